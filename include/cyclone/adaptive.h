@@ -0,0 +1,92 @@
+#ifndef CYCLONE_ADAPTIVE_H
+#define CYCLONE_ADAPTIVE_H
+
+#include "pfgen.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Advances a group of particles and the force generators acting on
+     * them by a frame, in as many substeps as it takes to keep the error
+     * of each one under a tolerance.
+     *
+     * The error is estimated by step doubling: each substep is taken
+     * once whole and again as two halves, and the distance between the
+     * two results is the error. If it is too large the substep is tried
+     * again, shorter. Otherwise the more accurate two-half result is
+     * kept and the next substep is sized from how much room the error
+     * left. Calm motion soon grows to the longest substep allowed, and
+     * only frames with stiff or fast motion pay for short ones.
+     *
+     * A substep costs three force updates. A stepper looks after one
+     * group, such as one island of connected particles, and groups that
+     * don't interact can each have their own, so each takes the steps
+     * it needs. The registry must only act on the group's particles.
+     */
+    class AdaptiveStepper
+    {
+    protected:
+        /** Largest error allowed in one substep, in world units. */
+        real tolerance;
+
+        real minStep;
+        real maxStep;
+
+        /** The length the next substep will be tried at. */
+        real nextStep;
+
+        /** The group at the start of the current substep. */
+        std::vector<Particle> start;
+
+        /** Where the whole substep put each particle. */
+        std::vector<Vector3> coarsePositions;
+        std::vector<Vector3> coarseVelocities;
+
+        unsigned substeps;
+        unsigned rejected;
+        real largestError;
+
+        /** Updates the forces on the group and integrates it. */
+        void integrate(Particle *particles, unsigned count, ParticleForceRegistry &registry,
+                       real duration);
+
+    public:
+        AdaptiveStepper(real tolerance = 0.001f, real minStep = 0.001f, real maxStep = 0.05f);
+
+        /** Sets the largest error allowed per substep. */
+        void setTolerance(real tolerance);
+
+        real getTolerance() const;
+
+        /**
+         * Sets the shortest and longest substeps. The shortest is always
+         * accepted, whatever its error, so a frame can't take forever.
+         */
+        void setStepLimits(real minStep, real maxStep);
+
+        /**
+         * Advances the particles by the duration, updating the registry's
+         * forces for every substep, and returns the number of substeps
+         * kept. Forces already in the particles' accumulators are applied
+         * in the first substep.
+         */
+        unsigned advance(Particle *particles, unsigned count, ParticleForceRegistry &registry,
+                         real duration);
+
+        /** The length the next substep will be tried at. */
+        real getStepSize() const;
+
+        /** Substeps kept and thrown away since the last reset. */
+        unsigned getSubstepCount() const;
+
+        unsigned getRejectedCount() const;
+
+        /** Largest error of a kept substep since the last reset. */
+        real getLargestError() const;
+
+        void resetStats();
+    };
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef CYCLONE_COMMANDQUEUE_H
+#define CYCLONE_COMMANDQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include "core.h"
+
+namespace cyclone
+{
+    /**
+     * Carries commands from any number of threads, such as input,
+     * gameplay or network threads, to the one thread stepping the
+     * simulation, without locks.
+     *
+     * The queue is a fixed ring of cells, each with a sequence number
+     * saying whose turn it is. A producer claims a cell by moving the
+     * tail on with a compare and swap, writes its command and then
+     * publishes it by bumping the cell's sequence. The consumer reads
+     * cells in order, handing each back to the producers the same way.
+     * Neither side ever waits for the other: a push onto a full queue
+     * fails, and a drain stops at the first cell whose producer hasn't
+     * finished writing, leaving it for next time.
+     */
+    template <class Command>
+    class CommandQueue
+    {
+    protected:
+        struct Cell
+        {
+            std::atomic<unsigned> sequence;
+            Command command;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+
+        unsigned mask;
+
+        /** Next cell to claim, shared by every producer. */
+        std::atomic<unsigned> tail;
+
+        /** Keeps the producers' tail off the consumer's cache line. */
+        char padding[64];
+
+        /** Next cell to read. Consumer only. */
+        unsigned head;
+
+        std::atomic<unsigned long long> dropped;
+
+    public:
+        /** Creates a queue with room for at least the given number of commands. */
+        CommandQueue(unsigned capacity = 1024)
+            : tail(0), head(0), dropped(0)
+        {
+            unsigned size = 2;
+            while (size < capacity) size <<= 1;
+
+            cells.reset(new Cell[size]);
+            mask = size - 1;
+            for (unsigned i = 0; i < size; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        unsigned getCapacity() const
+        {
+            return mask + 1;
+        }
+
+        /**
+         * Adds a command. Returns false, dropping it, if the queue is
+         * full. Any thread.
+         */
+        bool push(const Command &command)
+        {
+            unsigned position = tail.load(std::memory_order_relaxed);
+            Cell *cell;
+            for (;;)
+            {
+                cell = &cells[position & mask];
+                int wait = (int)(cell->sequence.load(std::memory_order_acquire) - position);
+                if (wait == 0)
+                {
+                    if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+                }
+                else if (wait < 0)
+                {
+                    // the consumer hasn't read the cell from a lap ago.
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    position = tail.load(std::memory_order_relaxed);
+                }
+            }
+
+            cell->command = command;
+            cell->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Takes the oldest command, if it has been written. Consumer
+         * only.
+         */
+        bool pop(Command &command)
+        {
+            Cell &cell = cells[head & mask];
+            if ((int)(cell.sequence.load(std::memory_order_acquire) - (head + 1)) < 0) return false;
+
+            command = cell.command;
+            cell.sequence.store(head + mask + 1, std::memory_order_release);
+            head++;
+            return true;
+        }
+
+        /**
+         * Passes every command pushed before the call to the handler, in
+         * order, and returns how many there were. Commands pushed while
+         * it runs wait for the next drain, so producers that never stop
+         * can't keep it going. Consumer only.
+         */
+        template <class Handler>
+        unsigned drain(Handler handler)
+        {
+            const unsigned end = tail.load(std::memory_order_acquire);
+
+            unsigned count = 0;
+            Command command;
+            while ((int)(end - head) > 0 && pop(command))
+            {
+                handler(command);
+                count++;
+            }
+            return count;
+        }
+
+        /** Number of commands dropped because the queue was full. */
+        unsigned long long getDroppedCount() const
+        {
+            return dropped.load(std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * A change to a simulation's particles asked for from outside its
+     * step. What a spawn launches, and how, is up to the simulation.
+     */
+    struct ParticleCommand
+    {
+        enum Action
+        {
+            SPAWN,
+            IMPULSE,
+            REMOVE
+        };
+
+        Action action;
+
+        /** The type to spawn, in the simulation's own numbering, and how many. */
+        unsigned type;
+        unsigned count;
+
+        /**
+         * The particle slot an impulse or removal is for. Whatever is in
+         * the slot when the command is applied gets it, and a free slot
+         * is left alone.
+         */
+        unsigned index;
+
+        /** Change in momentum, for an impulse. */
+        Vector3 impulse;
+
+        static ParticleCommand spawn(unsigned type, unsigned count = 1)
+        {
+            ParticleCommand command = {SPAWN, type, count, 0, Vector3()};
+            return command;
+        }
+
+        static ParticleCommand push(unsigned index, const Vector3 &impulse)
+        {
+            ParticleCommand command = {IMPULSE, 0, 0, index, impulse};
+            return command;
+        }
+
+        static ParticleCommand remove(unsigned index)
+        {
+            ParticleCommand command = {REMOVE, 0, 0, index, Vector3()};
+            return command;
+        }
+    };
+
+    typedef CommandQueue<ParticleCommand> ParticleCommandQueue;
+}
+
+#endif
@@ -2,4 +2,27 @@
 #include "core.h"
 #include "particle.h"
 #include "random.h"
-#include "pfgen.h"
\ No newline at end of file
+#include "timer.h"
+#include "trace.h"
+#include "profile.h"
+#include "pfgen.h"
+#include "pbd.h"
+#include "parallel.h"
+#include "nbody.h"
+#include "spatial.h"
+#include "sph.h"
+#include "forcefield.h"
+#include "explosion.h"
+#include "snapshot.h"
+#include "trajectory.h"
+#include "replication.h"
+#include "sharedstate.h"
+#include "triplebuffer.h"
+#include "render.h"
+#include "store.h"
+#include "reorder.h"
+#include "multirate.h"
+#include "adaptive.h"
+#include "ensemble.h"
+#include "taskgraph.h"
+#include "commandqueue.h"
\ No newline at end of file
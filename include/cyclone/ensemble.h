@@ -0,0 +1,162 @@
+#ifndef CYCLONE_ENSEMBLE_H
+#define CYCLONE_ENSEMBLE_H
+
+#include "core.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Many independent worlds, each with one projectile in it, run side
+     * by side, for sweeps and Monte Carlo studies of how shots land as
+     * their mass, launch velocity and damping vary.
+     *
+     * Each world's state is spread over arrays, one per component, so
+     * the same step of neighbouring worlds can go through the vector
+     * units together, and threads each take a range of worlds. Worlds
+     * are run in small batches from launch to landing, while their state
+     * is still in cache, and a batch stops as soon as all of its worlds
+     * have.
+     *
+     * A projectile moves exactly as a Particle with a ParticleDrag on it
+     * would, and a world ends the way a BallisticRange round does: when
+     * it hits the ground, flies too far or has been flying too long.
+     */
+    class ProjectileEnsemble
+    {
+    public:
+        /**
+         * Where worlds are launched from and the ranges their launches
+         * are drawn from, along with what every world shares.
+         */
+        struct Setup
+        {
+            Vector3 position;
+
+            /** Each component is drawn from min to max. */
+            Vector3 minVelocity;
+            Vector3 maxVelocity;
+
+            real minMass;
+            real maxMass;
+
+            real minDamping;
+            real maxDamping;
+
+            /** Constant acceleration, such as gravity. */
+            Vector3 acceleration;
+
+            /** Drag force coefficients, as in ParticleDrag. */
+            real k1;
+            real k2;
+
+            /** A world ends once its projectile has flown this long. */
+            real maxAge;
+
+            /** Or has gone this far down range, in z. */
+            real maxRange;
+
+            Setup();
+        };
+
+        /** How a world ended. */
+        enum Result
+        {
+            FLYING = 0,
+            LANDED,
+            EXPIRED,
+            OUT_OF_RANGE
+        };
+
+        /** Totals over the worlds that have finished. */
+        struct Stats
+        {
+            unsigned worlds;
+            unsigned landed;
+            unsigned expired;
+            unsigned outOfRange;
+
+            /** Horizontal distance from launch to impact of the landed shots. */
+            real minDistance;
+            real maxDistance;
+            real meanDistance;
+            real deviation;
+
+            real meanFlightTime;
+
+            /**
+             * Landed shots counted by distance, in even bins from zero
+             * to the histogram range. The last bin also counts those
+             * beyond it.
+             */
+            std::vector<unsigned> histogram;
+            real histogramRange;
+        };
+
+    protected:
+        Setup setup;
+
+        unsigned count;
+
+        std::vector<real> positionX, positionY, positionZ;
+        std::vector<real> velocityX, velocityY, velocityZ;
+        std::vector<real> inverseMass;
+        std::vector<real> damping;
+        std::vector<real> age;
+
+        /** One while a world is running, zero once it has ended. */
+        std::vector<real> flying;
+
+        std::vector<unsigned char> results;
+
+        /** Runs a range of worlds until every one of them has ended. */
+        void run(unsigned begin, unsigned end, real duration);
+
+    public:
+        ProjectileEnsemble();
+
+        /**
+         * Sets up the given number of worlds with launches drawn from
+         * the setup's ranges. Each world has its own random generator,
+         * seeded from the seed and its index, so a world gets the same
+         * launch however many worlds there are.
+         */
+        void launch(const Setup &setup, unsigned count, unsigned seed = 1);
+
+        /**
+         * Gives one world a launch of its own, for sweeps over a grid of
+         * values rather than random draws.
+         */
+        void setWorld(unsigned world, const Vector3 &velocity, real mass, real damping);
+
+        unsigned getWorldCount() const;
+
+        /**
+         * Runs every world that is still flying, in fixed steps, until
+         * all of them have ended.
+         */
+        void run(real duration);
+
+        Result getResult(unsigned world) const;
+
+        /** Where the projectile is, or where it was when its world ended. */
+        Vector3 getPosition(unsigned world) const;
+
+        Vector3 getVelocity(unsigned world) const;
+
+        real getMass(unsigned world) const;
+
+        real getDamping(unsigned world) const;
+
+        /** How long the projectile has flown. */
+        real getFlightTime(unsigned world) const;
+
+        /**
+         * Gathers the totals of every finished world, with a histogram
+         * of the given number of bins covering distances up to the range.
+         */
+        void getStats(Stats &stats, unsigned bins = 10, real range = 200) const;
+    };
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef CYCLONE_EXPLOSION_H
+#define CYCLONE_EXPLOSION_H
+
+#include "particle.h"
+#include "spatial.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Applies radial blasts, such as explosions and shockwaves, to every
+     * particle within their radius. Blasts are queued during the frame and
+     * applied together: the particles are bucketed into a spatial grid once
+     * and each blast only visits the particles near it. The cells suit a
+     * blast of the median radius; larger blasts visit more of them, and
+     * one spanning more cells than there are particles tests every
+     * particle instead.
+     */
+    class ParticleExplosions
+    {
+    public:
+        typedef std::vector<Particle*> Particles;
+
+        enum BlastType
+        {
+            /** Changes velocity immediately, scaled by inverse mass. */
+            IMPULSE,
+            /** Adds a force for the next integration step. */
+            FORCE
+        };
+
+        struct Blast
+        {
+            Vector3 centre;
+            real radius;
+            /** Impulse or force at the centre, falling off linearly to zero at the radius. */
+            real strength;
+            BlastType type;
+        };
+
+    protected:
+        Particles particles;
+
+        typedef std::vector<Blast> Blasts;
+        Blasts blasts;
+
+        SpatialGrid grid;
+
+        /** Radii of the queued blasts, for sizing the grid's cells. */
+        std::vector<real> radii;
+
+        std::vector<Vector3> positions;
+
+        /** Accumulated velocity change and force of each particle. */
+        std::vector<Vector3> impulses;
+        std::vector<Vector3> forces;
+        std::vector<unsigned> touched;
+        std::vector<bool> isTouched;
+
+        /** Adds a blast's push to one particle within its radius. */
+        void push(const Blast &blast, unsigned index);
+
+    public:
+        ParticleExplosions();
+
+        void add(Particle *particle);
+
+        void remove(Particle *particle);
+
+        /**
+         * Follows the particles to their new places after they have been
+         * reordered, dropping any that were removed.
+         */
+        void remapParticles(const ParticleRemap &remap);
+
+        /**
+         * Removes all the particles. Queued blasts are kept.
+         */
+        void clear();
+
+        /**
+         * Queues a blast to be applied at the next call to apply().
+         */
+        void addBlast(const Vector3 &centre, real radius, real strength, BlastType type = IMPULSE);
+
+        unsigned getPendingBlastCount() const;
+
+        /**
+         * Applies every queued blast and empties the queue. Returns the
+         * number of particles that were affected.
+         */
+        unsigned apply();
+    };
+}
+
+#endif
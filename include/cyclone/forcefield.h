@@ -0,0 +1,138 @@
+#ifndef CYCLONE_FORCEFIELD_H
+#define CYCLONE_FORCEFIELD_H
+
+#include "particle.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * A field of vectors stored on a regular 3D grid and applied to a set
+     * of particles in one batch. This replaces analytic wind, vortex or
+     * turbulence generators, which would need a virtual call and a noise
+     * evaluation per particle, with a single trilinear lookup.
+     *
+     * A field may hold several frames, which are interpolated over time
+     * and loop, for fields that change during the simulation.
+     */
+    class ForceField
+    {
+    public:
+        typedef std::vector<Particle*> Particles;
+
+        /** How sampled vectors act on the particles. */
+        enum Mode
+        {
+            /** The sample is a force. */
+            FORCE,
+            /** The sample is an acceleration, scaled by particle mass. */
+            ACCELERATION,
+            /** The sample is a flow velocity the particle is dragged towards. */
+            VELOCITY
+        };
+
+    protected:
+        Particles particles;
+
+        /** World position of the first grid point. */
+        Vector3 origin;
+
+        real cellSize;
+
+        real inverseCellSize;
+
+        /** Number of grid points along each axis, at least two. */
+        unsigned sizeX, sizeY, sizeZ;
+
+        unsigned frameCount;
+
+        /** Time between two frames of a time varying field. */
+        real frameDuration;
+
+        /** Current time of the field, used to pick frames. */
+        real time;
+
+        Mode mode;
+
+        /** Drag coefficient in VELOCITY mode. */
+        real drag;
+
+        /** Grid vectors, x fastest, then y, z and frame. */
+        std::vector<Vector3> values;
+
+        /** Scratch buffers for the batch. */
+        std::vector<Vector3> positions;
+        std::vector<Vector3> samples;
+
+        unsigned index(unsigned x, unsigned y, unsigned z, unsigned frame) const
+        {
+            return ((frame * sizeZ + z) * sizeY + y) * sizeX + x;
+        }
+
+        /** Samples a single frame at the given block of positions. */
+        void sampleFrame(unsigned frame, const Vector3 *positions, Vector3 *results,
+                         unsigned count, real weight, bool accumulate) const;
+
+    public:
+        ForceField(const Vector3 &origin, real cellSize,
+                   unsigned sizeX, unsigned sizeY, unsigned sizeZ,
+                   unsigned frameCount = 1, real frameDuration = 1);
+
+        void add(Particle *particle);
+
+        void remove(Particle *particle);
+
+        /**
+         * Follows the particles to their new places after they have been
+         * reordered, dropping any that were removed.
+         */
+        void remapParticles(const ParticleRemap &remap);
+
+        void clear();
+
+        void setMode(Mode mode, real drag = 1);
+
+        void setTime(real time);
+
+        real getTime() const;
+
+        /** Returns the world position of the given grid point. */
+        Vector3 getPoint(unsigned x, unsigned y, unsigned z) const;
+
+        void setValue(unsigned x, unsigned y, unsigned z, const Vector3 &value, unsigned frame = 0);
+
+        const Vector3& getValue(unsigned x, unsigned y, unsigned z, unsigned frame = 0) const;
+
+        /**
+         * Fills the grid from a function, called as fn(position, time) at
+         * every grid point of every frame. Intended to be run once at load
+         * time so the function is never evaluated during simulation.
+         */
+        template <class Function>
+        void bake(Function fn)
+        {
+            for (unsigned frame = 0; frame < frameCount; frame++)
+            for (unsigned z = 0; z < sizeZ; z++)
+            for (unsigned y = 0; y < sizeY; y++)
+            for (unsigned x = 0; x < sizeX; x++)
+            {
+                values[index(x, y, z, frame)] = fn(getPoint(x, y, z), frame * frameDuration);
+            }
+        }
+
+        /**
+         * Samples the field at the current time with trilinear
+         * interpolation for a batch of positions. Positions outside the
+         * grid take the value at the nearest border.
+         */
+        void sample(const Vector3 *positions, Vector3 *results, unsigned count) const;
+
+        /**
+         * Samples the field for every particle, adds the resulting force
+         * and then advances the field time by the duration.
+         */
+        void updateForces(real duration);
+    };
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef CYCLONE_MORTON_H
+#define CYCLONE_MORTON_H
+
+#include "core.h"
+
+namespace cyclone
+{
+    /** Number of bits per axis in a 64 bit morton code. */
+    const unsigned MORTON_BITS = 21;
+
+    /**
+     * Spreads the low 21 bits of the value so there are two zero bits
+     * between each of them.
+     */
+    inline unsigned long long mortonSpread(unsigned long long v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8) & 0x100f00f00f00f00fULL;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2) & 0x1249249249249249ULL;
+        return v;
+    }
+
+    /**
+     * Interleaves three 21 bit cell coordinates into a morton code, with x
+     * in the lowest bit of each triple.
+     */
+    inline unsigned long long mortonEncode(unsigned x, unsigned y, unsigned z)
+    {
+        return mortonSpread(x) | (mortonSpread(y) << 1) | (mortonSpread(z) << 2);
+    }
+
+    /**
+     * Returns the morton code of a position inside the box starting at
+     * origin, where scale converts world units to cells. Positions outside
+     * the box are clamped to it.
+     */
+    inline unsigned long long mortonCode(const Vector3 &position, const Vector3 &origin, real scale)
+    {
+        const real maxCell = (real)((1u << MORTON_BITS) - 1);
+
+        real x = (position.x - origin.x) * scale;
+        real y = (position.y - origin.y) * scale;
+        real z = (position.z - origin.z) * scale;
+
+        x = x < 0 ? 0 : (x > maxCell ? maxCell : x);
+        y = y < 0 ? 0 : (y > maxCell ? maxCell : y);
+        z = z < 0 ? 0 : (z > maxCell ? maxCell : z);
+
+        return mortonEncode((unsigned)x, (unsigned)y, (unsigned)z);
+    }
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef CYCLONE_MULTIRATE_H
+#define CYCLONE_MULTIRATE_H
+
+#include "particle.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Decides which particles are updated on each step, so that those
+     * that don't need full accuracy, such as slow, heavily damped smoke,
+     * can be updated every second, fourth or eighth step instead.
+     *
+     * A particle at level L is updated every 2^L steps, with the time
+     * that has passed since its last update. Each level is split into
+     * 2^L buckets that fall due on different steps, and particles join
+     * the emptiest bucket of their level, so the slow particles are
+     * spread evenly over the steps rather than all updating together.
+     *
+     * Particles are known by their index in their array. Their bucket
+     * is kept in a small array of its own, so finding the particles that
+     * are due means scanning that rather than the particles themselves,
+     * and they come out in index order.
+     *
+     * Particles that are between updates still take part in everything
+     * else: their positions are read where they were last updated, and
+     * forces and impulses can be applied to them at any time. Impulses
+     * change their velocity straight away. Forces pile up in their
+     * accumulators, and integrate averages them over the steps they were
+     * added in, so a force added on every step pushes a slow particle as
+     * hard as a fast one.
+     */
+    class MultiRateScheduler
+    {
+    public:
+        /** Most levels a scheduler can have, giving one update in 128. */
+        static const unsigned MAX_LEVELS = 8;
+
+    protected:
+        /** Marks a particle that isn't scheduled. */
+        static const unsigned char NO_BUCKET = 0xff;
+
+        struct Bucket
+        {
+            /** Time and steps since the start of the bucket's interval. */
+            real elapsed;
+            unsigned steps;
+
+            /** First step of the current interval. */
+            unsigned start;
+
+            unsigned members;
+
+            bool due;
+        };
+
+        unsigned levelCount;
+
+        /** Steps taken so far, counting the current one. */
+        unsigned step;
+
+        /**
+         * The buckets of each level, one after another: level L has 2^L
+         * of them, starting at 2^L - 1.
+         */
+        std::vector<Bucket> buckets;
+
+        /** Bucket of every particle, or NO_BUCKET. */
+        std::vector<unsigned char> bucketOf;
+
+        /**
+         * Step each particle was last updated or added on, and how far
+         * into its bucket's interval that was.
+         */
+        std::vector<unsigned> stamps;
+        std::vector<real> offsets;
+        std::vector<unsigned> offsetSteps;
+
+    public:
+        MultiRateScheduler(unsigned levels = 4, unsigned size = 0);
+
+        unsigned getLevelCount() const;
+
+        /** Changes the number of particle slots. New ones aren't scheduled. */
+        void resize(unsigned size);
+
+        /**
+         * Schedules a particle at the given level, clamped to the last
+         * one, moving it if it was already scheduled. It counts from the
+         * end of the current step, so it isn't due again until a later
+         * one.
+         */
+        void add(unsigned index, unsigned level);
+
+        /** Stops scheduling a particle. */
+        void remove(unsigned index);
+
+        bool isScheduled(unsigned index) const;
+
+        /** The level of a scheduled particle. */
+        unsigned getLevel(unsigned index) const;
+
+        /**
+         * Starts the next step, of the given duration, and works out
+         * which buckets are due.
+         */
+        void advance(real duration);
+
+        /** True if the particle should be updated on this step. */
+        bool isDue(unsigned index) const
+        {
+            unsigned char bucket = bucketOf[index];
+            return bucket != NO_BUCKET && buckets[bucket].due && stamps[index] != step;
+        }
+
+        /**
+         * Returns the time that has passed since a due particle was last
+         * updated, and marks it as updated. If steps is given it receives
+         * the number of steps that time covers.
+         */
+        real take(unsigned index, unsigned *steps = NULL);
+
+        /**
+         * Takes a due particle and integrates it over the time since its
+         * last update, averaging the forces added to it over that time.
+         * Returns the duration it was integrated for.
+         */
+        real integrate(unsigned index, Particle &particle);
+
+        /** Integrates every due particle of the array. */
+        void integrate(Particle *particles);
+
+        /** Number of particles scheduled at each level. */
+        unsigned getScheduledCount(unsigned level) const;
+    };
+}
+
+#endif
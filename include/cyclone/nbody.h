@@ -0,0 +1,134 @@
+#ifndef CYCLONE_NBODY_H
+#define CYCLONE_NBODY_H
+
+#include "particle.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Mutual gravitational attraction between a set of particles. Rather
+     * than registering a generator for every pair, the stage builds a
+     * Barnes-Hut octree over the particles each step and approximates
+     * distant groups of particles by their centre of mass, giving
+     * O(n log n) force evaluation.
+     */
+    class ParticleNBodyGravity
+    {
+    public:
+        typedef std::vector<Particle*> Particles;
+
+        /**
+         * Error of the tree forces measured against direct summation.
+         */
+        struct Accuracy
+        {
+            /** Largest relative error of any sampled particle. */
+            real maxRelativeError;
+            /** Root mean square relative error over the samples. */
+            real rmsRelativeError;
+            unsigned samples;
+        };
+
+    protected:
+        /**
+         * Holds one cell of the octree. The particles of the cell are the
+         * range [begin, end) of the morton sorted arrays.
+         */
+        struct Node
+        {
+            Vector3 centreOfMass;
+            real mass;
+            /** Edge length of the cell. */
+            real size;
+            unsigned begin;
+            unsigned end;
+            /** Index of each child node, or -1 if there is none. */
+            int children[8];
+            bool leaf;
+        };
+
+        Particles particles;
+
+        /** Gravitational constant G. */
+        real gravitationalConstant;
+
+        /** Squared softening length, removes the singularity at r = 0. */
+        real softening;
+
+        /**
+         * Opening angle. A cell is treated as a single mass when its size
+         * over its distance is below this value; zero is direct summation.
+         */
+        real theta;
+
+        /** Maximum number of particles held by a leaf cell. */
+        unsigned leafSize;
+
+        std::vector<Node> nodes;
+
+        /** Morton code and source particle of each sorted entry. */
+        std::vector<unsigned long long> codes;
+        std::vector<unsigned> order;
+
+        /** Positions and masses in morton order. */
+        std::vector<Vector3> positions;
+        std::vector<real> masses;
+
+        int buildNode(std::vector<Node> &out, unsigned begin, unsigned end,
+                      unsigned level, real size) const;
+
+        void splitRange(unsigned begin, unsigned end, unsigned level, unsigned ranges[9]) const;
+
+        /**
+         * Accumulates the tree approximation of the acceleration at the
+         * given sorted entry.
+         */
+        Vector3 treeAcceleration(unsigned index) const;
+
+        /** Accumulates the exact acceleration at the given sorted entry. */
+        Vector3 directAcceleration(unsigned index) const;
+
+    public:
+        ParticleNBodyGravity(real gravitationalConstant, real theta = 0.5f, real softening = 0.01f);
+
+        void add(Particle *particle);
+
+        void remove(Particle *particle);
+
+        /**
+         * Follows the particles to their new places after they have been
+         * reordered, dropping any that were removed.
+         */
+        void remapParticles(const ParticleRemap &remap);
+
+        void clear();
+
+        void setTheta(real theta);
+
+        void setSoftening(real softening);
+
+        void setLeafSize(unsigned leafSize);
+
+        /**
+         * Rebuilds the octree from the current particle positions. Only
+         * particles with finite mass take part.
+         */
+        void build();
+
+        /**
+         * Builds the octree and adds the gravitational force on every
+         * particle to its accumulator.
+         */
+        void updateForces(real duration);
+
+        /**
+         * Compares the forces of the last built tree against direct
+         * summation for up to the given number of particles, spread evenly
+         * through the set. Zero samples every particle.
+         */
+        Accuracy measureAccuracy(unsigned sampleCount = 0) const;
+    };
+}
+
+#endif
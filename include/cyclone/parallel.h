@@ -0,0 +1,74 @@
+#ifndef CYCLONE_PARALLEL_H
+#define CYCLONE_PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include "profile.h"
+
+namespace cyclone
+{
+    /**
+     * Returns the number of threads that parallel stages split their
+     * work across.
+     */
+    unsigned getWorkerCount();
+
+    /**
+     * Sets the number of threads used by parallel stages. Zero selects
+     * the hardware concurrency and one runs everything on the calling
+     * thread.
+     */
+    void setWorkerCount(unsigned count);
+
+    /**
+     * Splits the range [begin, end) into contiguous blocks and calls
+     * body(blockBegin, blockEnd) for each block, one block per worker.
+     * Blocks are never smaller than the grain, so small ranges run on the
+     * calling thread without starting any threads.
+     */
+    template <class Body>
+    void parallelFor(unsigned begin, unsigned end, unsigned grain, Body body)
+    {
+        if (end <= begin) return;
+        if (grain == 0) grain = 1;
+
+        unsigned count = end - begin;
+        unsigned blocks = (count + grain - 1) / grain;
+        unsigned workers = getWorkerCount();
+        if (blocks > workers) blocks = workers;
+
+        if (blocks <= 1)
+        {
+            body(begin, end);
+            return;
+        }
+
+        unsigned blockSize = (count + blocks - 1) / blocks;
+
+#ifdef CYCLONE_PROFILE
+        // workers show up in a trace under the name of the calling stage.
+        const char *scope = Trace::getCurrentScope();
+#endif
+
+        // the calling thread takes the first block.
+        std::vector<std::thread> threads;
+        threads.reserve(blocks - 1);
+        for (unsigned start = begin + blockSize; start < end; start += blockSize)
+        {
+            unsigned stop = start + blockSize < end ? start + blockSize : end;
+            threads.push_back(std::thread([=, &body]() {
+                CYCLONE_TRACE_SCOPE(scope);
+                body(start, stop);
+            }));
+        }
+
+        body(begin, begin + blockSize);
+
+        for (unsigned i = 0; i < threads.size(); i++)
+        {
+            threads[i].join();
+        }
+    }
+}
+
+#endif
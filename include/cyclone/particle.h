@@ -1,6 +1,7 @@
 #ifndef CYCLONE_PARTICLE_H
 #define CYCLONE_PARTICLE_H
 
+#include <stddef.h>
 #include "core.h"
 
 namespace cyclone
@@ -35,6 +36,11 @@ namespace cyclone
         Vector3 forceAccum;
 
     public:
+        /**
+         * Creates a particle at rest at the origin with infinite mass.
+         */
+        Particle() : damping(1), inverseMass(0) {}
+
         /** Integrates particle forward in time.
          * This function uses newton-euler integration method.
          */
@@ -88,6 +94,58 @@ namespace cyclone
          * Adds the given force to the particle to be applied at the next iteration.
          */
         void addForce(const Vector3 &force);
+
+        /**
+         * Returns the force accumulated since the last integration step.
+         */
+        Vector3 getAccumulatedForce() const;
+    };
+
+    /**
+     * Says where each particle of an array went when the array was
+     * reordered or compacted, so anything holding pointers to them can
+     * follow.
+     */
+    class ParticleRemap
+    {
+    protected:
+        Particle *particles;
+        unsigned count;
+
+        /** New index of each old particle, ~0 for one that was removed. */
+        const unsigned *newIndices;
+
+    public:
+        ParticleRemap()
+            : particles(NULL), count(0), newIndices(NULL)
+        {
+        }
+
+        /** The array, as it is now, and the new index of every old slot. */
+        ParticleRemap(Particle *particles, unsigned count, const unsigned *newIndices)
+            : particles(particles), count(count), newIndices(newIndices)
+        {
+        }
+
+        /**
+         * Returns the new place of a particle that was in the array, or
+         * NULL if it was removed. Other particles are returned as they
+         * are.
+         */
+        Particle* operator()(Particle *particle) const
+        {
+            if (particle < particles || particle >= particles + count) return particle;
+
+            unsigned index = newIndices[particle - particles];
+            return index == ~0u ? NULL : particles + index;
+        }
+
+        /**
+         * Remaps a list of particles in place, dropping removed ones and
+         * putting the rest in the order they are in memory. Returns the
+         * new length of the list.
+         */
+        unsigned remapList(Particle **list, unsigned length) const;
     };
 }
 
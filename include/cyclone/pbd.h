@@ -0,0 +1,206 @@
+#ifndef CYCLONE_PBD_H
+#define CYCLONE_PBD_H
+
+#include "particle.h"
+#include <vector>
+
+namespace cyclone
+{
+    class ParticleConstraintSolver;
+
+    /**
+     * A constraint projected directly on predicted particle positions by
+     * the position based solver. Particles are referred to by the index
+     * they were given when added to the solver.
+     */
+    class ParticleConstraint
+    {
+    public:
+        virtual ~ParticleConstraint() {}
+
+        /**
+         * Moves the predicted positions of the constrained particles
+         * towards satisfying the constraint.
+         */
+        virtual void project(ParticleConstraintSolver *solver) = 0;
+    };
+
+    /**
+     * Keeps two particles at a fixed distance. This is the positional
+     * equivalent of ParticleSpring.
+     */
+    class ParticleDistanceConstraint : public ParticleConstraint
+    {
+        unsigned a;
+        unsigned b;
+        real restLength;
+        /** Fraction of the error removed per projection, in [0, 1]. */
+        real stiffness;
+
+    public:
+        ParticleDistanceConstraint(unsigned a, unsigned b, real restLength, real stiffness = 1);
+        virtual void project(ParticleConstraintSolver *solver);
+    };
+
+    /**
+     * Resists bending of the chain b0 - v - b1 by keeping the middle
+     * particle at its rest distance from the centroid of the triangle.
+     */
+    class ParticleBendingConstraint : public ParticleConstraint
+    {
+        unsigned b0;
+        unsigned v;
+        unsigned b1;
+        real restDistance;
+        real stiffness;
+
+    public:
+        /**
+         * Creates the constraint, taking the rest shape from the current
+         * particle positions.
+         */
+        ParticleBendingConstraint(const ParticleConstraintSolver &solver,
+                                  unsigned b0, unsigned v, unsigned b1, real stiffness = 1);
+        virtual void project(ParticleConstraintSolver *solver);
+    };
+
+    /**
+     * Keeps every particle of the solver on the positive side of a plane.
+     */
+    class ParticlePlaneConstraint : public ParticleConstraint
+    {
+        Vector3 normal;
+        real offset;
+        real radius;
+
+    public:
+        ParticlePlaneConstraint(const Vector3 &normal, real offset, real radius = 0);
+        virtual void project(ParticleConstraintSolver *solver);
+    };
+
+    /**
+     * Stops two particles from getting closer than the given distance.
+     */
+    class ParticleCollisionConstraint : public ParticleConstraint
+    {
+        unsigned a;
+        unsigned b;
+        real minDistance;
+
+    public:
+        ParticleCollisionConstraint(unsigned a, unsigned b, real minDistance);
+        virtual void project(ParticleConstraintSolver *solver);
+    };
+
+    /**
+     * Position based dynamics solver. Each step predicts particle positions
+     * from their velocity and accumulated forces, projects the constraints
+     * on the predicted positions and derives the new velocity from the
+     * change in position. The inverse mass of each particle is used as its
+     * constraint weight, so particles with infinite mass stay pinned.
+     */
+    class ParticleConstraintSolver
+    {
+    public:
+        enum Mode
+        {
+            /** Corrections are applied as soon as they are computed. */
+            GAUSS_SEIDEL,
+            /** Corrections are averaged and applied after each iteration. */
+            JACOBI
+        };
+
+    protected:
+        typedef std::vector<Particle*> Particles;
+        Particles particles;
+
+        typedef std::vector<ParticleConstraint*> Constraints;
+        Constraints constraints;
+
+        /** Positions at the start of the step. */
+        std::vector<Vector3> previous;
+
+        /** Positions being projected during the step. */
+        std::vector<Vector3> predicted;
+
+        /** Accumulated corrections when running in jacobi mode. */
+        std::vector<Vector3> deltas;
+        std::vector<unsigned> deltaCounts;
+
+        unsigned iterations;
+
+        Mode mode;
+
+        /** Over relaxation applied to averaged jacobi corrections. */
+        real relaxation;
+
+        void predict(real duration);
+
+        void applyDeltas();
+
+        /** Predicts, projects and updates velocities without clearing forces. */
+        void solve(real duration);
+
+        void clearAccumulators();
+
+    public:
+        ParticleConstraintSolver(unsigned iterations, Mode mode = GAUSS_SEIDEL);
+
+        /**
+         * Adds the particle to the solver, returning the index that
+         * constraints use to refer to it.
+         */
+        unsigned addParticle(Particle *particle);
+
+        /**
+         * Follows the particles to their new places after they have been
+         * reordered. Their indices stay the same, since constraints refer
+         * to them by index, so particles must be taken out of the solver
+         * before they are removed.
+         */
+        void remapParticles(const ParticleRemap &remap);
+
+        /**
+         * Adds a constraint to be projected at every iteration. The solver
+         * does not take ownership of the constraint.
+         */
+        void addConstraint(ParticleConstraint *constraint);
+
+        /**
+         * Removes all particles and constraints from the solver.
+         */
+        void clear();
+
+        unsigned getParticleCount() const;
+
+        void setIterations(unsigned iterations);
+
+        void setMode(Mode mode);
+
+        void setRelaxation(real relaxation);
+
+        const Vector3& getPredicted(unsigned index) const;
+
+        real getInverseMass(unsigned index) const;
+
+        /**
+         * Moves the predicted position of the given particle. In jacobi mode
+         * the correction is deferred until the end of the iteration.
+         */
+        void correct(unsigned index, const Vector3 &delta);
+
+        /**
+         * Advances all the particles of the solver by the given duration.
+         * Forces accumulated on the particles are applied and cleared.
+         */
+        void step(real duration);
+
+        /**
+         * Advances by the given duration in a number of equal substeps.
+         * Accumulated forces act over all the substeps.
+         */
+        void runPhysics(real duration, unsigned substeps = 1);
+    };
+}
+
+#endif
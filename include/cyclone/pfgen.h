@@ -2,21 +2,109 @@
 #define CYCLONE_PFGEN_H
 
 #include "particle.h"
+#include "taskgraph.h"
+#include <string>
 #include <vector>
+#ifdef CYCLONE_PROFILE
+    #include <mutex>
+    #include <typeinfo>
+#endif
 
 namespace cyclone
 {
     class ParticleForceGenerator
     {
     public:
+        virtual ~ParticleForceGenerator() {}
+
         /**
          * Update the force applied to the given particle.
          */
         virtual void updateForce(Particle *particle, real duration) = 0;
+
+        /**
+         * Follows any particles the generator refers to, other than the
+         * ones it is registered with, to their new places after they
+         * have been reordered. Returns false if one of them was removed,
+         * leaving the generator with nothing to act against.
+         */
+        virtual bool remapParticles(const ParticleRemap &) { return true; }
+    };
+
+    /**
+     * Cost of one type of force generator in one registry, collected
+     * when the library is built with CYCLONE_PROFILE and profiling is
+     * enabled.
+     */
+    struct ParticleForceStats
+    {
+        /** Name given to the registry. */
+        const char *registry;
+
+        /** Class name of the force generator. */
+        std::string type;
+
+        /** Number of updateForce calls, one per particle registered. */
+        unsigned long long calls;
+
+        /**
+         * Number of particles pushed, each counted once per update
+         * however many generators of the type it has.
+         */
+        unsigned long long particles;
+
+        /**
+         * Number of timed runs. Consecutive registrations of the same
+         * type are timed together, so the clock isn't read per call.
+         */
+        unsigned long long batches;
+
+        /**
+         * Time spent in the runs, less what reading the clock costs, so
+         * types whose registrations are interleaved with others aren't
+         * charged for the timer.
+         */
+        unsigned long long nanoseconds;
+
+        /** Longest single run. */
+        unsigned long long maxNanoseconds;
     };
 
     class ParticleForceRegistry
     {
+    public:
+        /**
+         * How updateForces adds up the forces of the generators when it
+         * splits them between threads. Whichever is used, a generator must
+         * only add force to the particle it is given.
+         */
+        enum Accumulation
+        {
+            /** One thread applies every registration in order. */
+            SERIAL,
+
+            /**
+             * The registrations are coloured so that no two of a colour
+             * push the same particle, and the colours are applied one
+             * after another, each split between threads. A particle's
+             * n-th registration is in the n-th colour, so forces add up
+             * in the same order, and to the same bits, as in serial.
+             * Suits meshes, where each particle has a few generators.
+             */
+            COLOURED,
+
+            /**
+             * The registrations are split into blocks, one per thread,
+             * each adding its forces into a buffer of its own, and the
+             * buffers are then summed particle by particle. Suits a few
+             * particles with many generators each, which would need many
+             * colours. The sums depend on how the registrations are split,
+             * unless the accumulation is made deterministic. Its
+             * generators aren't counted in the stats.
+             */
+            BUFFERED
+        };
+
     protected:
         /**
          * Keeps track of one force gennerator and the particle it applies to.
@@ -33,7 +121,98 @@ namespace cyclone
         typedef std::vector<ParticleForceRegistration> Registry;
         Registry registrations;
 
+        /** Name reported in the stats. */
+        const char *name;
+
+#ifdef CYCLONE_PROFILE
+        /** Cost counters, one per generator type seen since the last reset. */
+        struct TypeCounters
+        {
+            const std::type_info *type;
+            std::string name;
+            unsigned long long calls;
+            unsigned long long particles;
+            unsigned long long batches;
+            unsigned long long nanoseconds;
+            unsigned long long maxNanoseconds;
+        };
+        typedef std::vector<TypeCounters> Counters;
+        Counters counters;
+
+        /** Every generator type registered, worked out with the layouts below. */
+        std::vector<const std::type_info*> types;
+
+        /** The index into types of each registration's generator. */
+        std::vector<unsigned> typeSlots;
+
+        /**
+         * Whether each registration is the first of its type on its
+         * particle, so a particle is counted once per type.
+         */
+        std::vector<unsigned char> countsParticle;
+
+        /** Guards the counters when subsets are applied from several threads. */
+        mutable std::mutex countersMutex;
+
+        TypeCounters& getCounters(const std::type_info &type);
+
+        /**
+         * Applies the given registrations, or every one if there is no
+         * list, while timing each generator type and counting the
+         * particles it pushes.
+         */
+        void updateForcesMeasured(const unsigned *indices, unsigned count, real duration);
+#endif
+
+        /**
+         * Applies the given registrations, or every one if there is no
+         * list, in order.
+         */
+        void applyForces(const unsigned *indices, unsigned count, real duration);
+
+        Accumulation accumulation;
+
+        bool deterministic;
+
+        /** Whether the layouts below match the registrations. */
+        bool prepared;
+
+        /** Every particle registered, once each. */
+        std::vector<Particle*> particles;
+
+        /** The index into particles of each registration's particle. */
+        std::vector<unsigned> particleSlots;
+
+        /** The registrations of each colour, one colour after another. */
+        std::vector<unsigned> colourStarts;
+        std::vector<unsigned> colourIndices;
+
+        /**
+         * A task per colour on the worker pool, each waiting for the one
+         * before, so coloured updates don't start threads every step.
+         */
+        TaskGraph colourGraph;
+
+        /** Duration the colour tasks pass to the generators. */
+        real colourDuration;
+
+        /** The force buffers of the blocks, each x, y and z in turn. */
+        std::vector<real> buffers;
+
+        /** Works out the particles and colours, once per change. */
+        void prepare();
+
+        void updateForcesColoured(real duration);
+
+        void updateForcesBuffered(real duration);
+
     public:
+        ParticleForceRegistry(const char *name = "registry");
+
+        /** The colour tasks refer back to the registry, so it can't be copied. */
+        ParticleForceRegistry(const ParticleForceRegistry &) = delete;
+        ParticleForceRegistry& operator=(const ParticleForceRegistry &) = delete;
+
         /**
          * Registers the given force generator to apply to the given particle.
          */
@@ -50,6 +229,64 @@ namespace cyclone
          * Calls all the force generators to update the foces of their corresponding particles.
          */
         void updateForces(real duration);
+
+        /** Sets how forces are added up, serially by default. */
+        void setAccumulation(Accumulation accumulation);
+
+        Accumulation getAccumulation() const;
+
+        /**
+         * Makes buffered accumulation split the registrations into the
+         * same blocks however many threads there are, so its sums are the
+         * same from run to run and machine to machine, for the cost of
+         * more buffers than threads. Serial and coloured accumulation are
+         * always deterministic.
+         */
+        void setDeterministic(bool deterministic);
+
+        bool isDeterministic() const;
+
+        /** Number of colours coloured accumulation applies in turn. */
+        unsigned getColourCount();
+
+        /**
+         * Calls the force generators of the given registrations only, in
+         * the order given. Subsets that push different particles can be
+         * applied from several threads at once, as long as each one's
+         * generators only read the particles of the others.
+         */
+        void updateForces(const unsigned *indices, unsigned count, real duration);
+
+        /**
+         * Appends the cost of every generator type since the last reset,
+         * so the stats of several registries can be collected in one
+         * list. Nothing is added unless built with CYCLONE_PROFILE.
+         */
+        void getStats(std::vector<ParticleForceStats> &stats) const;
+
+        /** Zeroes the cost counters, normally once per frame. */
+        void resetStats();
+
+        unsigned getRegistrationCount() const;
+
+        Particle* getParticle(unsigned index) const;
+
+        ParticleForceGenerator* getForceGenerator(unsigned index) const;
+
+        /**
+         * Points the registrations at the particles' new places after
+         * they have been reordered, dropping those of removed particles.
+         * The registrations keep their order, which is usually the order
+         * the generators were created in, so forces add up exactly as
+         * before.
+         *
+         * Unless told otherwise the registered generators are remapped
+         * too, once each, and the registrations of any that lost a
+         * particle they refer to are dropped as well. A generator
+         * registered with several registries must only be remapped
+         * through one of them.
+         */
+        void remapParticles(const ParticleRemap &remap, bool generators = true);
     };
 
     class ParticleGravity : public ParticleForceGenerator
@@ -85,6 +322,7 @@ namespace cyclone
     public:
         ParticleSpring(Particle *other, real springConstant, real restLength);
         virtual void updateForce(Particle *particle, real duration);
+        virtual bool remapParticles(const ParticleRemap &remap);
     };
 
     class ParticleAnchoredSpring: public ParticleForceGenerator {
@@ -110,11 +348,13 @@ namespace cyclone
     public:
         ParticleBungee(Particle *other, real springConstant, real restLength);
         virtual void updateForce(Particle *particle, real duration);
+        virtual bool remapParticles(const ParticleRemap &remap);
     };
 
     class ParticleAnchoredBungee : public ParticleAnchoredSpring
     {
     public:
+        ParticleAnchoredBungee(Vector3 *anchor, real springConstant, real restLength);
         virtual void updateForce(Particle *particle, real duration);
     };
 
@@ -144,4 +384,4 @@ namespace cyclone
     };
 }
 
-#endif;
\ No newline at end of file
+#endif
\ No newline at end of file
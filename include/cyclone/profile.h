@@ -0,0 +1,144 @@
+#ifndef CYCLONE_PROFILE_H
+#define CYCLONE_PROFILE_H
+
+#include "timer.h"
+#include "trace.h"
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Timing counters of one named piece of code. Sections are created by
+     * CYCLONE_PROFILE_SCOPE, once per call site, and can be recorded into
+     * from any thread.
+     */
+    class ProfileSection
+    {
+    public:
+        const char *name;
+
+        /** Next section in the list of all sections. */
+        ProfileSection *next;
+
+        /** Counters of the frame in progress. */
+        std::atomic<unsigned long long> calls;
+        std::atomic<unsigned long long> nanoseconds;
+        std::atomic<unsigned long long> maxNanoseconds;
+
+        /** Counters of the last completed frame. */
+        unsigned long long lastCalls;
+        unsigned long long lastNanoseconds;
+        unsigned long long lastMaxNanoseconds;
+
+        /** Totals over all completed frames. */
+        unsigned long long frames;
+        unsigned long long totalCalls;
+        unsigned long long totalNanoseconds;
+        unsigned long long worstFrameNanoseconds;
+
+        ProfileSection(const char *name);
+
+        void record(unsigned long long duration);
+    };
+
+    /**
+     * Snapshot of the counters of one section.
+     */
+    struct ProfileStats
+    {
+        const char *name;
+
+        /** Calls and time in the last completed frame. */
+        unsigned long long calls;
+        double frameMilliseconds;
+        double maxCallMilliseconds;
+
+        /** Averages and peak over all completed frames. */
+        double averageCalls;
+        double averageFrameMilliseconds;
+        double worstFrameMilliseconds;
+    };
+
+    /**
+     * Collects the profile sections and rolls their counters over at the
+     * end of every frame.
+     */
+    class Profiler
+    {
+        static std::atomic<bool> enabled;
+
+    public:
+        static bool isEnabled()
+        {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        /** Turns recording on or off at run time. */
+        static void setEnabled(bool enabled);
+
+        /**
+         * Closes the frame in progress. Must not run at the same time as
+         * any profiled code.
+         */
+        static void endFrame();
+
+        /** Clears all counters of every section. */
+        static void reset();
+
+        static void getStats(std::vector<ProfileStats> &stats);
+
+        /** Adds a section to the list, called by its constructor. */
+        static void registerSection(ProfileSection *section);
+    };
+
+    /**
+     * Times its own lifetime into a section when profiling is enabled,
+     * and into the trace timeline when a trace is running.
+     */
+    class ProfileScope
+    {
+        ProfileSection *section;
+        bool traced;
+        unsigned long long start;
+
+    public:
+        ProfileScope(ProfileSection *section)
+            : section(Profiler::isEnabled() ? section : NULL),
+              traced(Trace::isEnabled()), start(0)
+        {
+            if (ProfileScope::section || traced) start = getTimeNanoseconds();
+            if (traced) traced = Trace::begin(section->name, start);
+        }
+
+        ~ProfileScope()
+        {
+            if (!section && !traced) return;
+
+            unsigned long long stop = getTimeNanoseconds();
+            if (section) section->record(stop - start);
+            if (traced) Trace::end(stop);
+        }
+    };
+}
+
+/**
+ * Profiles the rest of the enclosing block under the given name, and
+ * CYCLONE_TRACE_SCOPE adds it to the trace timeline only. Both expand to
+ * nothing unless the library is built with CYCLONE_PROFILE defined.
+ */
+#ifdef CYCLONE_PROFILE
+    #define CYCLONE_PROFILE_JOIN2(a, b) a##b
+    #define CYCLONE_PROFILE_JOIN(a, b) CYCLONE_PROFILE_JOIN2(a, b)
+    #define CYCLONE_PROFILE_SCOPE(name) \
+        static cyclone::ProfileSection CYCLONE_PROFILE_JOIN(profileSection, __LINE__)(name); \
+        cyclone::ProfileScope CYCLONE_PROFILE_JOIN(profileScope, __LINE__)(&CYCLONE_PROFILE_JOIN(profileSection, __LINE__))
+    #define CYCLONE_TRACE_SCOPE(name) \
+        cyclone::TraceScope CYCLONE_PROFILE_JOIN(traceScope, __LINE__)(name)
+#else
+    #define CYCLONE_PROFILE_SCOPE(name)
+    #define CYCLONE_TRACE_SCOPE(name)
+#endif
+
+#endif
@@ -26,6 +26,20 @@ namespace cyclone
 
         Vector3 randomVector(const Vector3 &min, const Vector3 &max);
 
+        /**
+         * Complete state of the generator. Restoring it continues the
+         * exact same sequence.
+         */
+        struct State
+        {
+            unsigned buffer[17];
+            int p1, p2;
+        };
+
+        State getState() const;
+
+        void setState(const State &state);
+
     private:
         int p1, p2;
         unsigned buffer[17];
@@ -0,0 +1,85 @@
+#ifndef CYCLONE_RENDER_H
+#define CYCLONE_RENDER_H
+
+#include "particle.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Vertices of the live particles, packed ready to hand to any
+     * renderer in one call: three floats of position and four bytes of
+     * colour (red, green, blue, alpha in memory order) per vertex.
+     */
+    struct RenderBuffer
+    {
+        std::vector<float> positions;
+        std::vector<unsigned> colours;
+        unsigned vertexCount;
+
+        RenderBuffer() : vertexCount(0) {}
+
+        /**
+         * Hashes the vertices, so the extract can be compared bit for
+         * bit without drawing anything.
+         */
+        unsigned long long checksum() const;
+    };
+
+    /**
+     * Turns a set of particles into a RenderBuffer.
+     *
+     * Each particle has a type, zero for a slot that isn't in use, which
+     * picks its colour from a lookup table. Particles become single
+     * points, or square billboards facing down the z axis, optionally
+     * with a copy mirrored in the ground plane. The particles are split
+     * into blocks that are counted and then written in parallel, always
+     * in the order they were given.
+     */
+    class RenderExtractor
+    {
+    public:
+        enum Primitive
+        {
+            POINTS,
+            QUADS
+        };
+
+    protected:
+        Primitive primitive;
+        real size;
+        bool reflect;
+
+        /** Packed colour of each type. */
+        std::vector<unsigned> colours;
+
+        /** Live particles in each block, then where each block starts. */
+        std::vector<unsigned> blockStarts;
+
+    public:
+        RenderExtractor(Primitive primitive = QUADS, real size = 0.1f, bool reflect = false);
+
+        /**
+         * Sets the shape of each particle. Size is half the width of a
+         * billboard. With reflect set, every particle is also drawn
+         * mirrored in the plane y = 0.
+         */
+        void setPrimitive(Primitive primitive, real size = 0.1f, bool reflect = false);
+
+        /** Number of vertices written for each live particle. */
+        unsigned getVerticesPerParticle() const;
+
+        /** Sets the colour of a type, each component from 0 to 1. */
+        void setColour(unsigned type, real red, real green, real blue, real alpha = 1);
+
+        /**
+         * Writes the vertices of every particle with a non zero type
+         * into the buffer, replacing what was there. Types past the end
+         * of the table are white.
+         */
+        void extract(const Particle *const *particles, const unsigned *types, unsigned count,
+                     RenderBuffer &buffer);
+    };
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef CYCLONE_REORDER_H
+#define CYCLONE_REORDER_H
+
+#include "store.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Sorts the particles of a store into morton order, so particles
+     * that are close in space are close in memory too.
+     *
+     * As particles spawn, die and move, the order they're stored in
+     * drifts away from where they are, and every pass that visits a
+     * particle's neighbours or spring partners ends up hopping around
+     * memory. Reordering every so often puts them back in step. The
+     * morton codes are sorted with a parallel radix sort, which skips the
+     * digits every code shares.
+     *
+     * After a reorder, the registries, springs and stages that point at
+     * the store's particles have to be told where they went, by passing
+     * getRemap() to their remapParticles methods.
+     */
+    class MortonReorder
+    {
+    protected:
+        /** Size of a morton cell, in world units. */
+        real cellSize;
+
+        std::vector<unsigned long long> keys;
+        std::vector<unsigned long long> keyScratch;
+        std::vector<unsigned> order;
+        std::vector<unsigned> orderScratch;
+        std::vector<unsigned> newIndices;
+
+        /** Per block digit counts, then where each block's digits go. */
+        std::vector<unsigned> histograms;
+
+        ParticleRemap remap;
+
+        void computeKeys(const Particle *particles, unsigned count);
+
+        void sortKeys(unsigned count);
+
+    public:
+        MortonReorder(real cellSize = 1);
+
+        /**
+         * Sets the size of the cells that particles are sorted by. A
+         * size around the interaction radius is a good choice. It grows
+         * if needed to fit every particle in the morton grid.
+         */
+        void setCellSize(real cellSize);
+
+        /**
+         * Returns the fraction of particles that are stored after one
+         * with a higher morton code: zero for a sorted store and about a
+         * half for a random one.
+         */
+        real measureDisorder(const Particle *particles, unsigned count);
+
+        /**
+         * Works out the morton order of the particles without moving
+         * them. Element i of the result is the index of the particle
+         * that belongs at i.
+         */
+        const std::vector<unsigned>& sort(const Particle *particles, unsigned count);
+
+        /**
+         * Reorders the store, particles and columns together, if its
+         * disorder is above the threshold. Returns true if it did, in
+         * which case getRemap says where each particle went.
+         */
+        bool reorder(ParticleStore &store, real threshold = 0);
+
+        /** The remapping done by the last reorder. */
+        const ParticleRemap& getRemap() const;
+    };
+}
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef CYCLONE_REPLICATION_H
+#define CYCLONE_REPLICATION_H
+
+#include "particle.h"
+#include "random.h"
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * One packet on the wire.
+     */
+    typedef std::vector<unsigned char> ReplicationPacket;
+    typedef std::vector<ReplicationPacket> ReplicationPackets;
+
+    /**
+     * Turns the state of a set of particles into a stream of small
+     * packets for observers in other processes.
+     *
+     * Positions and velocities are quantised to a fixed precision and
+     * compared with the last frame the observer acknowledged. Only the
+     * particles that changed are sent, each as bit packed differences
+     * using just as many bits as the differences need. Until the first
+     * acknowledgement every frame is sent against an all zero state.
+     *
+     * A frame is split into packets of at most the given size, so each
+     * fits in one datagram. Particles are identified by their position
+     * in the list, which should stay the same from frame to frame.
+     */
+    class ReplicationEncoder
+    {
+    public:
+        /** Frames kept for use as baselines. */
+        enum { HISTORY = 64 };
+
+    protected:
+        real positionPrecision;
+        real velocityPrecision;
+        unsigned maxPacketSize;
+
+        unsigned sequence;
+        unsigned baseline;
+
+        /** Quantised frames sent recently, oldest first. */
+        struct Frame
+        {
+            unsigned sequence;
+            std::vector<int> state;
+        };
+        std::deque<Frame> history;
+
+        const Frame* findFrame(unsigned sequence) const;
+
+        /** Writes the header of a packet, all but its particle count. */
+        void startPacket(ReplicationPacket &packet, unsigned sequence, unsigned baseline,
+                         unsigned count, unsigned first, unsigned slice) const;
+
+    public:
+        ReplicationEncoder(real positionPrecision = 0.001f, real velocityPrecision = 0.01f,
+                           unsigned maxPacketSize = 1200);
+
+        /**
+         * Encodes the particles as the next frame, replacing the contents
+         * of the packet list. Returns the frame's sequence number.
+         */
+        unsigned encode(const Particle *const *particles, unsigned count, ReplicationPackets &packets);
+
+        /**
+         * Handles a packet sent back by a decoder. Returns false if it
+         * isn't an acknowledgement.
+         */
+        bool receive(const unsigned char *data, unsigned size);
+
+        /** Marks a frame as received, making it the new baseline. */
+        void acknowledge(unsigned sequence);
+
+        /** Sequence number of the baseline, zero for none. */
+        unsigned getBaseline() const;
+    };
+
+    /**
+     * Rebuilds the particle state from the packets of a
+     * ReplicationEncoder. Packets may arrive late, twice or not at all;
+     * a frame becomes current once all its packets are in. Several
+     * frames are assembled at once, so the packets of consecutive
+     * frames may arrive mixed together.
+     *
+     * Packets come from the network, so anything that doesn't fit what
+     * an encoder could have sent, or that describes more particles than
+     * the decoder was told to expect, is dropped before any memory is
+     * set aside for it.
+     */
+    class ReplicationDecoder
+    {
+    public:
+        /** Frames assembled at once, the oldest giving way to newer ones. */
+        enum { PENDING = 4 };
+
+    protected:
+        struct Frame
+        {
+            unsigned sequence;
+            std::vector<int> state;
+        };
+        std::deque<Frame> history;
+
+        /** A frame being assembled from its packets. */
+        struct Pending
+        {
+            Frame frame;
+            std::vector<bool> received;
+            unsigned receivedCount;
+        };
+
+        /** Frames being assembled, in sequence order. */
+        std::deque<Pending> pending;
+
+        unsigned maxParticles;
+
+        unsigned sequence;
+        real positionPrecision;
+        real velocityPrecision;
+
+        std::vector<Vector3> positions;
+        std::vector<Vector3> velocities;
+
+        const Frame* findFrame(unsigned sequence) const;
+
+    public:
+        /** Creates a decoder for frames of up to the given number of particles. */
+        ReplicationDecoder(unsigned maxParticles = 1 << 20);
+
+        /**
+         * Applies one packet. Returns true when it completes a frame,
+         * which then becomes the current state.
+         */
+        bool receive(const unsigned char *data, unsigned size);
+
+        /**
+         * Writes the acknowledgement of the current frame, to be sent
+         * back to the encoder.
+         */
+        void acknowledge(ReplicationPacket &packet) const;
+
+        /** Sequence number of the current frame, zero for none. */
+        unsigned getSequence() const;
+
+        const std::vector<Vector3>& getPositions() const;
+
+        const std::vector<Vector3>& getVelocities() const;
+    };
+
+    /**
+     * Carries packets between an encoder and a decoder.
+     */
+    class ReplicationTransport
+    {
+    public:
+        virtual ~ReplicationTransport() {}
+
+        virtual bool send(const unsigned char *data, unsigned size) = 0;
+
+        /**
+         * Takes the next packet if there is one, without waiting.
+         * Returns false if nothing has arrived.
+         */
+        virtual bool receive(ReplicationPacket &packet) = 0;
+    };
+
+    /**
+     * In process transport, for tests and for observers in the same
+     * process. Two endpoints are connected to each other, and a share of
+     * the packets can be dropped on purpose.
+     */
+    class LoopbackTransport : public ReplicationTransport
+    {
+    protected:
+        LoopbackTransport *peer;
+
+        std::mutex mutex;
+        std::deque<ReplicationPacket> queue;
+
+        real lossRate;
+        Random random;
+
+    public:
+        LoopbackTransport();
+
+        static void connect(LoopbackTransport &a, LoopbackTransport &b);
+
+        /** Drops the given fraction of the packets sent from here. */
+        void setLossRate(real lossRate, unsigned seed = 1);
+
+        virtual bool send(const unsigned char *data, unsigned size);
+        virtual bool receive(ReplicationPacket &packet);
+    };
+
+    /**
+     * UDP transport, sending to one peer. Only available on POSIX
+     * systems; open fails elsewhere.
+     */
+    class UdpTransport : public ReplicationTransport
+    {
+    protected:
+        int socket;
+        unsigned char peer[32];
+        unsigned peerSize;
+
+    public:
+        UdpTransport();
+        ~UdpTransport();
+
+        /**
+         * Binds to the given local port, zero for any, and sends to the
+         * given IPv4 address and port. Returns false on failure.
+         */
+        bool open(unsigned short localPort, const char *peerAddress, unsigned short peerPort);
+
+        void close();
+
+        virtual bool send(const unsigned char *data, unsigned size);
+        virtual bool receive(ReplicationPacket &packet);
+    };
+}
+
+#endif
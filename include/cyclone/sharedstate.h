@@ -0,0 +1,164 @@
+#ifndef CYCLONE_SHAREDSTATE_H
+#define CYCLONE_SHAREDSTATE_H
+
+#include "particle.h"
+#include <atomic>
+
+namespace cyclone
+{
+    /**
+     * Layout of the start of a shared state segment. The header is
+     * followed by three slots, each SharedStateHeader::slotSize bytes
+     * long and 64 byte aligned. A slot holds a SharedSlotHeader, then the
+     * positions as x y z floats, then the optional type and colour
+     * words, every array padded to 64 bytes.
+     *
+     * Each slot has a sequence number that is odd while the slot is being
+     * written. A reader takes the slot named by latest, notes its even
+     * sequence number, reads in place and then checks that the number is
+     * unchanged. The writer only comes back to a slot two frames later,
+     * so a reader has that long before its frame is overwritten.
+     */
+    struct SharedStateHeader
+    {
+        char magic[8];
+        unsigned version;
+        unsigned capacity;
+        unsigned attributes;
+        unsigned slotSize;
+
+        /** Index of the newest complete slot. */
+        std::atomic<unsigned> latest;
+        unsigned padding;
+
+        std::atomic<unsigned long long> sequences[3];
+    };
+
+    struct SharedSlotHeader
+    {
+        unsigned long long frame;
+        double time;
+        unsigned count;
+    };
+
+    /**
+     * A frame in a shared state segment, read in place.
+     */
+    struct SharedStateFrame
+    {
+        unsigned long long frame;
+        double time;
+        unsigned count;
+
+        /** Three floats per particle. */
+        const float *positions;
+
+        /** NULL unless the segment has the attribute. */
+        const unsigned *types;
+        const unsigned *colours;
+
+        unsigned slot;
+        unsigned long long sequence;
+    };
+
+    /**
+     * Publishes particle state into a POSIX shared memory segment for
+     * other processes to read, without locks and without ever waiting
+     * for them.
+     */
+    class SharedStateWriter
+    {
+    public:
+        /** Optional per particle words, combined as a bit mask. */
+        enum Attribute
+        {
+            TYPES = 1,
+            COLOURS = 2
+        };
+
+        /** Writable arrays of the slot being filled. */
+        struct Frame
+        {
+            float *positions;
+            unsigned *types;
+            unsigned *colours;
+            unsigned capacity;
+        };
+
+    protected:
+        SharedStateHeader *header;
+        unsigned long long size;
+        char name[256];
+
+        unsigned long long frames;
+        unsigned writing;
+
+        unsigned char* getSlot(unsigned slot) const;
+
+    public:
+        SharedStateWriter();
+        ~SharedStateWriter();
+
+        /**
+         * Creates the named segment, for example "/cyclone", with room
+         * for the given number of particles. Returns false on failure or
+         * where POSIX shared memory isn't available.
+         */
+        bool open(const char *name, unsigned capacity, unsigned attributes = 0);
+
+        /** Unmaps and removes the segment. */
+        void close();
+
+        /**
+         * Starts writing the next frame and returns its arrays, which
+         * stay writable until endFrame.
+         */
+        Frame beginFrame();
+
+        /** Makes the frame begun last the newest one. */
+        void endFrame(unsigned count, double time);
+
+        /**
+         * Writes and publishes a frame holding the given particles. The
+         * attribute arrays are only used if the segment has them.
+         */
+        void publish(const Particle *const *particles, unsigned count, double time,
+                     const unsigned *types = NULL, const unsigned *colours = NULL);
+    };
+
+    /**
+     * Reads frames published by a SharedStateWriter in another process.
+     */
+    class SharedStateReader
+    {
+    protected:
+        const SharedStateHeader *header;
+        unsigned long long size;
+
+    public:
+        SharedStateReader();
+        ~SharedStateReader();
+
+        /** Maps the named segment read only. */
+        bool open(const char *name);
+
+        void close();
+
+        unsigned getCapacity() const;
+
+        /**
+         * Points the frame at the newest complete frame, in place.
+         * Returns false if nothing has been published or the writer got
+         * in the way, in which case it's fine to try again.
+         */
+        bool acquire(SharedStateFrame &frame) const;
+
+        /**
+         * Checks that a frame wasn't overwritten while it was read. Only
+         * values read before this returns true can be trusted.
+         */
+        bool validate(const SharedStateFrame &frame) const;
+    };
+}
+
+#endif
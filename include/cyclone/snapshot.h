@@ -0,0 +1,172 @@
+#ifndef CYCLONE_SNAPSHOT_H
+#define CYCLONE_SNAPSHOT_H
+
+#include "particle.h"
+#include "pfgen.h"
+#include "random.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Read only view of a snapshot file, mapped into memory. Columns are
+     * handed out as pointers straight into the mapping, so tools that
+     * work on columns read them without any copy or parsing.
+     *
+     * A snapshot is little-endian and versioned. A 64 byte header is
+     * followed by a directory of columns, and each column is a 64 byte
+     * aligned array with one element per particle, registration, random
+     * generator or value.
+     */
+    class SnapshotFile
+    {
+    public:
+        /** Format version written by this library. */
+        enum { VERSION = 1 };
+
+        enum Column
+        {
+            /** Three reals per particle, x y z. */
+            POSITION,
+            VELOCITY,
+            ACCELERATION,
+            FORCE_ACCUMULATOR,
+
+            /** One real per particle. */
+            DAMPING,
+            INVERSE_MASS,
+
+            /** One 32 bit index per registration. */
+            REGISTRATION_PARTICLE,
+            REGISTRATION_GENERATOR,
+
+            /** Nineteen 32 bit words per generator, buffer then p1 and p2. */
+            RANDOM_STATE,
+
+            /**
+             * The application's own data for each particle: a 32 bit
+             * word from each of its arrays of words, then a real from
+             * each of its arrays of reals.
+             */
+            PARTICLE_WORDS,
+            PARTICLE_REALS,
+
+            /** One 32 bit word per value. */
+            VALUE,
+
+            COLUMN_COUNT
+        };
+
+    protected:
+        unsigned char *data;
+        unsigned long long size;
+        bool mapped;
+
+        unsigned realSize;
+        unsigned long long particleCount;
+        unsigned long long registrationCount;
+        unsigned long long generatorCount;
+        unsigned long long randomCount;
+        unsigned long long valueCount;
+
+        const unsigned char *columns[COLUMN_COUNT];
+        unsigned elementSizes[COLUMN_COUNT];
+
+        bool parse();
+
+    public:
+        SnapshotFile();
+        ~SnapshotFile();
+
+        /**
+         * Maps the given file and checks its header and directory.
+         * Returns false if the file can't be read or isn't a snapshot of
+         * a version this library understands.
+         */
+        bool open(const char *filename);
+
+        void close();
+
+        /** Size of a real in the file, 4 or 8 bytes. */
+        unsigned getRealSize() const;
+
+        unsigned long long getParticleCount() const;
+
+        unsigned long long getRegistrationCount() const;
+
+        /** Number of entries in the force generator table when saved. */
+        unsigned long long getGeneratorCount() const;
+
+        unsigned long long getRandomCount() const;
+
+        unsigned long long getValueCount() const;
+
+        /**
+         * Returns the raw little-endian data of a column, or NULL if the
+         * file doesn't have it. The pointer stays valid until the file is
+         * closed.
+         */
+        const void* getColumn(Column column, unsigned *elementSize = NULL) const;
+    };
+
+    /**
+     * Saves and restores the state of a simulation: every particle's
+     * motion and accumulators, the contents of a force registry, the
+     * state of any number of random generators and whatever else the
+     * application keeps, as arrays alongside the particles or as single
+     * values.
+     *
+     * The snapshot refers to objects the application owns. Force
+     * generators are stored as indices into the generators table, so
+     * the application has to create the same generators, in the same
+     * order, before restoring; their parameters are not saved.
+     */
+    class Snapshot
+    {
+    public:
+        typedef std::vector<Particle*> Particles;
+        typedef std::vector<ParticleForceGenerator*> Generators;
+        typedef std::vector<Random*> Randoms;
+        typedef std::vector<unsigned*> Words;
+        typedef std::vector<real*> Reals;
+
+        Particles particles;
+
+        /** Registry to save and rebuild, may be NULL. */
+        ParticleForceRegistry *registry;
+
+        Generators generators;
+
+        Randoms randoms;
+
+        /**
+         * Arrays with an element for each particle, such as the columns
+         * of a particle store.
+         */
+        Words particleWords;
+        Reals particleReals;
+
+        /** Single words, such as counters. */
+        Words values;
+
+        Snapshot();
+
+        /**
+         * Writes the state to the given file, one large sequential
+         * write per column. Returns false if the file can't be written or
+         * the registry uses a particle or generator missing from the
+         * tables.
+         */
+        bool save(const char *filename) const;
+
+        /**
+         * Restores the state from the given file. The tables must have
+         * the same sizes as when it was saved. The registry is cleared
+         * and rebuilt. Returns false, changing nothing, if the file
+         * doesn't match.
+         */
+        bool load(const char *filename);
+    };
+}
+
+#endif
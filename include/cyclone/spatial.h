@@ -0,0 +1,101 @@
+#ifndef CYCLONE_SPATIAL_H
+#define CYCLONE_SPATIAL_H
+
+#include "core.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Uniform grid over a set of points, stored as a hash table of cells
+     * so the grid is unbounded. Points are bucketed by a counting sort on
+     * their cell hash, so building is linear in the number of points.
+     */
+    class SpatialGrid
+    {
+    protected:
+        real cellSize;
+
+        real inverseCellSize;
+
+        /** Number of hash buckets, always a power of two. */
+        unsigned tableSize;
+
+        /** First entry of each bucket, with one extra end marker. */
+        std::vector<unsigned> cellStart;
+
+        /** Point indices ordered by bucket. */
+        std::vector<unsigned> entries;
+
+        /** Bucket of each point. */
+        std::vector<unsigned> pointCell;
+
+        /** Positions the grid was last built from. */
+        const Vector3 *positions;
+
+        int cellCoordinate(real value) const
+        {
+            return (int)floor(value * inverseCellSize);
+        }
+
+        unsigned hash(int x, int y, int z) const
+        {
+            return ((unsigned)x * 73856093u ^ (unsigned)y * 19349663u ^ (unsigned)z * 83492791u) & (tableSize - 1);
+        }
+
+    public:
+        SpatialGrid(real cellSize);
+
+        void setCellSize(real cellSize);
+
+        real getCellSize() const;
+
+        /**
+         * Buckets the given points. The positions must stay valid and
+         * unchanged while the grid is queried.
+         */
+        void build(const Vector3 *positions, unsigned count);
+
+        /**
+         * Calls visit(index) for every point within the radius of the
+         * centre, each point once.
+         */
+        template <class Visitor>
+        void query(const Vector3 &centre, real radius, Visitor visit) const
+        {
+            if (entries.empty()) return;
+
+            real radius2 = radius * radius;
+            int minX = cellCoordinate(centre.x - radius), maxX = cellCoordinate(centre.x + radius);
+            int minY = cellCoordinate(centre.y - radius), maxY = cellCoordinate(centre.y + radius);
+            int minZ = cellCoordinate(centre.z - radius), maxZ = cellCoordinate(centre.z + radius);
+
+            for (int x = minX; x <= maxX; x++)
+            for (int y = minY; y <= maxY; y++)
+            for (int z = minZ; z <= maxZ; z++)
+            {
+                unsigned cell = hash(x, y, z);
+                for (unsigned e = cellStart[cell]; e < cellStart[cell + 1]; e++)
+                {
+                    unsigned index = entries[e];
+                    const Vector3 &p = positions[index];
+
+                    // buckets are shared by distant cells, skip points
+                    // that only collided into this one.
+                    if (cellCoordinate(p.x) != x || cellCoordinate(p.y) != y ||
+                        cellCoordinate(p.z) != z) continue;
+
+                    if ((p - centre).sqaureMagnitude() <= radius2) visit(index);
+                }
+            }
+        }
+
+        /**
+         * Appends the indices of all points within the radius of the
+         * centre to the list and returns how many were found.
+         */
+        unsigned query(const Vector3 &centre, real radius, std::vector<unsigned> &found) const;
+    };
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef CYCLONE_SPH_H
+#define CYCLONE_SPH_H
+
+#include "particle.h"
+#include "spatial.h"
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Smoothed particle hydrodynamics fluid. Each step the density of every
+     * particle is estimated from its neighbours, converted to pressure, and
+     * pressure and viscosity forces are added to the particles.
+     *
+     * Neighbours are found with a spatial grid and cached in verlet lists
+     * that include a skin distance beyond the smoothing radius. The lists
+     * are only rebuilt once some particle has moved more than half the
+     * skin since they were built.
+     */
+    class ParticleFluid
+    {
+    public:
+        typedef std::vector<Particle*> Particles;
+
+    protected:
+        Particles particles;
+
+        /** Smoothing radius h of the kernels. */
+        real smoothingRadius;
+
+        /** Density the fluid settles at. */
+        real restDensity;
+
+        /** Gas constant relating density error to pressure. */
+        real stiffness;
+
+        /** Dynamic viscosity coefficient. */
+        real viscosity;
+
+        /** Extra search distance that lets neighbour lists be reused. */
+        real skin;
+
+        /** Precomputed kernel normalisation constants. */
+        real poly6;
+        real spikyGradient;
+        real viscosityLaplacian;
+
+        SpatialGrid grid;
+
+        /** Particle state gathered into flat arrays for the kernels. */
+        std::vector<Vector3> positions;
+        std::vector<Vector3> velocities;
+        std::vector<real> masses;
+        std::vector<real> densities;
+        std::vector<real> pressures;
+
+        /** Positions the neighbour lists were built at. */
+        std::vector<Vector3> listPositions;
+
+        /** Neighbours of particle i are neighbours[neighbourStart[i]...]. */
+        std::vector<unsigned> neighbourStart;
+        std::vector<unsigned> neighbours;
+
+        unsigned rebuilds;
+
+        void updateKernels();
+
+        void gather();
+
+        bool needsRebuild() const;
+
+        void buildNeighbourLists();
+
+        void computeDensities();
+
+        void applyForces();
+
+    public:
+        ParticleFluid(real smoothingRadius, real restDensity = 1000.0f,
+                      real stiffness = 3.0f, real viscosity = 0.25f);
+
+        void add(Particle *particle);
+
+        void remove(Particle *particle);
+
+        /**
+         * Follows the particles to their new places after they have been
+         * reordered, dropping any that were removed.
+         */
+        void remapParticles(const ParticleRemap &remap);
+
+        void clear();
+
+        void setSmoothingRadius(real smoothingRadius);
+
+        void setSkin(real skin);
+
+        void setStiffness(real stiffness);
+
+        void setViscosity(real viscosity);
+
+        /** Returns the density computed at the last update. */
+        real getDensity(unsigned index) const;
+
+        /** Returns how many times the neighbour lists have been rebuilt. */
+        unsigned getRebuildCount() const;
+
+        /**
+         * Adds pressure and viscosity forces to every particle of the
+         * fluid.
+         */
+        void updateForces(real duration);
+    };
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef CYCLONE_STORE_H
+#define CYCLONE_STORE_H
+
+#include "particle.h"
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Typed access to one attribute column of a ParticleStore. A view
+     * stays valid until the store is resized, compacted or permuted.
+     */
+    template <class T>
+    class AttributeView
+    {
+    protected:
+        T *data;
+        unsigned size;
+
+    public:
+        AttributeView(T *data = NULL, unsigned size = 0)
+            : data(data), size(size)
+        {
+        }
+
+        /** False if the column doesn't exist or holds another type. */
+        bool isValid() const
+        {
+            return data != NULL;
+        }
+
+        T& operator[](unsigned index) const
+        {
+            return data[index];
+        }
+
+        T* getData() const
+        {
+            return data;
+        }
+
+        unsigned getSize() const
+        {
+            return size;
+        }
+    };
+
+    /**
+     * A set of particles with any number of attribute columns alongside
+     * them: one value per particle for each column, such as a type, an
+     * age or a colour. The particles themselves hold only physics state,
+     * and each column is its own contiguous array, so code that only
+     * needs one attribute only touches that attribute.
+     *
+     * Whenever particles are added, removed or moved around, their
+     * attributes go with them. Column values are copied as raw bytes,
+     * so they must be plain types without constructors of their own.
+     *
+     * The particles only move in memory when the store grows, so after
+     * compact or permute anything pointing at them can be brought up to
+     * date with a ParticleRemap.
+     */
+    class ParticleStore
+    {
+    public:
+        typedef unsigned Column;
+
+        /** Returned by findColumn for a column that doesn't exist. */
+        static const Column NO_COLUMN = ~0u;
+
+        /** Marks a slot removed by compact in its remapping. */
+        static const unsigned REMOVED = ~0u;
+
+    protected:
+        struct ColumnData
+        {
+            std::string name;
+            const std::type_info *type;
+            unsigned elementSize;
+
+            /** Value given to new slots. */
+            std::vector<unsigned char> initial;
+
+            std::vector<unsigned char> values;
+        };
+
+        std::vector<Particle> particles;
+        std::vector<ColumnData> columns;
+
+        /** Used while permuting. */
+        std::vector<Particle> particleScratch;
+        std::vector<unsigned char> columnScratch;
+
+        Column addColumn(const char *name, const std::type_info &type,
+                         unsigned elementSize, const void *initial);
+
+        void* getColumnData(Column column, const std::type_info &type) const;
+
+    public:
+        ParticleStore(unsigned size = 0);
+
+        /**
+         * Adds a column, giving every particle the initial value, and
+         * returns its handle. Returns NO_COLUMN if there is already a
+         * column with the same name.
+         */
+        template <class T>
+        Column addColumn(const char *name, const T &initial = T())
+        {
+            return addColumn(name, typeid(T), sizeof(T), &initial);
+        }
+
+        Column findColumn(const char *name) const;
+
+        unsigned getColumnCount() const;
+
+        const char* getColumnName(Column column) const;
+
+        /**
+         * Returns a view of a column, or an invalid view if the column
+         * doesn't exist or wasn't added with the same type.
+         */
+        template <class T>
+        AttributeView<T> getView(Column column)
+        {
+            return AttributeView<T>((T*)getColumnData(column, typeid(T)), getSize());
+        }
+
+        template <class T>
+        AttributeView<const T> getView(Column column) const
+        {
+            return AttributeView<const T>((const T*)getColumnData(column, typeid(T)), getSize());
+        }
+
+        unsigned getSize() const;
+
+        /**
+         * Changes the number of particles. New particles are at rest at
+         * the origin and take each column's initial value.
+         */
+        void resize(unsigned size);
+
+        void reserve(unsigned capacity);
+
+        /** Adds a particle with initial attributes and returns its index. */
+        unsigned spawn();
+
+        /** Overwrites one particle and its attributes with another's. */
+        void copy(unsigned from, unsigned to);
+
+        void swap(unsigned a, unsigned b);
+
+        /**
+         * Removes every particle whose keep flag is zero, keeping the
+         * others in order, and returns the new size. If remap is given,
+         * it receives the new index of every old particle, or REMOVED.
+         */
+        unsigned compact(const unsigned char *keep, unsigned *remap = NULL);
+
+        /**
+         * Reorders the particles so that the particle at each index
+         * comes from the old index given by order, which must list every
+         * index once.
+         */
+        void permute(const unsigned *order);
+
+        Particle* getParticles();
+
+        const Particle* getParticles() const;
+
+        Particle& getParticle(unsigned index);
+
+        const Particle& getParticle(unsigned index) const;
+    };
+}
+
+#endif
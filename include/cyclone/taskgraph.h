@@ -0,0 +1,117 @@
+#ifndef CYCLONE_TASKGRAPH_H
+#define CYCLONE_TASKGRAPH_H
+
+#include <functional>
+#include <vector>
+#include "parallel.h"
+
+namespace cyclone
+{
+    class TaskPool;
+
+    /**
+     * The stages of a step, such as forces, integration and lifetime
+     * checks, as a graph of tasks and the order some of them must run in.
+     *
+     * A task covers a range of items, split into chunks of at most its
+     * grain, and each chunk is a separate piece of work. Chunks are
+     * handed out one at a time to a pool of worker threads that lives as
+     * long as the program, with the thread calling run taking its share.
+     * A task's successors become ready the moment its last chunk is
+     * done, so one stage of a group of particles can start while other
+     * groups are still in an earlier stage, and a short stage doesn't
+     * hold every core up until it is over.
+     *
+     * Tasks that have no order between them may run at the same time,
+     * and so must not write anything the other reads or writes. With a
+     * single worker everything runs on the calling thread, in the same
+     * order every time.
+     *
+     * A graph is built once and run every step.
+     */
+    class TaskGraph
+    {
+    public:
+        /** Does the work of the items [begin, end) of a task. */
+        typedef std::function<void(unsigned begin, unsigned end)> Body;
+
+    protected:
+        struct Task
+        {
+            const char *name;
+            Body body;
+            unsigned begin;
+            unsigned end;
+            unsigned grain;
+
+            /** Tasks that can't start until this one has finished. */
+            std::vector<unsigned> successors;
+
+            /** Number of tasks this one waits for. */
+            unsigned predecessors;
+        };
+
+        std::vector<Task> tasks;
+
+        /**
+         * Every task in an order that runs each one after those it
+         * waits for, or empty if the graph has a cycle.
+         */
+        std::vector<unsigned> order;
+
+        bool sorted;
+
+        /**
+         * While the graph runs, the tasks each task still waits for, the
+         * chunks of each task not yet done and the tasks not yet done.
+         * Kept by the worker pool, under its lock.
+         */
+        std::vector<unsigned> waiting;
+        std::vector<unsigned> remaining;
+        unsigned unfinished;
+
+        friend class TaskPool;
+
+        /** Works out the order, once per change to the graph. */
+        bool sort();
+
+        /** Runs every task on the calling thread, in order. */
+        void runInline();
+
+    public:
+        TaskGraph();
+
+        /**
+         * Adds a task that calls the body once with the range [0, 1),
+         * and returns its index.
+         */
+        unsigned addTask(const char *name, const std::function<void()> &body);
+
+        /**
+         * Adds a task over the items [begin, end), split into chunks of
+         * at most the grain, and returns its index. The name labels its
+         * chunks in a trace, so it must outlive the graph.
+         */
+        unsigned addTask(const char *name, unsigned begin, unsigned end, unsigned grain, const Body &body);
+
+        /** Makes the second task wait until the first has finished. */
+        void addDependency(unsigned before, unsigned after);
+
+        /** Removes every task. */
+        void clear();
+
+        unsigned getTaskCount() const;
+
+        const char* getTaskName(unsigned task) const;
+
+        /**
+         * Runs every task once, returning when all of them have finished.
+         * Returns false without running anything if the graph has a
+         * cycle. A graph must not be run from two threads at once, but
+         * separate graphs can be.
+         */
+        bool run();
+    };
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef CYCLONE_TIMER_H
+#define CYCLONE_TIMER_H
+
+namespace cyclone
+{
+    /**
+     * Returns a monotonic timestamp in nanoseconds. It never goes
+     * backwards when the wall clock is adjusted, and only differences
+     * between timestamps are meaningful.
+     */
+    unsigned long long getTimeNanoseconds();
+
+    /**
+     * Returns a monotonic timestamp in seconds, with the same origin as
+     * getTimeNanoseconds().
+     */
+    double getTimeSeconds();
+}
+
+#endif
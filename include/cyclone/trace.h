@@ -0,0 +1,87 @@
+#ifndef CYCLONE_TRACE_H
+#define CYCLONE_TRACE_H
+
+#include <atomic>
+#include <stddef.h>
+#include "timer.h"
+
+namespace cyclone
+{
+    /**
+     * Records begin and end events of profiled scopes on every thread
+     * into a timeline, written out as a Chrome trace JSON file that can
+     * be opened in Perfetto or chrome://tracing.
+     *
+     * Each thread writes into its own fixed size ring without locking. A
+     * background thread drains the rings and does all the formatting and
+     * file output, so the simulation threads never wait on the disk.
+     * When a ring is full new scopes are dropped whole rather than
+     * leaving unmatched events.
+     */
+    class Trace
+    {
+        static std::atomic<bool> enabled;
+
+    public:
+        static bool isEnabled()
+        {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Starts tracing into the given file, with room for the given
+         * number of unflushed events per thread. Returns false if the
+         * file can't be opened or a trace is already running.
+         */
+        static bool start(const char *filename, unsigned capacity = 65536);
+
+        /**
+         * Stops tracing, flushes every remaining event and closes the
+         * file. Must not run at the same time as any traced code.
+         */
+        static void stop();
+
+        /**
+         * Records the start of a scope on the calling thread at the
+         * given time. Returns false if the event was dropped, in which
+         * case end must not be called for it.
+         */
+        static bool begin(const char *name, unsigned long long time);
+
+        /** Records the end of the innermost scope begun on this thread. */
+        static void end(unsigned long long time);
+
+        /**
+         * Returns the name of the innermost scope open on the calling
+         * thread, or NULL. Worker threads use it to label their share of
+         * a stage with the stage's name.
+         */
+        static const char* getCurrentScope();
+
+        /** Returns the number of scopes dropped because a ring was full. */
+        static unsigned long long getDroppedCount();
+    };
+
+    /**
+     * Traces its own lifetime when tracing is running, without touching
+     * the profile counters.
+     */
+    class TraceScope
+    {
+        bool traced;
+
+    public:
+        TraceScope(const char *name)
+            : traced(name != NULL && Trace::isEnabled())
+        {
+            if (traced) traced = Trace::begin(name, getTimeNanoseconds());
+        }
+
+        ~TraceScope()
+        {
+            if (traced) Trace::end(getTimeNanoseconds());
+        }
+    };
+}
+
+#endif
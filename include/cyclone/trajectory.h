@@ -0,0 +1,164 @@
+#ifndef CYCLONE_TRAJECTORY_H
+#define CYCLONE_TRAJECTORY_H
+
+#include "particle.h"
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+namespace cyclone
+{
+    /**
+     * Columns a trajectory can hold, combined as a bit mask.
+     */
+    enum TrajectoryColumn
+    {
+        TRAJECTORY_POSITION = 1,
+        TRAJECTORY_VELOCITY = 2
+    };
+
+    /**
+     * Records the trajectories of a set of particles, one frame per
+     * step, into a compressed file.
+     *
+     * Recording only copies the selected columns into a buffer of whole
+     * chunks. A background thread quantises each chunk to a fixed step
+     * and writes it out, while the simulation fills the second buffer.
+     * Each value is predicted by carrying on in a straight line from the
+     * last two frames, twice the last less the one before, and only the
+     * error of the prediction is stored, as a variable length integer
+     * with runs of exact predictions collapsed. The first frame of every
+     * chunk is predicted from zero, and so stored in full, so any frame
+     * can be decoded by reading a single chunk, found through the index
+     * at the end of the file.
+     *
+     * Particles are identified by their position in the list passed to
+     * record, so the list should keep the same order from step to step.
+     */
+    class TrajectoryRecorder
+    {
+    public:
+        struct Chunk;
+
+    protected:
+        FILE *file;
+        unsigned columns;
+        real quantum;
+        unsigned chunkFrames;
+
+        /** Chunk being filled by record, and chunk being written. */
+        Chunk *front;
+        Chunk *back;
+
+        unsigned long long frames;
+        unsigned long long stalls;
+
+        /** Index entries of the chunks written so far. */
+        std::vector<unsigned char> index;
+        unsigned long long chunkCount;
+        unsigned long long writtenFrames;
+
+        std::thread writer;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool pending;
+        bool stopping;
+        bool failed;
+
+        void submit();
+        void writeLoop();
+        void writeChunk(Chunk *chunk);
+
+    public:
+        TrajectoryRecorder();
+        ~TrajectoryRecorder();
+
+        /**
+         * Starts a new recording. Values are rounded to multiples of the
+         * quantum, and every chunk holds the given number of frames.
+         * Returns false if the file can't be created.
+         */
+        bool open(const char *filename, unsigned columns = TRAJECTORY_POSITION,
+                  real quantum = 0.001f, unsigned chunkFrames = 64);
+
+        /**
+         * Adds one frame holding the given particles at the given time.
+         * Only blocks if the background thread is still writing the
+         * previous chunk when this one fills up.
+         */
+        void record(double time, const Particle *const *particles, unsigned count);
+
+        /**
+         * Writes the remaining frames and the index and closes the file.
+         * Returns false if any write failed.
+         */
+        bool close();
+
+        bool isOpen() const;
+
+        unsigned long long getFrameCount() const;
+
+        /** Number of times record had to wait for the background thread. */
+        unsigned long long getStallCount() const;
+    };
+
+    /**
+     * Reads frames back from a trajectory file in any order.
+     */
+    class TrajectoryReader
+    {
+    protected:
+        FILE *file;
+        unsigned columns;
+        real quantum;
+
+        struct ChunkEntry
+        {
+            unsigned long long offset;
+            unsigned long long firstFrame;
+            unsigned frameCount;
+            double firstTime;
+        };
+        std::vector<ChunkEntry> chunks;
+        unsigned long long frameCount;
+
+        /** The most recently decoded chunk. */
+        unsigned cachedChunk;
+        std::vector<real> values;
+        std::vector<unsigned long long> frameStarts;
+        std::vector<unsigned> counts;
+        std::vector<double> times;
+
+        bool decode(unsigned chunk);
+
+    public:
+        TrajectoryReader();
+        ~TrajectoryReader();
+
+        bool open(const char *filename);
+
+        void close();
+
+        unsigned getColumns() const;
+
+        unsigned long long getFrameCount() const;
+
+        /**
+         * Finds the last frame recorded at or before the given time.
+         */
+        unsigned long long findFrame(double time);
+
+        /**
+         * Decodes one frame. Columns that weren't recorded are left
+         * empty. Returns false if the frame doesn't exist or the file is
+         * damaged.
+         */
+        bool readFrame(unsigned long long frame, double *time,
+                       std::vector<Vector3> *positions,
+                       std::vector<Vector3> *velocities = NULL);
+    };
+}
+
+#endif
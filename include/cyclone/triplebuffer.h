@@ -0,0 +1,90 @@
+#ifndef CYCLONE_TRIPLEBUFFER_H
+#define CYCLONE_TRIPLEBUFFER_H
+
+#include <atomic>
+
+namespace cyclone
+{
+    /**
+     * Hands complete frames from one producer thread to one consumer
+     * thread without either ever waiting for the other.
+     *
+     * The producer fills the back frame and publishes it, which swaps it
+     * with the middle frame. The consumer swaps the middle frame with
+     * its front frame whenever a new one has been published, and reads
+     * the front frame for as long as it likes. Frames are reused, so
+     * anything they own (vectors, say) stops allocating once it has
+     * grown to size.
+     *
+     * The producer may publish any number of frames between two reads;
+     * the consumer only ever sees the newest one.
+     */
+    template <class Frame>
+    class TripleBuffer
+    {
+    protected:
+        Frame frames[3];
+
+        /**
+         * Index of the middle frame, with the FRESH bit set while it
+         * holds a frame the consumer hasn't taken yet.
+         */
+        std::atomic<unsigned> middle;
+
+        /** Owned by the producer. */
+        unsigned back;
+
+        /** Owned by the consumer. */
+        unsigned front;
+
+        enum { INDEX = 3, FRESH = 4 };
+
+    public:
+        TripleBuffer()
+            : middle(1), back(0), front(2)
+        {
+        }
+
+        /**
+         * Returns the frame to fill in. Producer only.
+         */
+        Frame& getBack()
+        {
+            return frames[back];
+        }
+
+        /**
+         * Makes the back frame the newest one and hands the producer a
+         * free frame to fill next, holding whatever it held last time it
+         * was used. Producer only.
+         */
+        void publish()
+        {
+            back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        /**
+         * Takes the newest published frame, if there is one the
+         * consumer hasn't seen. Returns true if the front frame
+         * changed. Consumer only.
+         */
+        bool update()
+        {
+            if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) return false;
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        /**
+         * Returns the frame the consumer took last, a default
+         * constructed one before the first. It doesn't change until the
+         * next update. Consumer only.
+         */
+        const Frame& getFront() const
+        {
+            return frames[front];
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include <cyclone/adaptive.h>
+#include <cyclone/profile.h>
+
+using namespace cyclone;
+
+/** Keeps the next substep a little short of the one the error allows. */
+static const real adaptiveSafety = 0.9f;
+
+/** Most a substep can shrink or grow by from one try to the next. */
+static const real adaptiveMinScale = 0.2f;
+static const real adaptiveMaxScale = 2.0f;
+
+AdaptiveStepper::AdaptiveStepper(real tolerance, real minStep, real maxStep)
+    : tolerance(tolerance), minStep(minStep), maxStep(maxStep), nextStep(maxStep),
+      substeps(0), rejected(0), largestError(0)
+{
+}
+
+void AdaptiveStepper::setTolerance(real tolerance)
+{
+    AdaptiveStepper::tolerance = tolerance;
+}
+
+real AdaptiveStepper::getTolerance() const
+{
+    return tolerance;
+}
+
+void AdaptiveStepper::setStepLimits(real minStep, real maxStep)
+{
+    AdaptiveStepper::minStep = minStep;
+    AdaptiveStepper::maxStep = maxStep;
+    if (nextStep > maxStep) nextStep = maxStep;
+    if (nextStep < minStep) nextStep = minStep;
+}
+
+void AdaptiveStepper::integrate(Particle *particles, unsigned count, ParticleForceRegistry &registry,
+                                real duration)
+{
+    registry.updateForces(duration);
+    for (unsigned i = 0; i < count; i++) particles[i].integrate(duration);
+}
+
+unsigned AdaptiveStepper::advance(Particle *particles, unsigned count, ParticleForceRegistry &registry,
+                                  real duration)
+{
+    CYCLONE_PROFILE_SCOPE("integrate/adaptive");
+
+    start.resize(count);
+    coarsePositions.resize(count);
+    coarseVelocities.resize(count);
+
+    unsigned kept = 0;
+    real remaining = duration;
+    while (remaining > 0)
+    {
+        // rather than leave a sliver too short to take on its own, the
+        // rest of the frame is split into two even substeps.
+        real step = nextStep;
+        if (step >= remaining) step = remaining;
+        else if (remaining - step < minStep) step = remaining * 0.5f;
+
+        for (unsigned i = 0; i < count; i++) start[i] = particles[i];
+
+        integrate(particles, count, registry, step);
+        for (unsigned i = 0; i < count; i++)
+        {
+            coarsePositions[i] = particles[i].getPosition();
+            coarseVelocities[i] = particles[i].getVelocity();
+            particles[i] = start[i];
+        }
+
+        integrate(particles, count, registry, step * 0.5f);
+        integrate(particles, count, registry, step * 0.5f);
+
+        // a velocity error counts by how far it would move the particle
+        // over the substep.
+        real error = 0;
+        for (unsigned i = 0; i < count; i++)
+        {
+            real squared = (particles[i].getPosition() - coarsePositions[i]).sqaureMagnitude();
+            real velocity = (particles[i].getVelocity() - coarseVelocities[i]).sqaureMagnitude() * step * step;
+            if (velocity > squared) squared = velocity;
+            if (squared > error) error = squared;
+        }
+        error = real_sqrt(error);
+
+        // the integrator's error per substep grows with its square, so
+        // the substep scales with the root of the error's headroom.
+        real scale = adaptiveMaxScale;
+        if (error > 0) scale = adaptiveSafety * real_sqrt(tolerance / error);
+        if (!(scale >= adaptiveMinScale)) scale = adaptiveMinScale;
+        if (scale > adaptiveMaxScale) scale = adaptiveMaxScale;
+
+        bool accept = error <= tolerance || step <= minStep;
+        if (!accept)
+        {
+            for (unsigned i = 0; i < count; i++) particles[i] = start[i];
+            rejected++;
+        }
+        else
+        {
+            remaining -= step;
+            kept++;
+            if (error > largestError) largestError = error;
+        }
+
+        // a substep cut short by the end of the frame says nothing
+        // about how long the next one can be.
+        if (accept && step < nextStep && error <= tolerance) continue;
+
+        nextStep = step * scale;
+        if (nextStep < minStep) nextStep = minStep;
+        if (nextStep > maxStep) nextStep = maxStep;
+    }
+
+    substeps += kept;
+    return kept;
+}
+
+real AdaptiveStepper::getStepSize() const
+{
+    return nextStep;
+}
+
+unsigned AdaptiveStepper::getSubstepCount() const
+{
+    return substeps;
+}
+
+unsigned AdaptiveStepper::getRejectedCount() const
+{
+    return rejected;
+}
+
+real AdaptiveStepper::getLargestError() const
+{
+    return largestError;
+}
+
+void AdaptiveStepper::resetStats()
+{
+    substeps = 0;
+    rejected = 0;
+    largestError = 0;
+}
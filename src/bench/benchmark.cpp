@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cyclone/timer.h>
+#include "benchmark.h"
+
+BenchmarkRunner::BenchmarkRunner(const BenchmarkOptions &options)
+    : options(options)
+{
+}
+
+BenchmarkRunner::~BenchmarkRunner()
+{
+    for (unsigned i = 0; i < benchmarks.size(); i++) delete benchmarks[i];
+}
+
+void BenchmarkRunner::add(Benchmark *benchmark)
+{
+    benchmarks.push_back(benchmark);
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+    // nearest rank.
+    unsigned rank = (unsigned)(fraction * sorted.size() + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > sorted.size()) rank = (unsigned)sorted.size();
+    return sorted[rank - 1];
+}
+
+void BenchmarkRunner::run()
+{
+    results.clear();
+    unsigned repetitions = options.repetitions > 0 ? options.repetitions : 1;
+
+    for (unsigned b = 0; b < benchmarks.size(); b++)
+    {
+        Benchmark *benchmark = benchmarks[b];
+        if (options.filter && strstr(benchmark->getName(), options.filter) == NULL) continue;
+
+        fprintf(stderr, "running %s\n", benchmark->getName());
+        benchmark->setUp();
+
+        for (unsigned i = 0; i < options.warmup; i++) benchmark->run();
+
+        std::vector<double> samples(repetitions);
+        unsigned long long items = 0;
+        for (unsigned i = 0; i < repetitions; i++)
+        {
+            unsigned long long start = cyclone::getTimeNanoseconds();
+            items = benchmark->run();
+            samples[i] = (double)(cyclone::getTimeNanoseconds() - start);
+        }
+
+        benchmark->tearDown();
+
+        std::sort(samples.begin(), samples.end());
+        double total = 0;
+        for (unsigned i = 0; i < repetitions; i++) total += samples[i];
+
+        BenchmarkResult result;
+        result.name = benchmark->getName();
+        result.repetitions = repetitions;
+        result.items = items;
+        result.min = samples.front();
+        result.median = percentile(samples, 0.5);
+        result.p90 = percentile(samples, 0.9);
+        result.p99 = percentile(samples, 0.99);
+        result.max = samples.back();
+        result.mean = total / repetitions;
+        result.itemsPerSecond = result.median > 0 ? items * 1e9 / result.median : 0;
+        result.baseline = 0;
+        result.regressed = false;
+        results.push_back(result);
+    }
+}
+
+int BenchmarkRunner::compare(const char *baselineFile)
+{
+    FILE *file = fopen(baselineFile, "r");
+    if (!file) return -1;
+
+    // the baseline is read back from our own output, which has one
+    // benchmark object per line.
+    std::map<std::string, double> medians;
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        const char *name = strstr(line, "\"name\": \"");
+        const char *median = strstr(line, "\"median_ns\": ");
+        if (!name || !median) continue;
+
+        name += strlen("\"name\": \"");
+        const char *end = strchr(name, '"');
+        if (!end) continue;
+
+        medians[std::string(name, end)] = atof(median + strlen("\"median_ns\": "));
+    }
+    fclose(file);
+
+    int regressions = 0;
+    for (unsigned i = 0; i < results.size(); i++)
+    {
+        std::map<std::string, double>::iterator found = medians.find(results[i].name);
+        if (found == medians.end()) continue;
+
+        results[i].baseline = found->second;
+        results[i].regressed = results[i].median > found->second * (1 + options.threshold);
+        if (results[i].regressed) regressions++;
+    }
+    return regressions;
+}
+
+void BenchmarkRunner::print() const
+{
+    printf("%-36s %12s %12s %12s %12s %14s %9s\n",
+           "benchmark", "median ms", "p90 ms", "p99 ms", "min ms", "items/s", "vs base");
+
+    for (unsigned i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult &r = results[i];
+
+        char change[32] = "";
+        if (r.baseline > 0)
+        {
+            snprintf(change, sizeof(change), "%+.1f%%%s",
+                     (r.median / r.baseline - 1) * 100, r.regressed ? " !" : "");
+        }
+
+        printf("%-36s %12.4f %12.4f %12.4f %12.4f %14.4g %9s\n",
+               r.name.c_str(), r.median * 1e-6, r.p90 * 1e-6, r.p99 * 1e-6, r.min * 1e-6,
+               r.itemsPerSecond, change);
+    }
+}
+
+bool BenchmarkRunner::writeJson(const char *filename) const
+{
+    FILE *file = fopen(filename, "w");
+    if (!file) return false;
+
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (unsigned i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult &r = results[i];
+        fprintf(file,
+                "    {\"name\": \"%s\", \"repetitions\": %u, \"items\": %llu, "
+                "\"min_ns\": %.1f, \"median_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f, "
+                "\"max_ns\": %.1f, \"mean_ns\": %.1f, \"items_per_sec\": %.1f, "
+                "\"baseline_median_ns\": %.1f, \"regressed\": %s}%s\n",
+                r.name.c_str(), r.repetitions, r.items,
+                r.min, r.median, r.p90, r.p99, r.max, r.mean, r.itemsPerSecond,
+                r.baseline, r.regressed ? "true" : "false",
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    fclose(file);
+    return true;
+}
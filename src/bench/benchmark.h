@@ -0,0 +1,98 @@
+#ifndef CYCLONE_BENCH_BENCHMARK_H
+#define CYCLONE_BENCH_BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+/**
+ * A single measured piece of work. The runner calls setUp() once, run()
+ * for every warm-up and timed repetition, and tearDown() at the end.
+ */
+class Benchmark
+{
+public:
+    virtual ~Benchmark() {}
+
+    virtual const char* getName() const = 0;
+
+    virtual void setUp() {}
+
+    /**
+     * Performs one repetition and returns the number of items, such as
+     * particles or calls, it processed.
+     */
+    virtual unsigned long long run() = 0;
+
+    virtual void tearDown() {}
+};
+
+/**
+ * Timing statistics of one benchmark, in nanoseconds per repetition.
+ */
+struct BenchmarkResult
+{
+    std::string name;
+    unsigned repetitions;
+    unsigned long long items;
+    double min;
+    double median;
+    double p90;
+    double p99;
+    double max;
+    double mean;
+    double itemsPerSecond;
+
+    /** Median of the stored baseline, or zero if there is none. */
+    double baseline;
+    bool regressed;
+};
+
+struct BenchmarkOptions
+{
+    unsigned warmup;
+    unsigned repetitions;
+
+    /** Only benchmarks whose name contains this are run, if set. */
+    const char *filter;
+
+    /** Fraction the median may grow over the baseline before it is flagged. */
+    double threshold;
+
+    BenchmarkOptions() : warmup(3), repetitions(20), filter(NULL), threshold(0.10) {}
+};
+
+/**
+ * Runs a set of benchmarks and reports their results.
+ */
+class BenchmarkRunner
+{
+protected:
+    std::vector<Benchmark*> benchmarks;
+
+    std::vector<BenchmarkResult> results;
+
+    BenchmarkOptions options;
+
+public:
+    BenchmarkRunner(const BenchmarkOptions &options);
+    ~BenchmarkRunner();
+
+    /** Adds a benchmark, the runner takes ownership of it. */
+    void add(Benchmark *benchmark);
+
+    void run();
+
+    /**
+     * Compares the results against a file written by writeJson() and
+     * flags benchmarks whose median grew by more than the threshold.
+     * Returns the number of regressions, or -1 if the file can't be read.
+     */
+    int compare(const char *baselineFile);
+
+    /** Prints a table of the results to stdout. */
+    void print() const;
+
+    bool writeJson(const char *filename) const;
+};
+
+#endif
@@ -0,0 +1,424 @@
+/*
+ * cyclone-bench: micro benchmarks of the core types and force generators
+ * plus whole scenario benchmarks, with optional JSON output and
+ * comparison against a stored baseline.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <cyclone/cyclone.h>
+#include "benchmark.h"
+#include "../sim/scenario.h"
+
+using namespace cyclone;
+
+/** Results are written here so the compiler can't drop the work. */
+static volatile real sink;
+
+static void randomise(Random &random, std::vector<Vector3> &vectors, real range)
+{
+    for (unsigned i = 0; i < vectors.size(); i++)
+    {
+        vectors[i] = random.randomVector(Vector3(-range, -range, -range), Vector3(range, range, range));
+    }
+}
+
+class VectorBenchmark : public Benchmark
+{
+public:
+    enum Operation { ADD_SCALED, SCALAR_PRODUCT, VECTOR_PRODUCT, NORMALIZE };
+
+protected:
+    Operation operation;
+    std::vector<Vector3> a, b, c;
+
+public:
+    VectorBenchmark(Operation operation) : operation(operation) {}
+
+    virtual const char* getName() const
+    {
+        switch (operation)
+        {
+        case ADD_SCALED: return "vector3/addScaledVector";
+        case SCALAR_PRODUCT: return "vector3/scalarProduct";
+        case VECTOR_PRODUCT: return "vector3/vectorProduct";
+        case NORMALIZE: return "vector3/normalize";
+        }
+        return "vector3";
+    }
+
+    virtual void setUp()
+    {
+        Random random;
+        random.seed(1);
+        a.resize(65536);
+        b.resize(65536);
+        c.resize(65536);
+        randomise(random, a, 10);
+        randomise(random, b, 10);
+    }
+
+    virtual unsigned long long run()
+    {
+        unsigned count = (unsigned)a.size();
+        real total = 0;
+
+        switch (operation)
+        {
+        case ADD_SCALED:
+            for (unsigned i = 0; i < count; i++) c[i].addScaledVector(b[i], 0.5f);
+            total = c[count / 2].x;
+            break;
+        case SCALAR_PRODUCT:
+            for (unsigned i = 0; i < count; i++) total += a[i] * b[i];
+            break;
+        case VECTOR_PRODUCT:
+            for (unsigned i = 0; i < count; i++) c[i] = a[i] % b[i];
+            total = c[count / 2].y;
+            break;
+        case NORMALIZE:
+            for (unsigned i = 0; i < count; i++)
+            {
+                c[i] = a[i];
+                c[i].normalize();
+            }
+            total = c[count / 2].z;
+            break;
+        }
+
+        sink = total;
+        return count;
+    }
+};
+
+class IntegrateBenchmark : public Benchmark
+{
+    std::vector<Particle> particles;
+
+public:
+    virtual const char* getName() const
+    {
+        return "particle/integrate";
+    }
+
+    virtual void setUp()
+    {
+        Random random;
+        random.seed(2);
+        particles.resize(100000);
+        for (unsigned i = 0; i < particles.size(); i++)
+        {
+            Particle &particle = particles[i];
+            particle.setPosition(random.randomVector(Vector3(-10, -10, -10), Vector3(10, 10, 10)));
+            particle.setVelocity(random.randomVector(Vector3(-1, -1, -1), Vector3(1, 1, 1)));
+            particle.setAcceleration(Vector3::GRAVITY);
+            particle.setMass(1);
+            particle.setDamping(0.99f);
+        }
+    }
+
+    virtual unsigned long long run()
+    {
+        for (unsigned i = 0; i < particles.size(); i++)
+        {
+            particles[i].integrate(0.001f);
+        }
+        sink = particles[0].getPosition().y;
+        return particles.size();
+    }
+};
+
+/**
+ * updateForces() on a registry holding one generator type for every
+ * particle.
+ */
+class RegistryBenchmark : public Benchmark
+{
+public:
+    enum Kind { GRAVITY, DRAG, SPRING, ANCHORED_SPRING, BUNGEE, ANCHORED_BUNGEE, BUOYANCY, FAKE_SPRING };
+
+protected:
+    Kind kind;
+    std::vector<Particle> particles;
+    std::vector<ParticleForceGenerator*> generators;
+    ParticleForceRegistry registry;
+    Vector3 anchor;
+
+public:
+    RegistryBenchmark(Kind kind) : kind(kind) {}
+
+    virtual const char* getName() const
+    {
+        switch (kind)
+        {
+        case GRAVITY: return "registry/ParticleGravity";
+        case DRAG: return "registry/ParticleDrag";
+        case SPRING: return "registry/ParticleSpring";
+        case ANCHORED_SPRING: return "registry/ParticleAnchoredSpring";
+        case BUNGEE: return "registry/ParticleBungee";
+        case ANCHORED_BUNGEE: return "registry/ParticleAnchoredBungee";
+        case BUOYANCY: return "registry/ParticleBuoyancy";
+        case FAKE_SPRING: return "registry/ParticleFakeSpring";
+        }
+        return "registry";
+    }
+
+    virtual void setUp()
+    {
+        Random random;
+        random.seed(3);
+        particles.resize(10000);
+        for (unsigned i = 0; i < particles.size(); i++)
+        {
+            Particle &particle = particles[i];
+            particle.setPosition(random.randomVector(Vector3(-10, -10, -10), Vector3(10, 10, 10)));
+            particle.setVelocity(random.randomVector(Vector3(-1, -1, -1), Vector3(1, 1, 1)));
+            particle.setMass(1);
+        }
+
+        // generators with per particle state get one each, the rest are
+        // shared like in the demos.
+        ParticleForceGenerator *shared = NULL;
+        switch (kind)
+        {
+        case GRAVITY: shared = new ParticleGravity(Vector3::GRAVITY); break;
+        case DRAG: shared = new ParticleDrag(0.1f, 0.01f); break;
+        case ANCHORED_SPRING: shared = new ParticleAnchoredSpring(&anchor, 5, 2); break;
+        case ANCHORED_BUNGEE: shared = new ParticleAnchoredBungee(&anchor, 5, 2); break;
+        case BUOYANCY: shared = new ParticleBuoyancy(1, 0.1f, 0); break;
+        case FAKE_SPRING: shared = new ParticleFakeSpring(&anchor, 5, 0.5f); break;
+        default: break;
+        }
+        if (shared) generators.push_back(shared);
+
+        for (unsigned i = 0; i < particles.size(); i++)
+        {
+            ParticleForceGenerator *generator = shared;
+            Particle *other = &particles[(i + 1) % particles.size()];
+            if (kind == SPRING) generator = new ParticleSpring(other, 5, 2);
+            if (kind == BUNGEE) generator = new ParticleBungee(other, 5, 2);
+            if (!shared) generators.push_back(generator);
+
+            registry.add(&particles[i], generator);
+        }
+    }
+
+    virtual unsigned long long run()
+    {
+        registry.updateForces(0.01f);
+        for (unsigned i = 0; i < particles.size(); i++) particles[i].clearAccumulator();
+        return particles.size();
+    }
+
+    virtual void tearDown()
+    {
+        registry.clear();
+        for (unsigned i = 0; i < generators.size(); i++) delete generators[i];
+        generators.clear();
+    }
+};
+
+class RandomBenchmark : public Benchmark
+{
+    bool vectors;
+    Random random;
+
+public:
+    RandomBenchmark(bool vectors) : vectors(vectors) {}
+
+    virtual const char* getName() const
+    {
+        return vectors ? "random/randomVector" : "random/randomBits";
+    }
+
+    virtual void setUp()
+    {
+        random.seed(4);
+    }
+
+    virtual unsigned long long run()
+    {
+        const unsigned count = 1000000;
+        if (vectors)
+        {
+            Vector3 min(-1, -1, -1), max(1, 1, 1), total;
+            for (unsigned i = 0; i < count; i++) total += random.randomVector(min, max);
+            sink = total.x;
+        }
+        else
+        {
+            unsigned total = 0;
+            for (unsigned i = 0; i < count; i++) total ^= random.randomBits();
+            sink = (real)total;
+        }
+        return count;
+    }
+};
+
+/**
+ * Steps one of the headless scenarios, after running it for a while so
+ * the measured steps see a populated world.
+ */
+class ScenarioBenchmark : public Benchmark
+{
+    std::string name;
+    const char *scenarioName;
+    ScenarioOptions options;
+    unsigned prewarmSteps;
+    unsigned stepsPerRun;
+    real duration;
+    Scenario *scenario;
+
+public:
+    ScenarioBenchmark(const char *name, const char *scenarioName, const ScenarioOptions &options,
+                      unsigned prewarmSteps, unsigned stepsPerRun, real duration)
+        : name(name), scenarioName(scenarioName), options(options), prewarmSteps(prewarmSteps),
+          stepsPerRun(stepsPerRun), duration(duration), scenario(NULL)
+    {
+    }
+
+    virtual const char* getName() const
+    {
+        return name.c_str();
+    }
+
+    virtual void setUp()
+    {
+        scenario = createScenario(scenarioName, options);
+        for (unsigned i = 0; i < prewarmSteps; i++) scenario->step(duration);
+    }
+
+    virtual unsigned long long run()
+    {
+        unsigned long long items = 0;
+        for (unsigned i = 0; i < stepsPerRun; i++)
+        {
+            scenario->step(duration);
+            items += scenario->getLiveCount();
+        }
+        return items;
+    }
+
+    virtual void tearDown()
+    {
+        delete scenario;
+        scenario = NULL;
+    }
+};
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: cyclone-bench [options]\n"
+        "  --filter TEXT       only run benchmarks whose name contains TEXT\n"
+        "  --warmup N          untimed repetitions first (default 3)\n"
+        "  --reps N            timed repetitions (default 20)\n"
+        "  --json FILE         write the results as JSON\n"
+        "  --baseline FILE     compare against an earlier JSON result\n"
+        "  --threshold F       allowed median growth before flagging (default 0.10)\n"
+        "  --fireworks N       particle slots of the fireworks cascade (default 1000000)\n");
+}
+
+int main(int argc, char **argv)
+{
+    BenchmarkOptions options;
+    const char *json = NULL;
+    const char *baseline = NULL;
+    unsigned fireworks = 1000000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+        {
+            usage();
+            return 0;
+        }
+        if (value == NULL)
+        {
+            usage();
+            return 1;
+        }
+
+        if (strcmp(arg, "--filter") == 0) options.filter = value;
+        else if (strcmp(arg, "--warmup") == 0) options.warmup = (unsigned)atoi(value);
+        else if (strcmp(arg, "--reps") == 0) options.repetitions = (unsigned)atoi(value);
+        else if (strcmp(arg, "--json") == 0) json = value;
+        else if (strcmp(arg, "--baseline") == 0) baseline = value;
+        else if (strcmp(arg, "--threshold") == 0) options.threshold = atof(value);
+        else if (strcmp(arg, "--fireworks") == 0) fireworks = (unsigned)atoi(value);
+        else
+        {
+            usage();
+            return 1;
+        }
+        i++;
+    }
+
+    BenchmarkRunner runner(options);
+
+    runner.add(new VectorBenchmark(VectorBenchmark::ADD_SCALED));
+    runner.add(new VectorBenchmark(VectorBenchmark::SCALAR_PRODUCT));
+    runner.add(new VectorBenchmark(VectorBenchmark::VECTOR_PRODUCT));
+    runner.add(new VectorBenchmark(VectorBenchmark::NORMALIZE));
+    runner.add(new IntegrateBenchmark());
+    runner.add(new RegistryBenchmark(RegistryBenchmark::GRAVITY));
+    runner.add(new RegistryBenchmark(RegistryBenchmark::DRAG));
+    runner.add(new RegistryBenchmark(RegistryBenchmark::SPRING));
+    runner.add(new RegistryBenchmark(RegistryBenchmark::ANCHORED_SPRING));
+    runner.add(new RegistryBenchmark(RegistryBenchmark::BUNGEE));
+    runner.add(new RegistryBenchmark(RegistryBenchmark::ANCHORED_BUNGEE));
+    runner.add(new RegistryBenchmark(RegistryBenchmark::BUOYANCY));
+    runner.add(new RegistryBenchmark(RegistryBenchmark::FAKE_SPRING));
+    runner.add(new RandomBenchmark(false));
+    runner.add(new RandomBenchmark(true));
+
+    // a cascade that keeps most of the slots busy.
+    ScenarioOptions cascade;
+    cascade.capacity = fireworks;
+    cascade.interval = 1;
+    cascade.burst = fireworks / 2000 > 0 ? fireworks / 2000 : 1;
+    runner.add(new ScenarioBenchmark("scenario/fireworks-cascade", "fireworks", cascade, 120, 1, 0.016f));
+
+    ScenarioOptions mesh;
+    mesh.capacity = 256 * 256;
+    runner.add(new ScenarioBenchmark("scenario/spring-mesh", "springmesh", mesh, 10, 1, 0.005f));
+
+    ScenarioOptions salvo;
+    salvo.capacity = 4096;
+    salvo.interval = 1;
+    salvo.burst = 256;
+    runner.add(new ScenarioBenchmark("scenario/ballistic-salvo", "ballistic", salvo, 60, 10, 0.016f));
+
+    runner.run();
+
+    int regressions = 0;
+    if (baseline)
+    {
+        regressions = runner.compare(baseline);
+        if (regressions < 0)
+        {
+            fprintf(stderr, "cyclone-bench: can't read baseline '%s'\n", baseline);
+            regressions = 0;
+        }
+    }
+
+    runner.print();
+
+    if (json && !runner.writeJson(json))
+    {
+        fprintf(stderr, "cyclone-bench: can't write '%s'\n", json);
+        return 1;
+    }
+
+    if (regressions > 0)
+    {
+        fprintf(stderr, "cyclone-bench: %d benchmark(s) regressed\n", regressions);
+        return 2;
+    }
+    return 0;
+}
@@ -1,5 +1,18 @@
+#include <string.h>
+#include <chrono>
 #include "app.h"
 #include "ogl_headers.h"
+#include "timing.h"
+
+Application::Application()
+  : height(1), width(1), threaded(false), stepDuration(1.0f / 120.0f), running(false)
+{
+}
+
+Application::~Application()
+{
+  stopSimulation();
+}
 
 void Application::initGraphics() 
 {
@@ -30,11 +43,94 @@ void Application::display()
 
 void Application::update() 
 {
+  if (!threaded)
+  {
+    // Step by the duration of the last frame, as it was displayed.
+    cyclone::real duration = (cyclone::real)TimingData::get().lastFrameSeconds;
+    if (duration <= 0.0f) return;
+
+    std::lock_guard<std::mutex> lock(simulationMutex);
+    step(duration);
+    publish();
+  }
+
   glutPostRedisplay();
 }
 
+void Application::step(cyclone::real duration)
+{
+}
+
+void Application::publish()
+{
+}
+
+void Application::setThreaded(bool threaded, cyclone::real stepDuration)
+{
+  if (running) return;
+
+  Application::threaded = threaded;
+  Application::stepDuration = stepDuration;
+}
+
+bool Application::isThreaded() const
+{
+  return threaded;
+}
+
+void Application::startSimulation()
+{
+  if (!threaded || running) return;
+
+  running = true;
+  simulation = std::thread(&Application::simulate, this);
+}
+
+void Application::stopSimulation()
+{
+  running = false;
+  if (simulation.joinable()) simulation.join();
+}
+
+std::mutex& Application::getSimulationMutex()
+{
+  return simulationMutex;
+}
+
+void Application::simulate()
+{
+  // Steps happen on a fixed schedule. If the thread falls further behind
+  // than this many steps it gives up on them rather than racing to catch
+  // up, so the simulation slows down instead of spiralling.
+  const unsigned long long maxLag = 8;
+
+  unsigned long long interval = (unsigned long long)(stepDuration * 1e9);
+  unsigned long long next = cyclone::getTimeNanoseconds();
+
+  while (running)
+  {
+    {
+      std::lock_guard<std::mutex> lock(simulationMutex);
+      step(stepDuration);
+      publish();
+    }
+
+    next += interval;
+    unsigned long long now = cyclone::getTimeNanoseconds();
+    if (now < next)
+    {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+    }
+    else if (now - next > maxLag * interval)
+    {
+      next = now;
+    }
+  }
+}
+
 void Application::deinit()
 {
+  stopSimulation();
 }
 
 void Application::key(unsigned char key)
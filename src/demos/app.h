@@ -1,4 +1,7 @@
 #include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #include <cyclone/cyclone.h>
 
@@ -7,7 +10,32 @@ class Application
   protected:
     int height;
     int width;
+
+    /**
+     * True if the physics runs on its own thread at a fixed rate rather
+     * than once per displayed frame.
+     */
+    bool threaded;
+
+    /** Length of one physics step when threaded, in seconds. */
+    cyclone::real stepDuration;
+
+    std::thread simulation;
+    std::atomic<bool> running;
+
+    /**
+     * Held while the physics steps. Input doesn't take it: demos push
+     * their changes onto a cyclone::CommandQueue that the step drains.
+     */
+    std::mutex simulationMutex;
+
+    /** Body of the physics thread. */
+    void simulate();
+
   public:
+    Application();
+    virtual ~Application();
+
     virtual void setView();
     virtual void update();
     virtual void display();
@@ -18,4 +46,34 @@ class Application
     virtual void deinit();
     virtual const char* getTitle();
     void renderText(float x, float y, const char *text, void* font=NULL);
-};
\ No newline at end of file
+
+    /**
+     * Moves the simulation on by the given time. Called on the physics
+     * thread when threaded, from update otherwise.
+     */
+    virtual void step(cyclone::real duration);
+
+    /**
+     * Copies whatever display needs out of the simulation, straight
+     * after each step. Demos hand the copy over through a
+     * cyclone::TripleBuffer, so display never touches live state.
+     */
+    virtual void publish();
+
+    /**
+     * Chooses between stepping on a physics thread at the given rate and
+     * stepping once per frame by the frame's duration. Only has an
+     * effect before startSimulation.
+     */
+    void setThreaded(bool threaded, cyclone::real stepDuration = 1.0f / 120.0f);
+
+    bool isThreaded() const;
+
+    /** Starts the physics thread, if threaded. */
+    void startSimulation();
+
+    /** Stops and joins the physics thread. */
+    void stopSimulation();
+
+    std::mutex& getSimulationMutex();
+};
@@ -1,53 +1,32 @@
 #include <cyclone/cyclone.h>
+#include "ballisticrange.h"
 #include "../ogl_headers.h"
 #include "../app.h"
 #include "../timing.h"
 
-class BallisticDemo : public Application
+/**
+ * Positions of the rounds in flight, copied after each step.
+ */
+struct BallisticFrame
 {
-    enum ShotType
-    {
-        UNUSED = 0,
-        PISTOL,
-        ARTILLERY,
-        FIREBALL,
-        LASER
-    };
-
-    struct AmmoRound
-    {
-        cyclone::Particle particle;
-        ShotType type;
-        unsigned startTime;
+    std::vector<cyclone::Vector3> positions;
+};
 
-        void render()
-        {
-            cyclone::Vector3 position;
-            particle.getPosition(&position);
-
-            glColor3f(0, 0, 0);
-            glPushMatrix();
-            glTranslatef(position.x, position.y, position.z);
-            glutSolidSphere(0.3f, 5, 4);
-            glPopMatrix();
-
-            glColor3f(0.75, 0.75, 0.75);
-            glPushMatrix();
-            glTranslatef(position.x, 0, position.z);
-            glScalef(1.0f, 0.1f, 1.0f);
-            glutSolidSphere(0.6f, 5, 4);
-            glPopMatrix();
-        }
-    };
+class BallisticDemo : public Application
+{
+    typedef BallisticRange::ShotType ShotType;
+    typedef BallisticRange::AmmoRound AmmoRound;
 
-    const static unsigned ammoRounds = 16;
+    BallisticRange range;
 
-    AmmoRound ammo[ammoRounds];
+    cyclone::TripleBuffer<BallisticFrame> frames;
 
     ShotType currentShotType;
 
     void fire();
 
+    void render(const cyclone::Vector3 &position);
+
 public:
     BallisticDemo();
 
@@ -59,16 +38,15 @@ public:
 
     virtual void mouse(int button, int state, int x, int y);
 
-    virtual void update();
+    virtual void step(cyclone::real duration);
+
+    virtual void publish();
 };
 
 BallisticDemo::BallisticDemo()
-: currentShotType(LASER)
+: currentShotType(BallisticRange::LASER)
 {
-    for (AmmoRound *shot = ammo; shot < ammo + ammoRounds; shot++)
-    {
-        shot->type = UNUSED;
-    }
+    setThreaded(true);
 }
 
 const char* BallisticDemo::getTitle()
@@ -79,48 +57,23 @@ const char* BallisticDemo::getTitle()
 
 void BallisticDemo::fire()
 {
-    AmmoRound *shot;
-
-    for (shot = ammo; shot < ammo + ammoRounds; shot++)
-    {
-        if (shot->type == UNUSED) break;
-    }
-
-    if (shot >= ammo + ammoRounds) return;
-
-    switch (currentShotType)
-    {
-    case PISTOL:
-        shot->particle.setMass(2.0f);                  // 2kg
-        shot->particle.setVelocity(0.0f, 0.0f, 35.0f); // 35m/s
-        shot->particle.setAcceleration(0.0f, -1.0f, 0.0f);
-        shot->particle.setDamping(0.99f);
-        break;
-    case ARTILLERY:
-        shot->particle.setMass(200.0f);                 // 200.0kg
-        shot->particle.setVelocity(0.0f, 30.0f, 40.0f); // 50m/s
-        shot->particle.setAcceleration(0.0f, -20.0f, 0.0f);
-        shot->particle.setDamping(0.99f);
-        break;
-    case FIREBALL:
-        shot->particle.setMass(1.0f);
-        shot->particle.setVelocity(0.0f, 0.0f, 10.0f);
-        shot->particle.setAcceleration(0.0f, 0.6f, 0.0f); // float up
-        shot->particle.setDamping(0.9f);
-        break;
-    case LASER:
-        shot->particle.setMass(0.1f); // almost no mass;
-        shot->particle.setVelocity(0.0f, 0.0f, 100.0f);
-        shot->particle.setAcceleration(0.0f, 0.0f, 0.0f); // no gravity.
-        shot->particle.setDamping(0.99f);
-        break;
-    }
+    range.getCommands().push(cyclone::ParticleCommand::spawn(currentShotType));
+}
 
-    shot->particle.setPosition(0.0f, 1.5f, 0.0f);
-    shot->startTime = TimingData::get().lastFrameTimestamp;
-    shot->type = currentShotType;
+void BallisticDemo::render(const cyclone::Vector3 &position)
+{
+    glColor3f(0, 0, 0);
+    glPushMatrix();
+    glTranslatef(position.x, position.y, position.z);
+    glutSolidSphere(0.3f, 5, 4);
+    glPopMatrix();
 
-    shot->particle.clearAccumulator();
+    glColor3f(0.75, 0.75, 0.75);
+    glPushMatrix();
+    glTranslatef(position.x, 0, position.z);
+    glScalef(1.0f, 0.1f, 1.0f);
+    glutSolidSphere(0.6f, 5, 4);
+    glPopMatrix();
 }
 
 void BallisticDemo::display()
@@ -148,12 +101,11 @@ void BallisticDemo::display()
     }
     glEnd();
 
-    for (AmmoRound *shot = ammo; shot < ammo + ammoRounds; shot++) 
+    frames.update();
+    const BallisticFrame &frame = frames.getFront();
+    for (unsigned i = 0; i < frame.positions.size(); i++)
     {
-        if (shot->type != UNUSED)
-        {
-            shot->render();
-        }
+        render(frame.positions[i]);
     }
 
     glColor3f(0.0f, 0.0f, 0.0f);
@@ -161,10 +113,10 @@ void BallisticDemo::display()
 
     switch(currentShotType)
     {
-        case PISTOL: renderText(10.0f, 10.0f, "Current Ammo: Pistol"); break;
-        case ARTILLERY: renderText(10.0f, 10.0f, "Current Ammo: Artillery"); break;
-        case FIREBALL: renderText(10.0f, 10.0f, "Current Ammo: Fireball"); break;
-        case LASER: renderText(10.0f, 10.0f, "Current Ammo: Laser"); break;
+        case BallisticRange::PISTOL: renderText(10.0f, 10.0f, "Current Ammo: Pistol"); break;
+        case BallisticRange::ARTILLERY: renderText(10.0f, 10.0f, "Current Ammo: Artillery"); break;
+        case BallisticRange::FIREBALL: renderText(10.0f, 10.0f, "Current Ammo: Fireball"); break;
+        case BallisticRange::LASER: renderText(10.0f, 10.0f, "Current Ammo: Laser"); break;
     }
 }
 
@@ -172,10 +124,10 @@ void BallisticDemo::key(unsigned char key)
 {
     switch(key)
     {
-        case '1': currentShotType = PISTOL; break;
-        case '2': currentShotType = ARTILLERY; break;
-        case '3': currentShotType = FIREBALL; break;
-        case '4': currentShotType = LASER; break;
+        case '1': currentShotType = BallisticRange::PISTOL; break;
+        case '2': currentShotType = BallisticRange::ARTILLERY; break;
+        case '3': currentShotType = BallisticRange::FIREBALL; break;
+        case '4': currentShotType = BallisticRange::LASER; break;
     }
 }
 
@@ -185,33 +137,26 @@ void BallisticDemo::mouse(int button, int state, int x, int y)
 }
 
 
-void BallisticDemo::update()
+void BallisticDemo::step(cyclone::real duration)
+{
+    range.update(duration);
+}
+
+void BallisticDemo::publish()
 {
-    // find duration fo the last frame in seconds.
-    float duration = (float)TimingData::get().lastFrameDuration * 0.001f;
-    if (duration <= 0.0f)
-        return;
+    BallisticFrame &frame = frames.getBack();
+    frame.positions.clear();
 
-    // update physics of each particle.
-    for (AmmoRound *shot = ammo; shot < ammo + ammoRounds; shot++)
+    const AmmoRound *ammo = range.getRounds();
+    for (const AmmoRound *shot = ammo; shot < ammo + range.getRoundCount(); shot++)
     {
-        if (shot->type != UNUSED)
+        if (shot->type != BallisticRange::UNUSED)
         {
-            // run the physics.
-            shot->particle.integrate(duration);
-
-            // check if particle is now invalid.
-            if (shot->particle.getPosition().y < 0.0f ||
-                shot->startTime + 5000 < TimingData::get().lastFrameTimestamp ||
-                shot->particle.getPosition().z > 200.0f)
-            {   
-                // set particle to unused.
-                shot->type = UNUSED;
-            }
+            frame.positions.push_back(shot->particle.getPosition());
         }
     }
 
-    Application::update();
+    frames.publish();
 }
 
 Application* getApplication()
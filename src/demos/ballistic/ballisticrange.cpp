@@ -0,0 +1,150 @@
+#include <cyclone/profile.h>
+#include "ballisticrange.h"
+
+BallisticRange::BallisticRange(unsigned ammoRounds)
+    : ammoRounds(ammoRounds), commands(64)
+{
+    ammo = new AmmoRound[ammoRounds];
+
+    for (AmmoRound *shot = ammo; shot < ammo + ammoRounds; shot++)
+    {
+        shot->type = UNUSED;
+    }
+}
+
+BallisticRange::~BallisticRange()
+{
+    delete[] ammo;
+}
+
+bool BallisticRange::fire(ShotType type)
+{
+    CYCLONE_PROFILE_SCOPE("spawn/ballistic");
+
+    AmmoRound *shot;
+
+    for (shot = ammo; shot < ammo + ammoRounds; shot++)
+    {
+        if (shot->type == UNUSED) break;
+    }
+
+    if (shot >= ammo + ammoRounds) return false;
+
+    switch (type)
+    {
+    case PISTOL:
+        shot->particle.setMass(2.0f);                  // 2kg
+        shot->particle.setVelocity(0.0f, 0.0f, 35.0f); // 35m/s
+        shot->particle.setAcceleration(0.0f, -1.0f, 0.0f);
+        shot->particle.setDamping(0.99f);
+        break;
+    case ARTILLERY:
+        shot->particle.setMass(200.0f);                 // 200.0kg
+        shot->particle.setVelocity(0.0f, 30.0f, 40.0f); // 50m/s
+        shot->particle.setAcceleration(0.0f, -20.0f, 0.0f);
+        shot->particle.setDamping(0.99f);
+        break;
+    case FIREBALL:
+        shot->particle.setMass(1.0f);
+        shot->particle.setVelocity(0.0f, 0.0f, 10.0f);
+        shot->particle.setAcceleration(0.0f, 0.6f, 0.0f); // float up
+        shot->particle.setDamping(0.9f);
+        break;
+    case LASER:
+        shot->particle.setMass(0.1f); // almost no mass;
+        shot->particle.setVelocity(0.0f, 0.0f, 100.0f);
+        shot->particle.setAcceleration(0.0f, 0.0f, 0.0f); // no gravity.
+        shot->particle.setDamping(0.99f);
+        break;
+    case UNUSED:
+        return false;
+    }
+
+    shot->particle.setPosition(0.0f, 1.5f, 0.0f);
+    shot->age = 0;
+    shot->type = type;
+
+    shot->particle.clearAccumulator();
+    return true;
+}
+
+cyclone::ParticleCommandQueue& BallisticRange::getCommands()
+{
+    return commands;
+}
+
+void BallisticRange::applyCommands()
+{
+    commands.drain([&](const cyclone::ParticleCommand &command) {
+        if (command.action == cyclone::ParticleCommand::SPAWN)
+        {
+            if (command.type < PISTOL || command.type > LASER) return;
+            for (unsigned i = 0; i < command.count; i++) fire((ShotType)command.type);
+            return;
+        }
+        if (command.index >= ammoRounds || ammo[command.index].type == UNUSED) return;
+
+        AmmoRound &shot = ammo[command.index];
+        if (command.action == cyclone::ParticleCommand::IMPULSE)
+        {
+            shot.particle.setVelocity(shot.particle.getVelocity() +
+                                      command.impulse * shot.particle.getInverseMass());
+        }
+        else
+        {
+            shot.type = UNUSED;
+        }
+    });
+}
+
+void BallisticRange::update(cyclone::real duration)
+{
+    applyCommands();
+
+    CYCLONE_PROFILE_SCOPE("integrate/ballistic");
+
+    // update physics of each particle.
+    for (AmmoRound *shot = ammo; shot < ammo + ammoRounds; shot++)
+    {
+        if (shot->type != UNUSED)
+        {
+            // run the physics.
+            shot->particle.integrate(duration);
+            shot->age += duration;
+
+            // check if particle is now invalid.
+            if (shot->particle.getPosition().y < 0.0f ||
+                shot->age > 5.0f ||
+                shot->particle.getPosition().z > 200.0f)
+            {
+                // set particle to unused.
+                shot->type = UNUSED;
+            }
+        }
+    }
+}
+
+BallisticRange::AmmoRound* BallisticRange::getRounds()
+{
+    return ammo;
+}
+
+const BallisticRange::AmmoRound* BallisticRange::getRounds() const
+{
+    return ammo;
+}
+
+unsigned BallisticRange::getRoundCount() const
+{
+    return ammoRounds;
+}
+
+unsigned BallisticRange::getLiveCount() const
+{
+    unsigned count = 0;
+    for (const AmmoRound *shot = ammo; shot < ammo + ammoRounds; shot++)
+    {
+        if (shot->type != UNUSED) count++;
+    }
+    return count;
+}
@@ -0,0 +1,77 @@
+#ifndef CYCLONE_DEMO_BALLISTICRANGE_H
+#define CYCLONE_DEMO_BALLISTICRANGE_H
+
+#include <cyclone/cyclone.h>
+
+/**
+ * The ballistic simulation without any rendering, shared by the demo and
+ * the headless runner.
+ */
+class BallisticRange
+{
+public:
+    enum ShotType
+    {
+        UNUSED = 0,
+        PISTOL,
+        ARTILLERY,
+        FIREBALL,
+        LASER
+    };
+
+    struct AmmoRound
+    {
+        cyclone::Particle particle;
+        ShotType type;
+        /** Seconds since the round was fired. */
+        cyclone::real age;
+    };
+
+protected:
+    AmmoRound *ammo;
+
+    unsigned ammoRounds;
+
+    /**
+     * Spawns, impulses and removals pushed from other threads. A spawn
+     * fires rounds of its shot type.
+     */
+    cyclone::ParticleCommandQueue commands;
+
+    /** Applies the commands pushed since the last update. */
+    void applyCommands();
+
+public:
+    BallisticRange(unsigned ammoRounds = 16);
+    ~BallisticRange();
+
+    /**
+     * Fires a round of the given type from the first free slot. Returns
+     * false if every round is still in flight.
+     */
+    bool fire(ShotType type);
+
+    /**
+     * The queue other threads push commands onto rather than calling
+     * fire while the simulation is running. Commands are applied at the
+     * start of the next update, before anything moves.
+     */
+    cyclone::ParticleCommandQueue& getCommands();
+
+    /**
+     * Applies any queued commands, then moves every round on and frees
+     * those that hit the ground, leave the range or have been flying for
+     * more than five seconds.
+     */
+    void update(cyclone::real duration);
+
+    AmmoRound* getRounds();
+
+    const AmmoRound* getRounds() const;
+
+    unsigned getRoundCount() const;
+
+    unsigned getLiveCount() const;
+};
+
+#endif
@@ -0,0 +1,735 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cyclone/profile.h>
+#include "fireworksystem.h"
+
+void FireworkRule::create(cyclone::Random &random, cyclone::Particle &firework, cyclone::real &age,
+                          const cyclone::Particle *parent) const
+{
+    age = random.randomReal() * ageRange + minAge;
+
+    cyclone::Vector3 vel;
+    if (parent) {
+        // The position and velocity are based on the parent.
+        firework.setPosition(parent->getPosition());
+        vel += parent->getVelocity();
+    }
+    else
+    {
+        cyclone::Vector3 start;
+        int x = (int)random.randomInt(3) - 1;
+        start.x = 5.0f * cyclone::real(x);
+        firework.setPosition(start);
+    }
+
+    // z first, the order the components were drawn in when this went
+    // through Random::randomVector, so existing runs stay the same.
+    cyclone::real z = random.randomReal() * velocityRange.z + minVelocity.z;
+    cyclone::real y = random.randomReal() * velocityRange.y + minVelocity.y;
+    cyclone::real x = random.randomReal() * velocityRange.x + minVelocity.x;
+    vel += cyclone::Vector3(x, y, z);
+    firework.setVelocity(vel);
+
+    // We use a mass of one in all cases (no point having fireworks
+    // with different masses, since they are only under the influence
+    // of gravity).
+    firework.setMass(1);
+
+    firework.setDamping(damping);
+
+    firework.setAcceleration(cyclone::Vector3::GRAVITY);
+
+    firework.clearAccumulator();
+}
+
+static const char defaultRules[] =
+    "effect rocket\n"
+    "    age 0.5 1.4\n"
+    "    velocity -5 25 -5  5 28 5\n"
+    "    damping 0.1\n"
+    "    colour 1 0 0\n"
+    "    payload spark 5\n"
+    "    payload burst 5\n"
+    "effect fountain\n"
+    "    age 0.5 1.0\n"
+    "    velocity -5 10 -5  5 20 5\n"
+    "    damping 0.8\n"
+    "    colour 1 0.5 0\n"
+    "    payload spray 2\n"
+    "effect spark\n"
+    "    age 0.5 1.5\n"
+    "    velocity -5 -5 -5  5 5 5\n"
+    "    damping 0.1\n"
+    "    colour 1 1 0\n"
+    "effect spray\n"
+    "    age 0.25 0.5\n"
+    "    velocity -20 5 -5  20 5 5\n"
+    "    damping 0.2\n"
+    "    colour 0 1 0\n"
+    "effect burst\n"
+    "    age 0.5 1.0\n"
+    "    velocity -20 2 -5  20 18 5\n"
+    "    damping 0.01\n"
+    "    colour 0 1 1\n"
+    "    payload spark 5\n"
+    "effect drift\n"
+    "    age 3 5\n"
+    "    velocity -5 5 -5  5 10 5\n"
+    "    damping 0.95\n"
+    "    colour 0.4 0.4 1\n"
+    "    interval 4\n"
+    "effect shell\n"
+    "    age 4 5\n"
+    "    velocity -5 50 -5  5 60 5\n"
+    "    damping 0.01\n"
+    "    colour 1 0 1\n"
+    "    payload crackle 10\n"
+    "effect crackle\n"
+    "    age 0.25 0.5\n"
+    "    velocity -1 -1 -1  1 1 1\n"
+    "    damping 0.01\n"
+    "    colour 1 1 1\n"
+    "effect ember\n"
+    "    age 3 5\n"
+    "    velocity -15 10 -5  15 15 5\n"
+    "    damping 0.95\n"
+    "    colour 1 0.5 0.5\n"
+    "    interval 4\n";
+
+const char* FireworkRuleTable::getDefaultRules()
+{
+    return defaultRules;
+}
+
+/** Most slots in each chunk the update is split into. */
+static const unsigned updateChunkSize = 4096;
+
+/** Fewest chunks the update is split into, when there are enough slots. */
+static const unsigned updateChunks = 8;
+
+/** Most fireworks a single payload line may launch. */
+static const unsigned long maxPayloadCount = 1000;
+
+static bool parseError(std::string *error, unsigned line, const char *message)
+{
+    if (error)
+    {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "line %u: %s", line, message);
+        *error = buffer;
+    }
+    return false;
+}
+
+/** Reads the given number of reals from the words after the first. */
+static bool parseReals(const std::vector<std::string> &words, unsigned count, cyclone::real *values)
+{
+    if (words.size() != count + 1) return false;
+    for (unsigned i = 0; i < count; i++)
+    {
+        const char *text = words[i + 1].c_str();
+        char *end;
+        values[i] = (cyclone::real)strtod(text, &end);
+        if (end == text || *end != 0) return false;
+    }
+    return true;
+}
+
+/**
+ * Works out the size of a rule's cascade, depth first. Returns false if
+ * a payload chain leads back to a rule that is still being visited.
+ */
+static bool resolveCascade(std::vector<FireworkRule> &rules, const std::vector<FireworkPayload> &payloads,
+                           std::vector<unsigned char> &state, unsigned index, unsigned &cycle)
+{
+    enum { UNVISITED, VISITING, DONE };
+    if (state[index] == DONE) return true;
+    if (state[index] == VISITING)
+    {
+        cycle = index;
+        return false;
+    }
+
+    state[index] = VISITING;
+    FireworkRule &rule = rules[index];
+
+    // sizes saturate rather than wrap, so a huge cascade still looks huge.
+    const unsigned long long limit = ~0ULL;
+    unsigned long long size = 1;
+    for (unsigned i = 0; i < rule.payloadCount; i++)
+    {
+        const FireworkPayload &payload = payloads[rule.firstPayload + i];
+        if (!resolveCascade(rules, payloads, state, payload.type - 1, cycle)) return false;
+
+        unsigned long long child = rules[payload.type - 1].cascadeSize;
+        if (payload.count > 0 && child > (limit - size) / payload.count) size = limit;
+        else size += child * payload.count;
+    }
+
+    rule.cascadeSize = size;
+    state[index] = DONE;
+    return true;
+}
+
+bool FireworkRuleTable::parse(const char *text, std::string *error)
+{
+    std::vector<FireworkRule> rules;
+    std::vector<std::string> names;
+
+    // payloads name their effect, which may not have been seen yet.
+    struct PendingPayload
+    {
+        unsigned rule;
+        std::string name;
+        unsigned count;
+        unsigned line;
+    };
+    std::vector<PendingPayload> pending;
+
+    unsigned lineNumber = 0;
+    while (*text)
+    {
+        const char *end = text + strcspn(text, "\n");
+        std::string line(text, end);
+        text = *end ? end + 1 : end;
+        lineNumber++;
+
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+
+        std::vector<std::string> words;
+        size_t start = line.find_first_not_of(" \t\r");
+        while (start != std::string::npos)
+        {
+            size_t stop = line.find_first_of(" \t\r", start);
+            words.push_back(line.substr(start, stop - start));
+            start = line.find_first_not_of(" \t\r", stop);
+        }
+        if (words.empty()) continue;
+
+        const std::string &key = words[0];
+        if (key == "effect")
+        {
+            if (words.size() != 2) return parseError(error, lineNumber, "expected 'effect NAME'");
+            for (unsigned i = 0; i < names.size(); i++)
+            {
+                if (names[i] == words[1]) return parseError(error, lineNumber, "effect defined twice");
+            }
+
+            FireworkRule rule;
+            rule.type = (unsigned)rules.size() + 1;
+            rule.minAge = 1;
+            rule.ageRange = 0;
+            rule.damping = 0.99f;
+            rule.firstPayload = 0;
+            rule.payloadCount = 0;
+            rule.cascadeSize = 1;
+            rule.level = 0;
+            rule.colour[0] = rule.colour[1] = rule.colour[2] = 1;
+            rules.push_back(rule);
+            names.push_back(words[1]);
+            continue;
+        }
+
+        if (rules.empty()) return parseError(error, lineNumber, "setting outside an effect");
+        FireworkRule &rule = rules.back();
+
+        cyclone::real values[6];
+        if (key == "age")
+        {
+            if (!parseReals(words, 2, values) || values[1] < values[0] || values[0] < 0)
+            {
+                return parseError(error, lineNumber, "expected 'age MIN MAX'");
+            }
+            rule.minAge = values[0];
+            rule.ageRange = values[1] - values[0];
+        }
+        else if (key == "velocity")
+        {
+            if (!parseReals(words, 6, values))
+            {
+                return parseError(error, lineNumber, "expected 'velocity MINX MINY MINZ MAXX MAXY MAXZ'");
+            }
+            rule.minVelocity = cyclone::Vector3(values[0], values[1], values[2]);
+            rule.velocityRange = cyclone::Vector3(values[3] - values[0], values[4] - values[1],
+                                                  values[5] - values[2]);
+        }
+        else if (key == "damping")
+        {
+            if (!parseReals(words, 1, values)) return parseError(error, lineNumber, "expected 'damping VALUE'");
+            rule.damping = values[0];
+        }
+        else if (key == "colour" || key == "color")
+        {
+            if (!parseReals(words, 3, values)) return parseError(error, lineNumber, "expected 'colour R G B'");
+            for (unsigned i = 0; i < 3; i++) rule.colour[i] = values[i];
+        }
+        else if (key == "interval")
+        {
+            char *stop = NULL;
+            unsigned long steps = words.size() == 2 ? strtoul(words[1].c_str(), &stop, 10) : 0;
+            if (stop == NULL || *stop != 0 || steps == 0 || steps > 128 || (steps & (steps - 1)) != 0)
+            {
+                return parseError(error, lineNumber, "expected 'interval STEPS', a power of two up to 128");
+            }
+
+            rule.level = 0;
+            while ((1ul << rule.level) < steps) rule.level++;
+        }
+        else if (key == "payload")
+        {
+            // strtoul would take a sign, turning -1 into a huge count.
+            char *stop = NULL;
+            unsigned long count = words.size() == 3 && isdigit((unsigned char)words[2][0]) ?
+                strtoul(words[2].c_str(), &stop, 10) : 0;
+            if (stop == NULL || *stop != 0 || count == 0 || count > maxPayloadCount)
+            {
+                return parseError(error, lineNumber, "expected 'payload EFFECT COUNT', a count from 1 to 1000");
+            }
+
+            PendingPayload payload = {(unsigned)rules.size() - 1, words[1], (unsigned)count, lineNumber};
+            pending.push_back(payload);
+        }
+        else
+        {
+            return parseError(error, lineNumber, ("unknown setting '" + key + "'").c_str());
+        }
+    }
+
+    if (rules.empty()) return parseError(error, lineNumber, "no effects");
+
+    // lay the payloads out rule by rule, in the order they were given.
+    std::vector<FireworkPayload> payloads;
+    for (unsigned r = 0; r < rules.size(); r++)
+    {
+        rules[r].firstPayload = (unsigned)payloads.size();
+        for (unsigned i = 0; i < pending.size(); i++)
+        {
+            if (pending[i].rule != r) continue;
+
+            unsigned target = 0;
+            while (target < names.size() && names[target] != pending[i].name) target++;
+            if (target == names.size())
+            {
+                return parseError(error, pending[i].line,
+                                  ("unknown effect '" + pending[i].name + "'").c_str());
+            }
+
+            FireworkPayload payload = {target + 1, pending[i].count};
+            payloads.push_back(payload);
+        }
+        rules[r].payloadCount = (unsigned)payloads.size() - rules[r].firstPayload;
+    }
+
+    std::vector<unsigned char> state(rules.size(), 0);
+    for (unsigned r = 0; r < rules.size(); r++)
+    {
+        unsigned cycle = 0;
+        if (!resolveCascade(rules, payloads, state, r, cycle))
+        {
+            if (error) *error = "effect '" + names[cycle] + "' is its own payload";
+            return false;
+        }
+    }
+
+    FireworkRuleTable::rules.swap(rules);
+    FireworkRuleTable::payloads.swap(payloads);
+    FireworkRuleTable::names.swap(names);
+    return true;
+}
+
+bool FireworkRuleTable::load(const char *filename, std::string *error)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        if (error) *error = std::string("can't open '") + filename + "'";
+        return false;
+    }
+
+    std::string text;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, read);
+    fclose(file);
+
+    return parse(text.c_str(), error);
+}
+
+unsigned FireworkRuleTable::getRuleCount() const
+{
+    return (unsigned)rules.size();
+}
+
+const FireworkRule* FireworkRuleTable::getRule(unsigned type) const
+{
+    if (type == 0 || type > rules.size()) return NULL;
+    return &rules[type - 1];
+}
+
+const FireworkPayload* FireworkRuleTable::getPayloads(const FireworkRule &rule) const
+{
+    // a rule without payloads may start one past the end.
+    return rule.payloadCount == 0 ? NULL : payloads.data() + rule.firstPayload;
+}
+
+const char* FireworkRuleTable::getName(unsigned type) const
+{
+    if (type == 0 || type > names.size()) return NULL;
+    return names[type - 1].c_str();
+}
+
+FireworkSystem::FireworkSystem(unsigned maxFireworks)
+    : store(maxFireworks), maxFireworks(maxFireworks), nextFirework(0),
+      scheduler(cyclone::MultiRateScheduler::MAX_LEVELS, maxFireworks), multiRate(false), commands(256),
+      states(maxFireworks, IDLE), elapsed(maxFireworks, 0), committing(false), commitSlot(0), stepDuration(0)
+{
+    typeColumn = store.addColumn<unsigned>("type", 0);
+    ageColumn = store.addColumn<cyclone::real>("age", 0);
+
+    rules.parse(FireworkRuleTable::getDefaultRules());
+
+    chunkSize = (maxFireworks + updateChunks - 1) / updateChunks;
+    if (chunkSize > updateChunkSize) chunkSize = updateChunkSize;
+    if (chunkSize < 1) chunkSize = 1;
+    const unsigned chunks = (maxFireworks + chunkSize - 1) / chunkSize;
+    detonations.resize(chunks);
+
+    std::vector<unsigned> lifetimes;
+    for (unsigned chunk = 0; chunk < chunks; chunk++)
+    {
+        const unsigned first = chunk * chunkSize;
+        const unsigned last = first + chunkSize < maxFireworks ? first + chunkSize : maxFireworks;
+
+        unsigned moving = graph.addTask("integrate/fireworks", first, last, chunkSize, [this](unsigned begin, unsigned end) {
+            CYCLONE_PROFILE_SCOPE("integrate/fireworks");
+            const unsigned *types = getTypes();
+            for (unsigned i = begin; i < end; i++)
+            {
+                states[i] = IDLE;
+                if (types[i] == 0) continue;
+
+                elapsed[i] = move(i, stepDuration);
+                if (elapsed[i] >= 0) states[i] = MOVED;
+            }
+        });
+
+        unsigned ageing = graph.addTask("lifetime/fireworks", first, last, chunkSize, [this](unsigned begin, unsigned end) {
+            CYCLONE_PROFILE_SCOPE("lifetime/fireworks");
+            std::vector<unsigned> &detonating = detonations[begin / chunkSize];
+            detonating.clear();
+
+            for (unsigned i = begin; i < end; i++)
+            {
+                if (states[i] != MOVED || !burnsOut(i, elapsed[i])) continue;
+
+                states[i] = DETONATING;
+                detonating.push_back(i);
+            }
+        });
+
+        graph.addDependency(moving, ageing);
+        lifetimes.push_back(ageing);
+    }
+
+    unsigned committed = graph.addTask("detonate/fireworks", [this]() {
+        commit();
+    });
+    for (unsigned i = 0; i < lifetimes.size(); i++) graph.addDependency(lifetimes[i], committed);
+}
+
+void FireworkSystem::seed(unsigned s)
+{
+    random.seed(s);
+}
+
+bool FireworkSystem::loadRules(const char *filename, std::string *error)
+{
+    if (!rules.load(filename, error)) return false;
+
+    // fireworks of types that no longer exist go out.
+    cyclone::AttributeView<unsigned> types = store.getView<unsigned>(typeColumn);
+    for (unsigned i = 0; i < maxFireworks; i++)
+    {
+        if (rules.getRule(types[i]) == NULL) types[i] = 0;
+    }
+    schedule();
+    return true;
+}
+
+void FireworkSystem::schedule()
+{
+    const unsigned *types = getTypes();
+    for (unsigned i = 0; i < maxFireworks; i++)
+    {
+        if (types[i] > 0) scheduler.add(i, rules.getRule(types[i])->level);
+        else scheduler.remove(i);
+    }
+}
+
+void FireworkSystem::setMultiRate(bool multiRate)
+{
+    if (multiRate && !FireworkSystem::multiRate) schedule();
+    FireworkSystem::multiRate = multiRate;
+}
+
+bool FireworkSystem::isMultiRate() const
+{
+    return multiRate;
+}
+
+const cyclone::MultiRateScheduler& FireworkSystem::getScheduler() const
+{
+    return scheduler;
+}
+
+const FireworkRuleTable& FireworkSystem::getRules() const
+{
+    return rules;
+}
+
+unsigned FireworkSystem::getRuleCount() const
+{
+    return rules.getRuleCount();
+}
+
+void FireworkSystem::create(unsigned type, const cyclone::Particle *parent)
+{
+    const FireworkRule *rule = rules.getRule(type);
+    if (rule == NULL) return;
+
+    store.getView<unsigned>(typeColumn)[nextFirework] = type;
+    rule->create(random, store.getParticle(nextFirework),
+                 store.getView<cyclone::real>(ageColumn)[nextFirework], parent);
+    scheduler.add(nextFirework, rule->level);
+
+    // a slot the commit hasn't reached yet gets moved on this update.
+    if (committing && nextFirework > commitSlot)
+    {
+        states[nextFirework] = LAUNCHED;
+        visits.push(nextFirework);
+    }
+
+    nextFirework = (nextFirework + 1) % maxFireworks;
+}
+
+void FireworkSystem::create(unsigned type, unsigned number, const cyclone::Particle *parent)
+{
+    CYCLONE_PROFILE_SCOPE("spawn/fireworks");
+
+    for (unsigned i = 0; i < number; i++)
+    {
+        create(type, parent);
+    }
+}
+
+cyclone::ParticleCommandQueue& FireworkSystem::getCommands()
+{
+    return commands;
+}
+
+void FireworkSystem::applyCommands()
+{
+    CYCLONE_PROFILE_SCOPE("spawn/commands");
+
+    cyclone::Particle *particles = store.getParticles();
+    cyclone::AttributeView<unsigned> types = store.getView<unsigned>(typeColumn);
+
+    commands.drain([&](const cyclone::ParticleCommand &command) {
+        if (command.action == cyclone::ParticleCommand::SPAWN)
+        {
+            create(command.type, command.count, NULL);
+            return;
+        }
+        if (command.index >= maxFireworks || types[command.index] == 0) return;
+
+        cyclone::Particle &firework = particles[command.index];
+        if (command.action == cyclone::ParticleCommand::IMPULSE)
+        {
+            firework.setVelocity(firework.getVelocity() + command.impulse * firework.getInverseMass());
+        }
+        else
+        {
+            // taken out without going off.
+            types[command.index] = 0;
+            scheduler.remove(command.index);
+        }
+    });
+}
+
+cyclone::real FireworkSystem::move(unsigned index, cyclone::real duration)
+{
+    cyclone::Particle &firework = store.getParticle(index);
+
+    // slow types only move on when their turn comes round, by the time
+    // since they last did.
+    if (multiRate)
+    {
+        if (!scheduler.isDue(index)) return -1;
+        return scheduler.integrate(index, firework);
+    }
+
+    firework.integrate(duration);
+    return duration;
+}
+
+bool FireworkSystem::burnsOut(unsigned index, cyclone::real elapsed)
+{
+    cyclone::real &age = store.getView<cyclone::real>(ageColumn)[index];
+    age -= elapsed;
+    return age < 0 || store.getParticle(index).getPosition().y < 0;
+}
+
+void FireworkSystem::detonate(unsigned index)
+{
+    cyclone::Particle &firework = store.getParticle(index);
+    cyclone::AttributeView<unsigned> types = store.getView<unsigned>(typeColumn);
+
+    // Find the appropriate rule
+    const FireworkRule *rule = rules.getRule(types[index]);
+
+    // Delete the current firework (this doesn't affect its position and
+    // velocity for passing to the create function, just whether or not
+    // it is processed for rendering or physics.
+    types[index] = 0;
+    scheduler.remove(index);
+
+    // Push the fireworks around it outwards.
+    explosions.addBlast(firework.getPosition(), 2.0f, 3.0f);
+
+    // Add the payload
+    const FireworkPayload *payload = rules.getPayloads(*rule);
+    for (unsigned p = 0; p < rule->payloadCount; p++, payload++)
+    {
+        create(payload->type, payload->count, &firework);
+    }
+}
+
+void FireworkSystem::commit()
+{
+    CYCLONE_PROFILE_SCOPE("detonate/fireworks");
+
+    for (unsigned chunk = 0; chunk < detonations.size(); chunk++)
+    {
+        for (unsigned i = 0; i < detonations[chunk].size(); i++) visits.push(detonations[chunk][i]);
+    }
+
+    // the same order a single pass over the slots would go in, so the
+    // payloads draw the same numbers however many threads there are.
+    committing = true;
+    commitSlot = 0;
+    while (!visits.empty())
+    {
+        unsigned index = visits.top();
+        visits.pop();
+
+        // a slot may be queued twice, if a payload took it over.
+        unsigned char state = states[index];
+        states[index] = IDLE;
+        if (state == LAUNCHED)
+        {
+            commitSlot = index;
+            cyclone::real moved = move(index, stepDuration);
+            if (moved < 0 || !burnsOut(index, moved)) continue;
+        }
+        else if (state != DETONATING)
+        {
+            continue;
+        }
+
+        commitSlot = index;
+        detonate(index);
+    }
+    committing = false;
+
+    // All of this frame's detonations are applied in one pass, to the
+    // fireworks that are still alive.
+    if (explosions.getPendingBlastCount() > 0)
+    {
+        cyclone::Particle *particles = store.getParticles();
+        const unsigned *types = getTypes();
+
+        explosions.clear();
+        for (unsigned i = 0; i < maxFireworks; i++)
+        {
+            if (types[i] > 0) explosions.add(particles + i);
+        }
+        explosions.apply();
+    }
+}
+
+void FireworkSystem::update(cyclone::real duration)
+{
+    applyCommands();
+
+    scheduler.advance(duration);
+
+    stepDuration = duration;
+    graph.run();
+}
+
+cyclone::Particle* FireworkSystem::getParticles()
+{
+    return store.getParticles();
+}
+
+const cyclone::Particle* FireworkSystem::getParticles() const
+{
+    return store.getParticles();
+}
+
+const unsigned* FireworkSystem::getTypes() const
+{
+    return store.getView<unsigned>(typeColumn).getData();
+}
+
+cyclone::ParticleStore& FireworkSystem::getStore()
+{
+    return store;
+}
+
+const cyclone::ParticleStore& FireworkSystem::getStore() const
+{
+    return store;
+}
+
+unsigned FireworkSystem::getMaxFireworks() const
+{
+    return maxFireworks;
+}
+
+unsigned FireworkSystem::getLiveCount() const
+{
+    const unsigned *types = getTypes();
+    unsigned count = 0;
+    for (unsigned i = 0; i < maxFireworks; i++)
+    {
+        if (types[i] > 0) count++;
+    }
+    return count;
+}
+
+void FireworkSystem::setColours(cyclone::RenderExtractor &extractor) const
+{
+    for (unsigned type = 1; type <= rules.getRuleCount(); type++)
+    {
+        const cyclone::real *colour = rules.getRule(type)->colour;
+        extractor.setColour(type, colour[0], colour[1], colour[2]);
+    }
+}
+
+bool FireworkSystem::describe(cyclone::Snapshot &snapshot)
+{
+    if (multiRate) return false;
+
+    cyclone::Particle *particles = store.getParticles();
+    for (unsigned i = 0; i < maxFireworks; i++) snapshot.particles.push_back(particles + i);
+
+    snapshot.particleWords.push_back(store.getView<unsigned>(typeColumn).getData());
+    snapshot.particleReals.push_back(store.getView<cyclone::real>(ageColumn).getData());
+    snapshot.values.push_back(&nextFirework);
+    snapshot.randoms.push_back(&random);
+    return true;
+}
\ No newline at end of file
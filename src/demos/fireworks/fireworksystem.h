@@ -0,0 +1,301 @@
+#ifndef CYCLONE_DEMO_FIREWORKSYSTEM_H
+#define CYCLONE_DEMO_FIREWORKSYSTEM_H
+
+#include <queue>
+#include <string>
+#include <vector>
+#include <cyclone/cyclone.h>
+
+/**
+ * A payload released by a detonating firework: a number of fireworks
+ * of another type.
+ */
+struct FireworkPayload
+{
+    unsigned type;
+
+    unsigned count;
+};
+
+/**
+ * How one type of firework is launched and what it leaves behind, as
+ * compiled into a FireworkRuleTable.
+ */
+struct FireworkRule
+{
+    unsigned type;
+
+    /** The age is drawn from [minAge, minAge + ageRange). */
+    cyclone::real minAge;
+    cyclone::real ageRange;
+
+    /** Each velocity component is drawn from min to min + range. */
+    cyclone::Vector3 minVelocity;
+    cyclone::Vector3 velocityRange;
+
+    cyclone::real damping;
+
+    /** The rule's payloads, a range of the table's payload array. */
+    unsigned firstPayload;
+    unsigned payloadCount;
+
+    /**
+     * Number of fireworks a single one of this type turns into over its
+     * whole cascade, itself included.
+     */
+    unsigned long long cascadeSize;
+
+    /** Red, green and blue, from 0 to 1. */
+    cyclone::real colour[3];
+
+    /**
+     * Fireworks of this type are updated every 2^level steps when
+     * multi-rate stepping is on.
+     */
+    unsigned level;
+
+    /**
+     * Launches a firework of this type into the given particle, from the
+     * parent if there is one, and sets the age it will detonate at.
+     */
+    void create(cyclone::Random &random, cyclone::Particle &firework, cyclone::real &age,
+                const cyclone::Particle *parent = NULL) const;
+};
+
+/**
+ * Every firework rule, compiled from a text description into two flat
+ * arrays: the rules, indexed by type, and all of their payloads one
+ * after another.
+ *
+ * The description is a list of effects, one line per setting:
+ *
+ *     # a comment
+ *     effect rocket
+ *         age 0.5 1.4
+ *         velocity -5 25 -5  5 28 5
+ *         damping 0.1
+ *         colour 1 0 0
+ *         payload burst 5
+ *
+ * Effects become types in the order they are given, starting at one.
+ * Age and velocity give the ranges they're drawn from, minimum first.
+ * Interval, one by default, updates the effect only every so many
+ * steps, a power of two, when multi-rate stepping is on; it suits slow
+ * effects that live a long time. Payloads name other effects, given
+ * before or after, and launch from 1 to 1000 of them. Names are
+ * resolved when the table is compiled, and a payload chain that leads
+ * back to itself is an error, since it would never burn out.
+ */
+class FireworkRuleTable
+{
+protected:
+    std::vector<FireworkRule> rules;
+
+    std::vector<FireworkPayload> payloads;
+
+    std::vector<std::string> names;
+
+public:
+    /**
+     * Compiles a description, replacing the table. On failure the
+     * table is left alone and the error describes the problem.
+     */
+    bool parse(const char *text, std::string *error = NULL);
+
+    /** Compiles the description in the given file. */
+    bool load(const char *filename, std::string *error = NULL);
+
+    unsigned getRuleCount() const;
+
+    /** Returns the rule of a type, or NULL if there is no such type. */
+    const FireworkRule* getRule(unsigned type) const;
+
+    const FireworkPayload* getPayloads(const FireworkRule &rule) const;
+
+    const char* getName(unsigned type) const;
+
+    /** The description of the nine fireworks of the original demo. */
+    static const char* getDefaultRules();
+};
+
+/**
+ * The fireworks simulation without any rendering, shared by the demo and
+ * the headless runner.
+ */
+class FireworkSystem
+{
+protected:
+    /**
+     * Every firework slot. Each has a type, zero for a free slot, and an
+     * age that counts down to zero, when the firework delivers its
+     * payload.
+     */
+    cyclone::ParticleStore store;
+    cyclone::ParticleStore::Column typeColumn;
+    cyclone::ParticleStore::Column ageColumn;
+
+    unsigned maxFireworks;
+
+    unsigned nextFirework;
+
+    FireworkRuleTable rules;
+
+    cyclone::Random random;
+
+    /** Shockwaves of detonating fireworks, applied to their neighbours. */
+    cyclone::ParticleExplosions explosions;
+
+    /** Which fireworks are due on each step, by their rule's interval. */
+    cyclone::MultiRateScheduler scheduler;
+
+    bool multiRate;
+
+    /**
+     * Spawns, impulses and removals pushed from other threads. A spawn
+     * launches fireworks of its type from the ground.
+     */
+    cyclone::ParticleCommandQueue commands;
+
+    /**
+     * The update as a graph of tasks, with the slots split into chunks.
+     * Each chunk has a task that moves its fireworks on and one that
+     * ages them and picks out those that go off. The detonations are
+     * then committed by a single task, in slot order, since each draws
+     * its payload from the one random number generator.
+     */
+    cyclone::TaskGraph graph;
+
+    unsigned chunkSize;
+
+    /** What the update has done with each slot so far. */
+    enum SlotState
+    {
+        IDLE,
+        MOVED,
+        DETONATING,
+        /** Filled by this update's payloads, and not yet moved. */
+        LAUNCHED
+    };
+    std::vector<unsigned char> states;
+
+    /** The time each moved firework was moved over. */
+    std::vector<cyclone::real> elapsed;
+
+    /** The fireworks of each chunk that go off, in slot order. */
+    std::vector<std::vector<unsigned> > detonations;
+
+    /**
+     * Slots the commit still has to visit, lowest first. Payloads
+     * launched ahead of the slot being committed join them, since a
+     * firework that was updated one by one would still reach them.
+     */
+    std::priority_queue<unsigned, std::vector<unsigned>, std::greater<unsigned> > visits;
+
+    /** The slot being committed, while committing. */
+    bool committing;
+    unsigned commitSlot;
+
+    /** The duration of the update the graph is running. */
+    cyclone::real stepDuration;
+
+    /** Puts every live firework in its rule's bucket. */
+    void schedule();
+
+    /** Applies the commands pushed since the last update. */
+    void applyCommands();
+
+    /**
+     * Moves a live firework on, returning the time it was moved over,
+     * or less than zero if it isn't due this update.
+     */
+    cyclone::real move(unsigned index, cyclone::real duration);
+
+    /** Ages a moved firework, returning true if it goes off. */
+    bool burnsOut(unsigned index, cyclone::real elapsed);
+
+    /** Takes out a firework and launches its payload. */
+    void detonate(unsigned index);
+
+    /** Detonates, in slot order, the fireworks that went off. */
+    void commit();
+
+public:
+    FireworkSystem(unsigned maxFireworks = 1024);
+
+    /** The graph's tasks refer back to the system, so it can't be copied. */
+    FireworkSystem(const FireworkSystem &) = delete;
+    FireworkSystem& operator=(const FireworkSystem &) = delete;
+
+    void seed(unsigned s);
+
+    /**
+     * Replaces the firework rules with those in the given file. Returns
+     * false, keeping the old rules, if it can't be read or compiled.
+     */
+    bool loadRules(const char *filename, std::string *error = NULL);
+
+    const FireworkRuleTable& getRules() const;
+
+    /** Number of firework types, numbered from one. */
+    unsigned getRuleCount() const;
+
+    /**
+     * Turns multi-rate stepping on or off. While it is on, fireworks
+     * whose rules give an interval are only updated that often, over
+     * the time since they last were. It is off by default, and then
+     * every firework is updated on every step.
+     */
+    void setMultiRate(bool multiRate);
+
+    bool isMultiRate() const;
+
+    const cyclone::MultiRateScheduler& getScheduler() const;
+
+    void create(unsigned type, const cyclone::Particle *parent);
+
+    void create(unsigned type, unsigned number, const cyclone::Particle *parent);
+
+    /**
+     * The queue other threads push commands onto rather than calling
+     * create while the simulation is running. Commands are applied at
+     * the start of the next update, before anything moves.
+     */
+    cyclone::ParticleCommandQueue& getCommands();
+
+    /**
+     * Applies any queued commands, then moves every live firework on and
+     * fires the payloads of those that detonate.
+     */
+    void update(cyclone::real duration);
+
+    cyclone::Particle* getParticles();
+
+    const cyclone::Particle* getParticles() const;
+
+    /** The type of every slot, zero for a free one. */
+    const unsigned* getTypes() const;
+
+    /**
+     * The store behind the fireworks, for adding columns of data of
+     * one's own. It must not be resized.
+     */
+    cyclone::ParticleStore& getStore();
+
+    const cyclone::ParticleStore& getStore() const;
+
+    unsigned getMaxFireworks() const;
+
+    unsigned getLiveCount() const;
+
+    /** Sets the colour each type of firework is drawn in. */
+    void setColours(cyclone::RenderExtractor &extractor) const;
+
+    /**
+     * Adds the fireworks, their types and ages, the next slot to fill
+     * and the random number generator to the snapshot. Returns false if
+     * multi-rate stepping is on, since the schedule isn't saved.
+     */
+    bool describe(cyclone::Snapshot &snapshot);
+};
+
+#endif
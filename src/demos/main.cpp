@@ -1,3 +1,4 @@
+#include <string.h>
 #include "ogl_headers.h"
 
 #include "app.h"
@@ -31,6 +32,8 @@ void display()
   glutSwapBuffers();
 }
 
+// Input doesn't take the simulation lock, so it never waits for a step.
+// Demos queue their changes for the simulation to apply.
 void mouse(int button, int state, int x, int y)
 {
   app->mouse(button, state, x, y);
@@ -46,6 +49,13 @@ void reshape(int width, int height)
     app->resize(width, height);
 }
 
+// GLUT usually leaves its main loop by calling exit, so the physics
+// thread has to be stopped from here too.
+void stopPhysics()
+{
+  if (app) app->stopSimulation();
+}
+
 
 int main(int argc, char** argv)
 {
@@ -53,6 +63,11 @@ int main(int argc, char** argv)
   TimingData::init();
 
   app = getApplication();
+  for (int i = 1; i < argc; i++)
+  {
+    // Step the physics once per displayed frame, as the demos used to.
+    if (strcmp(argv[i], "--single-thread") == 0) app->setThreaded(false);
+  }
   createWindow(app->getTitle());
 
   glutKeyboardFunc(keyboard);
@@ -62,9 +77,12 @@ int main(int argc, char** argv)
   glutIdleFunc(update);
 
   app->initGraphics();
+  app->startSimulation();
+  atexit(stopPhysics);
   glutMainLoop();
 
   app->deinit();
   delete app;
+  app = NULL;
   TimingData::deinit();
 }
\ No newline at end of file
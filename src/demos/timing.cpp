@@ -1,3 +1,4 @@
+#include <cyclone/timer.h>
 #include "timing.h"
 
 static bool qpcFlag;
@@ -5,7 +6,6 @@ static bool qpcFlag;
 #if (__APPLE__ || __unix)
 	#define TIMING_UNIX	1
 	#include <stdlib.h>
-	#include <sys/time.h>
 #else 
 	#define TIMING_WINDOWS	1
 	
@@ -32,10 +32,9 @@ void initTime()
 unsigned systemTime()
 {
 #if TIMING_UNIX
-	struct timeval tv;
-	gettimeofday(&tv, 0);
-
-	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	// monotonic, so frame durations never go backwards when the wall
+	// clock is adjusted.
+	return (unsigned)(cyclone::getTimeNanoseconds() / 1000000ULL);
 #else
 	if (qpcFlag)
 	{
@@ -67,10 +66,7 @@ unsigned long systemClock()
 unsigned long TimingData::getClock()
 {
 #if TIMING_UNIX
-	struct timeval tv;
-	gettimeofday(&tv, 0);
-
-	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	return (unsigned long)cyclone::getTimeNanoseconds();
 #else
 	return systemClock();
 #endif
@@ -96,6 +92,11 @@ void TimingData::update()
 	timingData->lastFrameDuration = thisTime - timingData->lastFrameTimestamp;
 	timingData->lastFrameTimestamp = thisTime;
 
+	unsigned long long thisNanoseconds = cyclone::getTimeNanoseconds();
+	timingData->lastFrameSeconds =
+		(thisNanoseconds - timingData->lastFrameNanoseconds) * 1e-9;
+	timingData->lastFrameNanoseconds = thisNanoseconds;
+
 	unsigned long thisClock = getClock();
 	timingData->lastFrameClockTicks = thisClock - timingData->lastFrameClockstamp;
 	timingData->lastFrameClockstamp = thisClock;
@@ -132,6 +133,9 @@ void TimingData::init()
 	timingData->lastFrameTimestamp = systemTime();
 	timingData->lastFrameDuration = 0;
 
+	timingData->lastFrameNanoseconds = cyclone::getTimeNanoseconds();
+	timingData->lastFrameSeconds = 0;
+
 	timingData->lastFrameClockstamp = getClock();
 	timingData->lastFrameClockTicks = 0;
 
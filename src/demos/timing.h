@@ -9,6 +9,11 @@ struct TimingData
 
 	unsigned lastFrameDuration;
 
+	/** Precise duration of the last frame, from the monotonic timer. */
+	double lastFrameSeconds;
+
+	unsigned long long lastFrameNanoseconds;
+
 	unsigned long lastFrameClockstamp;
 	
 	unsigned long lastFrameClockTicks;
@@ -0,0 +1,302 @@
+#include <math.h>
+#include <cyclone/ensemble.h>
+#include <cyclone/parallel.h>
+#include <cyclone/profile.h>
+#include <cyclone/random.h>
+
+using namespace cyclone;
+
+/** Worlds run together from launch to landing, small enough to stay in cache. */
+static const unsigned ensembleBatch = 256;
+
+/** Mixes the ensemble seed with a world's index into a seed of its own. */
+static unsigned worldSeed(unsigned seed, unsigned world)
+{
+    unsigned long long x = ((unsigned long long)seed << 32) ^ world;
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    unsigned s = (unsigned)(x ^ (x >> 32));
+    return s != 0 ? s : 1;
+}
+
+ProjectileEnsemble::Setup::Setup()
+    : position(0, 1.5f, 0),
+      minVelocity(0, 30, 40), maxVelocity(0, 30, 40),
+      minMass(1), maxMass(1),
+      minDamping(0.99f), maxDamping(0.99f),
+      acceleration(Vector3::GRAVITY),
+      k1(0), k2(0),
+      maxAge(5), maxRange(200)
+{
+}
+
+ProjectileEnsemble::ProjectileEnsemble()
+    : count(0)
+{
+}
+
+void ProjectileEnsemble::launch(const Setup &setup, unsigned count, unsigned seed)
+{
+    ProjectileEnsemble::setup = setup;
+    ProjectileEnsemble::count = count;
+
+    positionX.assign(count, setup.position.x);
+    positionY.assign(count, setup.position.y);
+    positionZ.assign(count, setup.position.z);
+    velocityX.resize(count);
+    velocityY.resize(count);
+    velocityZ.resize(count);
+    inverseMass.resize(count);
+    damping.resize(count);
+    age.assign(count, 0);
+    flying.assign(count, 1);
+    results.assign(count, FLYING);
+
+    parallelFor(0, count, ensembleBatch, [&](unsigned begin, unsigned end) {
+        Random random;
+        for (unsigned i = begin; i < end; i++)
+        {
+            random.seed(worldSeed(seed, i));
+            velocityX[i] = random.randomReal(setup.minVelocity.x, setup.maxVelocity.x);
+            velocityY[i] = random.randomReal(setup.minVelocity.y, setup.maxVelocity.y);
+            velocityZ[i] = random.randomReal(setup.minVelocity.z, setup.maxVelocity.z);
+            inverseMass[i] = (real)1 / random.randomReal(setup.minMass, setup.maxMass);
+            damping[i] = random.randomReal(setup.minDamping, setup.maxDamping);
+        }
+    });
+}
+
+void ProjectileEnsemble::setWorld(unsigned world, const Vector3 &velocity, real mass, real damping)
+{
+    positionX[world] = setup.position.x;
+    positionY[world] = setup.position.y;
+    positionZ[world] = setup.position.z;
+    velocityX[world] = velocity.x;
+    velocityY[world] = velocity.y;
+    velocityZ[world] = velocity.z;
+    inverseMass[world] = (real)1 / mass;
+    ProjectileEnsemble::damping[world] = damping;
+    age[world] = 0;
+    flying[world] = 1;
+    results[world] = FLYING;
+}
+
+unsigned ProjectileEnsemble::getWorldCount() const
+{
+    return count;
+}
+
+void ProjectileEnsemble::run(unsigned begin, unsigned end, real duration)
+{
+    const Vector3 acceleration = setup.acceleration;
+    const real k1 = setup.k1;
+    const real k2 = setup.k2;
+    const real maxAge = setup.maxAge;
+    const real maxRange = setup.maxRange;
+
+    // a batch is worked on in arrays of its own, which the compiler
+    // knows don't overlap, so it can vectorise the step without first
+    // checking every pair of arrays at run time.
+    real px[ensembleBatch], py[ensembleBatch], pz[ensembleBatch];
+    real vx[ensembleBatch], vy[ensembleBatch], vz[ensembleBatch];
+    real ages[ensembleBatch];
+    real invMass[ensembleBatch], drag[ensembleBatch];
+    real alive[ensembleBatch];
+    unsigned char result[ensembleBatch];
+
+    // the state each world ended in.
+    real ex[ensembleBatch], ey[ensembleBatch], ez[ensembleBatch];
+    real eu[ensembleBatch], ev[ensembleBatch], ew[ensembleBatch];
+    real endAge[ensembleBatch];
+
+    for (unsigned first = begin; first < end; first += ensembleBatch)
+    {
+        const unsigned size = first + ensembleBatch < end ? ensembleBatch : end - first;
+
+        unsigned running = 0;
+        for (unsigned i = 0; i < size; i++)
+        {
+            ex[i] = px[i] = positionX[first + i];
+            ey[i] = py[i] = positionY[first + i];
+            ez[i] = pz[i] = positionZ[first + i];
+            eu[i] = vx[i] = velocityX[first + i];
+            ev[i] = vy[i] = velocityY[first + i];
+            ew[i] = vz[i] = velocityZ[first + i];
+            endAge[i] = ages[i] = age[first + i];
+            invMass[i] = inverseMass[first + i];
+            alive[i] = flying[first + i];
+            result[i] = results[first + i];
+
+            // the drag of a step depends only on the world's damping.
+            drag[i] = real_pow(damping[first + i], duration);
+            running += alive[i] > 0;
+        }
+
+        // the last batch is filled out with worlds that have already
+        // ended, so every batch steps the same number of worlds.
+        for (unsigned i = size; i < ensembleBatch; i++)
+        {
+            ex[i] = px[i] = ey[i] = py[i] = ez[i] = pz[i] = 0;
+            eu[i] = vx[i] = ev[i] = vy[i] = ew[i] = vz[i] = 0;
+            endAge[i] = ages[i] = 0;
+            invMass[i] = drag[i] = 1;
+            alive[i] = 0;
+            result[i] = FLYING;
+        }
+
+        while (running > 0)
+        {
+            // every world takes the step, even those that have ended,
+            // and each world's state is copied aside on the step it ends.
+            // That leaves the loop with nothing to branch on, so it can
+            // be vectorised.
+            running = 0;
+            for (unsigned i = 0; i < ensembleBatch; i++)
+            {
+                // the drag force of ParticleDrag, k1 |v| + k2 |v|^2 against
+                // the velocity, with the normalising division cancelled out
+                // so there's no zero speed to guard against.
+                real speed = real_sqrt(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+                real coefficient = -(k1 + k2 * speed);
+                real fx = vx[i] * coefficient;
+                real fy = vy[i] * coefficient;
+                real fz = vz[i] * coefficient;
+
+                // and the step, as Particle::integrate takes it.
+                px[i] += vx[i] * duration;
+                py[i] += vy[i] * duration;
+                pz[i] += vz[i] * duration;
+                vx[i] = (vx[i] + (acceleration.x + fx * invMass[i]) * duration) * drag[i];
+                vy[i] = (vy[i] + (acceleration.y + fy * invMass[i]) * duration) * drag[i];
+                vz[i] = (vz[i] + (acceleration.z + fz * invMass[i]) * duration) * drag[i];
+                ages[i] += duration;
+
+                bool live = alive[i] > 0;
+                bool landed = py[i] < 0;
+                bool expired = ages[i] > maxAge;
+                bool escaped = pz[i] > maxRange;
+                bool ended = live & (landed | expired | escaped);
+
+                ex[i] = ended ? px[i] : ex[i];
+                ey[i] = ended ? py[i] : ey[i];
+                ez[i] = ended ? pz[i] : ez[i];
+                eu[i] = ended ? vx[i] : eu[i];
+                ev[i] = ended ? vy[i] : ev[i];
+                ew[i] = ended ? vz[i] : ew[i];
+                endAge[i] = ended ? ages[i] : endAge[i];
+
+                // a world's result is FLYING, zero, until the step it ends.
+                unsigned how = OUT_OF_RANGE - 2 * landed - (expired & !landed);
+                result[i] |= (unsigned char)(ended * how);
+                alive[i] = live & !ended;
+                running += live & !ended;
+            }
+        }
+
+        for (unsigned i = 0; i < size; i++)
+        {
+            positionX[first + i] = ex[i];
+            positionY[first + i] = ey[i];
+            positionZ[first + i] = ez[i];
+            velocityX[first + i] = eu[i];
+            velocityY[first + i] = ev[i];
+            velocityZ[first + i] = ew[i];
+            age[first + i] = endAge[i];
+            flying[first + i] = alive[i];
+            results[first + i] = result[i];
+        }
+    }
+}
+
+void ProjectileEnsemble::run(real duration)
+{
+    CYCLONE_PROFILE_SCOPE("integrate/ensemble");
+
+    if (count == 0 || duration <= 0) return;
+
+    parallelFor(0, count, ensembleBatch, [&](unsigned begin, unsigned end) {
+        run(begin, end, duration);
+    });
+}
+
+ProjectileEnsemble::Result ProjectileEnsemble::getResult(unsigned world) const
+{
+    return (Result)results[world];
+}
+
+Vector3 ProjectileEnsemble::getPosition(unsigned world) const
+{
+    return Vector3(positionX[world], positionY[world], positionZ[world]);
+}
+
+Vector3 ProjectileEnsemble::getVelocity(unsigned world) const
+{
+    return Vector3(velocityX[world], velocityY[world], velocityZ[world]);
+}
+
+real ProjectileEnsemble::getMass(unsigned world) const
+{
+    return (real)1 / inverseMass[world];
+}
+
+real ProjectileEnsemble::getDamping(unsigned world) const
+{
+    return damping[world];
+}
+
+real ProjectileEnsemble::getFlightTime(unsigned world) const
+{
+    return age[world];
+}
+
+void ProjectileEnsemble::getStats(Stats &stats, unsigned bins, real range) const
+{
+    stats.worlds = count;
+    stats.landed = stats.expired = stats.outOfRange = 0;
+    stats.minDistance = stats.maxDistance = stats.meanDistance = stats.deviation = 0;
+    stats.meanFlightTime = 0;
+    stats.histogram.assign(bins, 0);
+    stats.histogramRange = range;
+
+    // sums over many worlds are kept in double, so they don't drown in
+    // rounding.
+    double sum = 0, squares = 0, time = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        switch (results[i])
+        {
+        case LANDED: stats.landed++; break;
+        case EXPIRED: stats.expired++; continue;
+        case OUT_OF_RANGE: stats.outOfRange++; continue;
+        default: continue;
+        }
+
+        real dx = positionX[i] - setup.position.x;
+        real dz = positionZ[i] - setup.position.z;
+        real distance = real_sqrt(dx * dx + dz * dz);
+
+        if (stats.landed == 1 || distance < stats.minDistance) stats.minDistance = distance;
+        if (distance > stats.maxDistance) stats.maxDistance = distance;
+        sum += distance;
+        squares += (double)distance * distance;
+        time += age[i];
+
+        if (bins > 0 && range > 0)
+        {
+            unsigned bin = (unsigned)(distance / range * bins);
+            stats.histogram[bin < bins ? bin : bins - 1]++;
+        }
+    }
+
+    if (stats.landed > 0)
+    {
+        double mean = sum / stats.landed;
+        double variance = squares / stats.landed - mean * mean;
+        stats.meanDistance = (real)mean;
+        stats.deviation = (real)(variance > 0 ? sqrt(variance) : 0);
+        stats.meanFlightTime = (real)(time / stats.landed);
+    }
+}
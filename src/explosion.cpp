@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cyclone/explosion.h>
+#include <cyclone/profile.h>
+
+using namespace cyclone;
+
+ParticleExplosions::ParticleExplosions()
+    : grid(1)
+{
+}
+
+void ParticleExplosions::add(Particle *particle)
+{
+    particles.push_back(particle);
+}
+
+void ParticleExplosions::remove(Particle *particle)
+{
+    Particles::iterator i = std::find(particles.begin(), particles.end(), particle);
+    if (i != particles.end()) particles.erase(i);
+}
+
+void ParticleExplosions::remapParticles(const ParticleRemap &remap)
+{
+    if (particles.empty()) return;
+    particles.resize(remap.remapList(particles.data(), (unsigned)particles.size()));
+}
+
+void ParticleExplosions::clear()
+{
+    particles.clear();
+}
+
+void ParticleExplosions::addBlast(const Vector3 &centre, real radius, real strength, BlastType type)
+{
+    if (radius <= 0) return;
+
+    Blast blast = {centre, radius, strength, type};
+    blasts.push_back(blast);
+}
+
+unsigned ParticleExplosions::getPendingBlastCount() const
+{
+    return (unsigned)blasts.size();
+}
+
+void ParticleExplosions::push(const Blast &blast, unsigned index)
+{
+    Vector3 direction = positions[index] - blast.centre;
+    real distance = direction.magnitude();
+    if (distance <= 0) return;
+
+    direction *= blast.strength * (1 - distance / blast.radius) / distance;
+    if (blast.type == IMPULSE) impulses[index] += direction;
+    else forces[index] += direction;
+
+    if (!isTouched[index])
+    {
+        isTouched[index] = true;
+        touched.push_back(index);
+    }
+}
+
+unsigned ParticleExplosions::apply()
+{
+    CYCLONE_PROFILE_SCOPE("forces/explosions");
+
+    if (blasts.empty() || particles.empty())
+    {
+        blasts.clear();
+        return 0;
+    }
+
+    unsigned count = (unsigned)particles.size();
+    positions.resize(count);
+    impulses.assign(count, Vector3());
+    forces.assign(count, Vector3());
+    isTouched.assign(count, false);
+    touched.clear();
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        positions[i] = particles[i]->getPosition();
+    }
+
+    // cells sized for a typical blast keep most queries to a few cells,
+    // without one huge blast making every cell huge.
+    radii.clear();
+    for (Blasts::iterator b = blasts.begin(); b != blasts.end(); b++) radii.push_back(b->radius);
+    std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+    real cellSize = radii[radii.size() / 2];
+    grid.setCellSize(cellSize);
+    grid.build(&positions[0], count);
+
+    for (Blasts::iterator b = blasts.begin(); b != blasts.end(); b++)
+    {
+        const Blast &blast = *b;
+        // a blast spanning more cells than there are particles is
+        // cheaper to test against every particle.
+        real span = 2 * blast.radius / cellSize + 1;
+        if (span * span * span <= count)
+        {
+            grid.query(blast.centre, blast.radius, [&](unsigned index) { push(blast, index); });
+            continue;
+        }
+
+        real radius2 = blast.radius * blast.radius;
+        for (unsigned i = 0; i < count; i++)
+        {
+            if ((positions[i] - blast.centre).sqaureMagnitude() <= radius2) push(blast, i);
+        }
+    }
+
+    // every affected particle is written once, however many blasts hit it.
+    for (unsigned t = 0; t < touched.size(); t++)
+    {
+        unsigned index = touched[t];
+        Particle *particle = particles[index];
+
+        if (particle->hasFiniteMass())
+        {
+            Vector3 velocity = particle->getVelocity();
+            velocity.addScaledVector(impulses[index], particle->getInverseMass());
+            particle->setVelocity(velocity);
+        }
+        particle->addForce(forces[index]);
+    }
+
+    blasts.clear();
+    return (unsigned)touched.size();
+}
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <assert.h>
+#include <cyclone/forcefield.h>
+#include <cyclone/parallel.h>
+#include <cyclone/profile.h>
+
+using namespace cyclone;
+
+ForceField::ForceField(const Vector3 &origin, real cellSize,
+                       unsigned sizeX, unsigned sizeY, unsigned sizeZ,
+                       unsigned frameCount, real frameDuration)
+    : origin(origin), cellSize(cellSize), inverseCellSize(((real)1) / cellSize),
+      sizeX(sizeX), sizeY(sizeY), sizeZ(sizeZ), frameCount(frameCount),
+      frameDuration(frameDuration), time(0), mode(FORCE), drag(1)
+{
+    assert(sizeX >= 2 && sizeY >= 2 && sizeZ >= 2);
+    assert(frameCount >= 1 && frameDuration > 0);
+
+    values.resize(sizeX * sizeY * sizeZ * frameCount);
+}
+
+void ForceField::add(Particle *particle)
+{
+    particles.push_back(particle);
+}
+
+void ForceField::remove(Particle *particle)
+{
+    Particles::iterator i = std::find(particles.begin(), particles.end(), particle);
+    if (i != particles.end()) particles.erase(i);
+}
+
+void ForceField::remapParticles(const ParticleRemap &remap)
+{
+    if (particles.empty()) return;
+    particles.resize(remap.remapList(particles.data(), (unsigned)particles.size()));
+}
+
+void ForceField::clear()
+{
+    particles.clear();
+}
+
+void ForceField::setMode(Mode mode, real drag)
+{
+    ForceField::mode = mode;
+    ForceField::drag = drag;
+}
+
+void ForceField::setTime(real time)
+{
+    ForceField::time = time;
+}
+
+real ForceField::getTime() const
+{
+    return time;
+}
+
+Vector3 ForceField::getPoint(unsigned x, unsigned y, unsigned z) const
+{
+    return origin + Vector3(x * cellSize, y * cellSize, z * cellSize);
+}
+
+void ForceField::setValue(unsigned x, unsigned y, unsigned z, const Vector3 &value, unsigned frame)
+{
+    values[index(x, y, z, frame)] = value;
+}
+
+const Vector3& ForceField::getValue(unsigned x, unsigned y, unsigned z, unsigned frame) const
+{
+    return values[index(x, y, z, frame)];
+}
+
+void ForceField::sampleFrame(unsigned frame, const Vector3 *positions, Vector3 *results,
+                             unsigned count, real weight, bool accumulate) const
+{
+    const unsigned blockSize = 256;
+    unsigned cells[blockSize];
+    real tx[blockSize], ty[blockSize], tz[blockSize];
+
+    const real maxX = (real)(sizeX - 1), maxY = (real)(sizeY - 1), maxZ = (real)(sizeZ - 1);
+    const unsigned strideY = sizeX;
+    const unsigned strideZ = sizeX * sizeY;
+    const unsigned frameBase = frame * strideZ * sizeZ;
+
+    for (unsigned start = 0; start < count; start += blockSize)
+    {
+        unsigned n = count - start < blockSize ? count - start : blockSize;
+        const Vector3 *p = positions + start;
+
+        // first pass works out the cell and interpolation weights with
+        // straight line arithmetic only.
+        for (unsigned i = 0; i < n; i++)
+        {
+            real gx = (p[i].x - origin.x) * inverseCellSize;
+            real gy = (p[i].y - origin.y) * inverseCellSize;
+            real gz = (p[i].z - origin.z) * inverseCellSize;
+            gx = gx < 0 ? 0 : (gx > maxX ? maxX : gx);
+            gy = gy < 0 ? 0 : (gy > maxY ? maxY : gy);
+            gz = gz < 0 ? 0 : (gz > maxZ ? maxZ : gz);
+
+            unsigned ix = (unsigned)gx, iy = (unsigned)gy, iz = (unsigned)gz;
+            ix = ix < sizeX - 2 ? ix : sizeX - 2;
+            iy = iy < sizeY - 2 ? iy : sizeY - 2;
+            iz = iz < sizeZ - 2 ? iz : sizeZ - 2;
+
+            tx[i] = gx - ix;
+            ty[i] = gy - iy;
+            tz[i] = gz - iz;
+            cells[i] = frameBase + iz * strideZ + iy * strideY + ix;
+        }
+
+        // second pass gathers the eight corners and blends them.
+        for (unsigned i = 0; i < n; i++)
+        {
+            const Vector3 *c = &values[cells[i]];
+            real x = tx[i], y = ty[i], z = tz[i];
+
+            Vector3 c00 = c[0] + (c[1] - c[0]) * x;
+            Vector3 c10 = c[strideY] + (c[strideY + 1] - c[strideY]) * x;
+            Vector3 c01 = c[strideZ] + (c[strideZ + 1] - c[strideZ]) * x;
+            Vector3 c11 = c[strideZ + strideY] + (c[strideZ + strideY + 1] - c[strideZ + strideY]) * x;
+
+            Vector3 c0 = c00 + (c10 - c00) * y;
+            Vector3 c1 = c01 + (c11 - c01) * y;
+
+            Vector3 value = (c0 + (c1 - c0) * z) * weight;
+            if (accumulate) results[start + i] += value;
+            else results[start + i] = value;
+        }
+    }
+}
+
+void ForceField::sample(const Vector3 *positions, Vector3 *results, unsigned count) const
+{
+    unsigned frame = 0, next = 0;
+    real blend = 0;
+
+    if (frameCount > 1)
+    {
+        real t = time / frameDuration;
+        real whole = floor(t);
+        blend = t - whole;
+
+        // wrapped before converting, as a long run's frame number can
+        // be too big for an int.
+        real wrapped = fmod(whole, (real)frameCount);
+        if (wrapped < 0) wrapped += frameCount;
+        frame = (unsigned)wrapped;
+        if (frame >= frameCount) frame = 0;
+        next = (frame + 1) % frameCount;
+    }
+
+    parallelFor(0, count, 4096, [&](unsigned begin, unsigned end) {
+        sampleFrame(frame, positions + begin, results + begin, end - begin, 1 - blend, false);
+        if (blend > 0)
+        {
+            sampleFrame(next, positions + begin, results + begin, end - begin, blend, true);
+        }
+    });
+}
+
+void ForceField::updateForces(real duration)
+{
+    CYCLONE_PROFILE_SCOPE("forces/field");
+
+    unsigned count = (unsigned)particles.size();
+    positions.resize(count);
+    samples.resize(count);
+
+    if (count > 0)
+    {
+        for (unsigned i = 0; i < count; i++)
+        {
+            positions[i] = particles[i]->getPosition();
+        }
+
+        sample(&positions[0], &samples[0], count);
+
+        parallelFor(0, count, 4096, [&](unsigned begin, unsigned end) {
+            for (unsigned i = begin; i < end; i++)
+            {
+                Particle *particle = particles[i];
+                switch (mode)
+                {
+                case FORCE:
+                    particle->addForce(samples[i]);
+                    break;
+                case ACCELERATION:
+                    if (particle->hasFiniteMass())
+                    {
+                        particle->addForce(samples[i] * particle->getMass());
+                    }
+                    break;
+                case VELOCITY:
+                    particle->addForce((samples[i] - particle->getVelocity()) * drag);
+                    break;
+                }
+            }
+        });
+    }
+
+    time += duration;
+}
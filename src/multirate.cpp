@@ -0,0 +1,158 @@
+#include <cyclone/multirate.h>
+
+using namespace cyclone;
+
+const unsigned MultiRateScheduler::MAX_LEVELS;
+const unsigned char MultiRateScheduler::NO_BUCKET;
+
+MultiRateScheduler::MultiRateScheduler(unsigned levels, unsigned size)
+    : step(0)
+{
+    if (levels < 1) levels = 1;
+    if (levels > MAX_LEVELS) levels = MAX_LEVELS;
+    levelCount = levels;
+
+    Bucket empty = {0, 0, 1, 0, false};
+    buckets.assign((1u << levels) - 1, empty);
+
+    resize(size);
+}
+
+unsigned MultiRateScheduler::getLevelCount() const
+{
+    return levelCount;
+}
+
+void MultiRateScheduler::resize(unsigned size)
+{
+    for (unsigned i = size; i < bucketOf.size(); i++) remove(i);
+
+    bucketOf.resize(size, NO_BUCKET);
+    stamps.resize(size, 0);
+    offsets.resize(size, 0);
+    offsetSteps.resize(size, 0);
+}
+
+void MultiRateScheduler::add(unsigned index, unsigned level)
+{
+    remove(index);
+    if (level >= levelCount) level = levelCount - 1;
+
+    // the emptiest bucket of the level, or of those the one due soonest.
+    const unsigned period = 1u << level;
+    const unsigned first = period - 1;
+    unsigned best = 0;
+    unsigned bestWait = period;
+    for (unsigned phase = 0; phase < period; phase++)
+    {
+        unsigned wait = (phase + period - (step + 1) % period) % period;
+        const Bucket &bucket = buckets[first + phase];
+        const Bucket &chosen = buckets[first + best];
+        if (bucket.members < chosen.members || (bucket.members == chosen.members && wait < bestWait))
+        {
+            best = phase;
+            bestWait = wait;
+        }
+    }
+
+    Bucket &bucket = buckets[first + best];
+    bucket.members++;
+    bucketOf[index] = (unsigned char)(first + best);
+    stamps[index] = step;
+    offsets[index] = bucket.elapsed;
+    offsetSteps[index] = bucket.steps;
+}
+
+void MultiRateScheduler::remove(unsigned index)
+{
+    if (bucketOf[index] == NO_BUCKET) return;
+
+    buckets[bucketOf[index]].members--;
+    bucketOf[index] = NO_BUCKET;
+}
+
+bool MultiRateScheduler::isScheduled(unsigned index) const
+{
+    return bucketOf[index] != NO_BUCKET;
+}
+
+unsigned MultiRateScheduler::getLevel(unsigned index) const
+{
+    unsigned level = 0;
+    for (unsigned bucket = bucketOf[index] + 1u; bucket > 1; bucket >>= 1) level++;
+    return level;
+}
+
+void MultiRateScheduler::advance(real duration)
+{
+    step++;
+
+    for (unsigned level = 0; level < levelCount; level++)
+    {
+        const unsigned period = 1u << level;
+        for (unsigned phase = 0; phase < period; phase++)
+        {
+            Bucket &bucket = buckets[period - 1 + phase];
+            if (bucket.due)
+            {
+                bucket.elapsed = 0;
+                bucket.steps = 0;
+                bucket.start = step;
+            }
+
+            bucket.elapsed += duration;
+            bucket.steps++;
+            bucket.due = step % period == phase;
+        }
+    }
+}
+
+real MultiRateScheduler::take(unsigned index, unsigned *steps)
+{
+    const Bucket &bucket = buckets[bucketOf[index]];
+
+    // an offset from before the interval started has already been used.
+    bool current = stamps[index] >= bucket.start;
+    real duration = bucket.elapsed - (current ? offsets[index] : 0);
+    if (steps) *steps = bucket.steps - (current ? offsetSteps[index] : 0);
+
+    stamps[index] = step;
+    offsets[index] = bucket.elapsed;
+    offsetSteps[index] = bucket.steps;
+    return duration;
+}
+
+real MultiRateScheduler::integrate(unsigned index, Particle &particle)
+{
+    unsigned steps;
+    real duration = take(index, &steps);
+    if (duration <= 0) return 0;
+
+    if (steps > 1)
+    {
+        Vector3 force = particle.getAccumulatedForce();
+        particle.clearAccumulator();
+        particle.addForce(force * ((real)1 / (real)steps));
+    }
+
+    particle.integrate(duration);
+    return duration;
+}
+
+void MultiRateScheduler::integrate(Particle *particles)
+{
+    for (unsigned i = 0; i < bucketOf.size(); i++)
+    {
+        if (isDue(i)) integrate(i, particles[i]);
+    }
+}
+
+unsigned MultiRateScheduler::getScheduledCount(unsigned level) const
+{
+    if (level >= levelCount) return 0;
+
+    const unsigned period = 1u << level;
+    unsigned count = 0;
+    for (unsigned phase = 0; phase < period; phase++) count += buckets[period - 1 + phase].members;
+    return count;
+}
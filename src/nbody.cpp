@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cyclone/nbody.h>
+#include <cyclone/morton.h>
+#include <cyclone/parallel.h>
+#include <cyclone/profile.h>
+
+using namespace cyclone;
+
+ParticleNBodyGravity::ParticleNBodyGravity(real gravitationalConstant, real theta, real softening)
+    : gravitationalConstant(gravitationalConstant), softening(softening * softening), theta(theta), leafSize(8)
+{
+}
+
+void ParticleNBodyGravity::add(Particle *particle)
+{
+    particles.push_back(particle);
+}
+
+void ParticleNBodyGravity::remove(Particle *particle)
+{
+    Particles::iterator i = std::find(particles.begin(), particles.end(), particle);
+    if (i != particles.end()) particles.erase(i);
+}
+
+void ParticleNBodyGravity::remapParticles(const ParticleRemap &remap)
+{
+    if (particles.empty()) return;
+    particles.resize(remap.remapList(particles.data(), (unsigned)particles.size()));
+}
+
+void ParticleNBodyGravity::clear()
+{
+    particles.clear();
+    nodes.clear();
+}
+
+void ParticleNBodyGravity::setTheta(real theta)
+{
+    ParticleNBodyGravity::theta = theta;
+}
+
+void ParticleNBodyGravity::setSoftening(real softening)
+{
+    ParticleNBodyGravity::softening = softening * softening;
+}
+
+void ParticleNBodyGravity::setLeafSize(unsigned leafSize)
+{
+    ParticleNBodyGravity::leafSize = leafSize > 0 ? leafSize : 1;
+}
+
+void ParticleNBodyGravity::splitRange(unsigned begin, unsigned end, unsigned level, unsigned ranges[9]) const
+{
+    // the codes of a cell share every digit above this level, so the
+    // digit at this level is sorted within the range.
+    unsigned shift = 3 * (MORTON_BITS - 1 - level);
+
+    ranges[0] = begin;
+    for (unsigned digit = 1; digit < 8; digit++)
+    {
+        unsigned lo = ranges[digit - 1], hi = end;
+        while (lo < hi)
+        {
+            unsigned mid = (lo + hi) / 2;
+            if (((codes[mid] >> shift) & 7) < digit) lo = mid + 1;
+            else hi = mid;
+        }
+        ranges[digit] = lo;
+    }
+    ranges[8] = end;
+}
+
+int ParticleNBodyGravity::buildNode(std::vector<Node> &out, unsigned begin, unsigned end,
+                                    unsigned level, real size) const
+{
+    Node node;
+    node.mass = 0;
+    node.size = size;
+    node.begin = begin;
+    node.end = end;
+    node.leaf = (end - begin <= leafSize) || (level >= MORTON_BITS);
+    for (unsigned i = 0; i < 8; i++) node.children[i] = -1;
+
+    int index = (int)out.size();
+    out.push_back(node);
+
+    Vector3 weighted;
+    if (node.leaf)
+    {
+        for (unsigned i = begin; i < end; i++)
+        {
+            weighted.addScaledVector(positions[i], masses[i]);
+            node.mass += masses[i];
+        }
+    }
+    else
+    {
+        unsigned ranges[9];
+        splitRange(begin, end, level, ranges);
+
+        for (unsigned digit = 0; digit < 8; digit++)
+        {
+            if (ranges[digit] == ranges[digit + 1]) continue;
+
+            int child = buildNode(out, ranges[digit], ranges[digit + 1], level + 1, size * 0.5f);
+            node.children[digit] = child;
+            weighted.addScaledVector(out[child].centreOfMass, out[child].mass);
+            node.mass += out[child].mass;
+        }
+    }
+
+    if (node.mass > 0) node.centreOfMass = weighted * (((real)1) / node.mass);
+
+    out[index] = node;
+    return index;
+}
+
+void ParticleNBodyGravity::build()
+{
+    CYCLONE_PROFILE_SCOPE("forces/nbody-build");
+
+    nodes.clear();
+
+    // only particles with finite mass attract or are attracted.
+    std::vector<unsigned> active;
+    active.reserve(particles.size());
+    for (unsigned i = 0; i < particles.size(); i++)
+    {
+        if (particles[i]->hasFiniteMass()) active.push_back(i);
+    }
+
+    unsigned count = (unsigned)active.size();
+    codes.resize(count);
+    order.resize(count);
+    positions.resize(count);
+    masses.resize(count);
+    if (count == 0) return;
+
+    // bounding cube of all the positions.
+    Vector3 min = particles[active[0]]->getPosition();
+    Vector3 max = min;
+    for (unsigned i = 1; i < count; i++)
+    {
+        Vector3 p = particles[active[i]]->getPosition();
+        if (p.x < min.x) min.x = p.x;
+        if (p.y < min.y) min.y = p.y;
+        if (p.z < min.z) min.z = p.z;
+        if (p.x > max.x) max.x = p.x;
+        if (p.y > max.y) max.y = p.y;
+        if (p.z > max.z) max.z = p.z;
+    }
+
+    real size = max.x - min.x;
+    if (max.y - min.y > size) size = max.y - min.y;
+    if (max.z - min.z > size) size = max.z - min.z;
+    size = size * 1.001f + 1e-6f;
+
+    real scale = (real)(1u << MORTON_BITS) / size;
+
+    std::vector<std::pair<unsigned long long, unsigned> > keys(count);
+    parallelFor(0, count, 4096, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++)
+        {
+            keys[i].first = mortonCode(particles[active[i]]->getPosition(), min, scale);
+            keys[i].second = active[i];
+        }
+    });
+
+    std::sort(keys.begin(), keys.end());
+
+    parallelFor(0, count, 4096, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++)
+        {
+            Particle *particle = particles[keys[i].second];
+            codes[i] = keys[i].first;
+            order[i] = keys[i].second;
+            positions[i] = particle->getPosition();
+            masses[i] = particle->getMass();
+        }
+    });
+
+    if (count <= leafSize)
+    {
+        buildNode(nodes, 0, count, 0, size);
+        return;
+    }
+
+    // the eight octants of the root are built in parallel and then
+    // appended behind the root.
+    unsigned ranges[9];
+    splitRange(0, count, 0, ranges);
+
+    std::vector<Node> subtrees[8];
+    parallelFor(0, 8, 1, [&](unsigned begin, unsigned end) {
+        for (unsigned digit = begin; digit < end; digit++)
+        {
+            if (ranges[digit] == ranges[digit + 1]) continue;
+            buildNode(subtrees[digit], ranges[digit], ranges[digit + 1], 1, size * 0.5f);
+        }
+    });
+
+    Node root;
+    root.mass = 0;
+    root.size = size;
+    root.begin = 0;
+    root.end = count;
+    root.leaf = false;
+    nodes.push_back(root);
+
+    Vector3 weighted;
+    for (unsigned digit = 0; digit < 8; digit++)
+    {
+        nodes[0].children[digit] = -1;
+        if (subtrees[digit].empty()) continue;
+
+        int offset = (int)nodes.size();
+        for (unsigned i = 0; i < subtrees[digit].size(); i++)
+        {
+            Node node = subtrees[digit][i];
+            for (unsigned c = 0; c < 8; c++)
+            {
+                if (node.children[c] >= 0) node.children[c] += offset;
+            }
+            nodes.push_back(node);
+        }
+
+        nodes[0].children[digit] = offset;
+        weighted.addScaledVector(nodes[offset].centreOfMass, nodes[offset].mass);
+        nodes[0].mass += nodes[offset].mass;
+    }
+
+    if (nodes[0].mass > 0) nodes[0].centreOfMass = weighted * (((real)1) / nodes[0].mass);
+}
+
+Vector3 ParticleNBodyGravity::treeAcceleration(unsigned index) const
+{
+    Vector3 acceleration;
+    if (nodes.empty()) return acceleration;
+
+    const Vector3 &position = positions[index];
+    real theta2 = theta * theta;
+
+    int stack[8 * (MORTON_BITS + 1)];
+    unsigned top = 0;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        const Node &node = nodes[stack[--top]];
+
+        if (node.leaf)
+        {
+            for (unsigned i = node.begin; i < node.end; i++)
+            {
+                if (i == index) continue;
+
+                Vector3 d = positions[i] - position;
+                real r2 = d.sqaureMagnitude() + softening;
+                acceleration.addScaledVector(d, gravitationalConstant * masses[i] / (r2 * real_sqrt(r2)));
+            }
+            continue;
+        }
+
+        Vector3 d = node.centreOfMass - position;
+        real distance2 = d.sqaureMagnitude();
+        bool contains = index >= node.begin && index < node.end;
+
+        if (!contains && node.size * node.size < theta2 * distance2)
+        {
+            // far enough away to treat the cell as a single mass.
+            real r2 = distance2 + softening;
+            acceleration.addScaledVector(d, gravitationalConstant * node.mass / (r2 * real_sqrt(r2)));
+            continue;
+        }
+
+        for (unsigned c = 0; c < 8; c++)
+        {
+            if (node.children[c] >= 0) stack[top++] = node.children[c];
+        }
+    }
+
+    return acceleration;
+}
+
+Vector3 ParticleNBodyGravity::directAcceleration(unsigned index) const
+{
+    Vector3 acceleration;
+    const Vector3 &position = positions[index];
+
+    for (unsigned i = 0; i < positions.size(); i++)
+    {
+        if (i == index) continue;
+
+        Vector3 d = positions[i] - position;
+        real r2 = d.sqaureMagnitude() + softening;
+        acceleration.addScaledVector(d, gravitationalConstant * masses[i] / (r2 * real_sqrt(r2)));
+    }
+
+    return acceleration;
+}
+
+void ParticleNBodyGravity::updateForces(real)
+{
+    build();
+
+    CYCLONE_PROFILE_SCOPE("forces/nbody");
+
+    // each sorted entry is a distinct particle, so the accumulators can be
+    // written from several threads at once.
+    parallelFor(0, (unsigned)positions.size(), 256, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++)
+        {
+            particles[order[i]]->addForce(treeAcceleration(i) * masses[i]);
+        }
+    });
+}
+
+ParticleNBodyGravity::Accuracy ParticleNBodyGravity::measureAccuracy(unsigned sampleCount) const
+{
+    Accuracy accuracy;
+    accuracy.maxRelativeError = 0;
+    accuracy.rmsRelativeError = 0;
+    accuracy.samples = 0;
+
+    unsigned count = (unsigned)positions.size();
+    if (count == 0 || nodes.empty()) return accuracy;
+    if (sampleCount == 0 || sampleCount > count) sampleCount = count;
+
+    std::vector<real> errors(sampleCount, 0);
+    parallelFor(0, sampleCount, 16, [&](unsigned begin, unsigned end) {
+        for (unsigned s = begin; s < end; s++)
+        {
+            unsigned index = (unsigned)((unsigned long long)s * count / sampleCount);
+
+            Vector3 exact = directAcceleration(index);
+            real magnitude = exact.magnitude();
+            if (magnitude <= 0) continue;
+
+            errors[s] = (treeAcceleration(index) - exact).magnitude() / magnitude;
+        }
+    });
+
+    double sum = 0;
+    for (unsigned s = 0; s < sampleCount; s++)
+    {
+        if (errors[s] > accuracy.maxRelativeError) accuracy.maxRelativeError = errors[s];
+        sum += (double)errors[s] * errors[s];
+    }
+
+    accuracy.samples = sampleCount;
+    accuracy.rmsRelativeError = (real)sqrt(sum / sampleCount);
+    return accuracy;
+}
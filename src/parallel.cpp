@@ -0,0 +1,20 @@
+#include <cyclone/parallel.h>
+
+using namespace cyclone;
+
+static unsigned workerCount = 0;
+
+unsigned cyclone::getWorkerCount()
+{
+    if (workerCount == 0)
+    {
+        workerCount = std::thread::hardware_concurrency();
+        if (workerCount == 0) workerCount = 1;
+    }
+    return workerCount;
+}
+
+void cyclone::setWorkerCount(unsigned count)
+{
+    workerCount = count;
+}
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <algorithm>
+#include <functional>
 #include <cyclone/particle.h>
 
 using namespace cyclone;
@@ -16,6 +18,7 @@ void Particle::integrate(real duration)
 
     // calculate acceleratino from force.
     Vector3 resultingAcceleration = acceleration;
+    resultingAcceleration.addScaledVector(forceAccum, inverseMass);
     // update linear velocity from acceleration.
     velocity.addScaledVector(resultingAcceleration, duration);
 
@@ -135,4 +138,22 @@ void Particle::clearAccumulator()
 void Particle::addForce(const Vector3 &force) 
 {
     forceAccum += force;
-} 
\ No newline at end of file
+}
+
+Vector3 Particle::getAccumulatedForce() const
+{
+    return forceAccum;
+}
+
+unsigned ParticleRemap::remapList(Particle **list, unsigned length) const
+{
+    unsigned kept = 0;
+    for (unsigned i = 0; i < length; i++)
+    {
+        Particle *particle = (*this)(list[i]);
+        if (particle) list[kept++] = particle;
+    }
+
+    std::sort(list, list + kept, std::less<Particle*>());
+    return kept;
+}
@@ -0,0 +1,283 @@
+#include <assert.h>
+#include <cyclone/pbd.h>
+#include <cyclone/profile.h>
+
+using namespace cyclone;
+
+ParticleDistanceConstraint::ParticleDistanceConstraint(unsigned a, unsigned b, real restLength, real stiffness)
+    : a(a), b(b), restLength(restLength), stiffness(stiffness)
+{
+}
+
+void ParticleDistanceConstraint::project(ParticleConstraintSolver *solver)
+{
+    real wa = solver->getInverseMass(a);
+    real wb = solver->getInverseMass(b);
+    real w = wa + wb;
+    if (w <= 0) return;
+
+    Vector3 delta = solver->getPredicted(a) - solver->getPredicted(b);
+    real length = delta.magnitude();
+    if (length <= 0) return;
+
+    // C = |pa - pb| - restLength, moved along the gradient weighted by
+    // inverse mass.
+    delta *= stiffness * (length - restLength) / (length * w);
+
+    solver->correct(a, delta * -wa);
+    solver->correct(b, delta * wb);
+}
+
+ParticleBendingConstraint::ParticleBendingConstraint(const ParticleConstraintSolver &solver,
+                                                     unsigned b0, unsigned v, unsigned b1, real stiffness)
+    : b0(b0), v(v), b1(b1), stiffness(stiffness)
+{
+    Vector3 centre = (solver.getPredicted(b0) + solver.getPredicted(v) + solver.getPredicted(b1)) * ((real)1 / 3);
+    restDistance = (solver.getPredicted(v) - centre).magnitude();
+}
+
+void ParticleBendingConstraint::project(ParticleConstraintSolver *solver)
+{
+    real w0 = solver->getInverseMass(b0);
+    real wv = solver->getInverseMass(v);
+    real w1 = solver->getInverseMass(b1);
+    real w = w0 + w1 + 2 * wv;
+    if (w <= 0) return;
+
+    Vector3 centre = (solver->getPredicted(b0) + solver->getPredicted(v) + solver->getPredicted(b1)) * ((real)1 / 3);
+    Vector3 offset = solver->getPredicted(v) - centre;
+    real distance = offset.magnitude();
+    if (distance <= 0) return;
+
+    // triangle bending constraint: C = |v - c| - restDistance.
+    offset *= stiffness * (1 - restDistance / distance);
+
+    solver->correct(b0, offset * (2 * w0 / w));
+    solver->correct(b1, offset * (2 * w1 / w));
+    solver->correct(v, offset * (-4 * wv / w));
+}
+
+ParticlePlaneConstraint::ParticlePlaneConstraint(const Vector3 &normal, real offset, real radius)
+    : normal(normal), offset(offset), radius(radius)
+{
+}
+
+void ParticlePlaneConstraint::project(ParticleConstraintSolver *solver)
+{
+    for (unsigned i = 0; i < solver->getParticleCount(); i++)
+    {
+        if (solver->getInverseMass(i) <= 0) continue;
+
+        real depth = solver->getPredicted(i) * normal - offset - radius;
+        if (depth >= 0) continue;
+
+        solver->correct(i, normal * -depth);
+    }
+}
+
+ParticleCollisionConstraint::ParticleCollisionConstraint(unsigned a, unsigned b, real minDistance)
+    : a(a), b(b), minDistance(minDistance)
+{
+}
+
+void ParticleCollisionConstraint::project(ParticleConstraintSolver *solver)
+{
+    real wa = solver->getInverseMass(a);
+    real wb = solver->getInverseMass(b);
+    real w = wa + wb;
+    if (w <= 0) return;
+
+    Vector3 delta = solver->getPredicted(a) - solver->getPredicted(b);
+    real length = delta.magnitude();
+
+    // only push apart, never pull together.
+    if (length >= minDistance || length <= 0) return;
+
+    delta *= (length - minDistance) / (length * w);
+
+    solver->correct(a, delta * -wa);
+    solver->correct(b, delta * wb);
+}
+
+ParticleConstraintSolver::ParticleConstraintSolver(unsigned iterations, Mode mode)
+    : iterations(iterations), mode(mode), relaxation(1.5f)
+{
+}
+
+unsigned ParticleConstraintSolver::addParticle(Particle *particle)
+{
+    particles.push_back(particle);
+    previous.push_back(particle->getPosition());
+    predicted.push_back(particle->getPosition());
+    deltas.push_back(Vector3());
+    deltaCounts.push_back(0);
+
+    return (unsigned)particles.size() - 1;
+}
+
+void ParticleConstraintSolver::remapParticles(const ParticleRemap &remap)
+{
+    for (unsigned i = 0; i < particles.size(); i++)
+    {
+        Particle *particle = remap(particles[i]);
+        if (particle) particles[i] = particle;
+    }
+}
+
+void ParticleConstraintSolver::addConstraint(ParticleConstraint *constraint)
+{
+    constraints.push_back(constraint);
+}
+
+void ParticleConstraintSolver::clear()
+{
+    particles.clear();
+    constraints.clear();
+    previous.clear();
+    predicted.clear();
+    deltas.clear();
+    deltaCounts.clear();
+}
+
+unsigned ParticleConstraintSolver::getParticleCount() const
+{
+    return (unsigned)particles.size();
+}
+
+void ParticleConstraintSolver::setIterations(unsigned iterations)
+{
+    ParticleConstraintSolver::iterations = iterations;
+}
+
+void ParticleConstraintSolver::setMode(Mode mode)
+{
+    ParticleConstraintSolver::mode = mode;
+}
+
+void ParticleConstraintSolver::setRelaxation(real relaxation)
+{
+    ParticleConstraintSolver::relaxation = relaxation;
+}
+
+const Vector3& ParticleConstraintSolver::getPredicted(unsigned index) const
+{
+    return predicted[index];
+}
+
+real ParticleConstraintSolver::getInverseMass(unsigned index) const
+{
+    return particles[index]->getInverseMass();
+}
+
+void ParticleConstraintSolver::correct(unsigned index, const Vector3 &delta)
+{
+    if (mode == GAUSS_SEIDEL)
+    {
+        predicted[index] += delta;
+    }
+    else
+    {
+        deltas[index] += delta;
+        deltaCounts[index]++;
+    }
+}
+
+void ParticleConstraintSolver::predict(real duration)
+{
+    for (unsigned i = 0; i < particles.size(); i++)
+    {
+        Particle *particle = particles[i];
+        previous[i] = particle->getPosition();
+        predicted[i] = previous[i];
+
+        if (!particle->hasFiniteMass()) continue;
+
+        // same acceleration as Particle::integrate, but the velocity is
+        // updated first so gravity shows up in the predicted position.
+        Vector3 acceleration = particle->getAcceleration();
+        acceleration.addScaledVector(particle->getAccumulatedForce(), particle->getInverseMass());
+
+        Vector3 velocity = particle->getVelocity();
+        velocity.addScaledVector(acceleration, duration);
+        velocity *= real_pow(particle->getDamping(), duration);
+
+        predicted[i].addScaledVector(velocity, duration);
+    }
+}
+
+void ParticleConstraintSolver::applyDeltas()
+{
+    for (unsigned i = 0; i < particles.size(); i++)
+    {
+        if (deltaCounts[i] == 0) continue;
+
+        predicted[i].addScaledVector(deltas[i], relaxation / (real)deltaCounts[i]);
+        deltas[i].clear();
+        deltaCounts[i] = 0;
+    }
+}
+
+void ParticleConstraintSolver::solve(real duration)
+{
+    assert(duration > 0.0);
+
+    {
+        CYCLONE_PROFILE_SCOPE("integrate/pbd");
+        predict(duration);
+    }
+
+    {
+        CYCLONE_PROFILE_SCOPE("collision/pbd");
+        for (unsigned iteration = 0; iteration < iterations; iteration++)
+        {
+            Constraints::iterator c = constraints.begin();
+            for (; c != constraints.end(); c++)
+            {
+                (*c)->project(this);
+            }
+
+            if (mode == JACOBI) applyDeltas();
+        }
+    }
+
+    // derive velocities from the change in position.
+    CYCLONE_PROFILE_SCOPE("integrate/pbd-velocity");
+    real inverseDuration = ((real)1) / duration;
+    for (unsigned i = 0; i < particles.size(); i++)
+    {
+        Particle *particle = particles[i];
+        if (!particle->hasFiniteMass()) continue;
+
+        particle->setVelocity((predicted[i] - previous[i]) * inverseDuration);
+        particle->setPosition(predicted[i]);
+    }
+}
+
+void ParticleConstraintSolver::clearAccumulators()
+{
+    Particles::iterator p = particles.begin();
+    for (; p != particles.end(); p++)
+    {
+        (*p)->clearAccumulator();
+    }
+}
+
+void ParticleConstraintSolver::step(real duration)
+{
+    solve(duration);
+    clearAccumulators();
+}
+
+void ParticleConstraintSolver::runPhysics(real duration, unsigned substeps)
+{
+    if (substeps == 0) substeps = 1;
+
+    // forces accumulated for the frame act over every substep.
+    real substep = duration / (real)substeps;
+    for (unsigned i = 0; i < substeps; i++)
+    {
+        solve(substep);
+    }
+
+    clearAccumulators();
+}
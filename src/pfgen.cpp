@@ -1,14 +1,100 @@
 #include <cyclone/pfgen.h>
+#include <cyclone/parallel.h>
+#include <cyclone/profile.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#if defined(CYCLONE_PROFILE) && defined(__GNUG__)
+    #include <cxxabi.h>
+#endif
 
 using namespace cyclone;
 
+/** Registrations of a colour each thread takes at a time. */
+static const unsigned colourGrain = 1024;
+
+/** Blocks that deterministic buffered accumulation always splits into. */
+static const unsigned deterministicBlocks = 8;
+
+/** Particles each thread sums the buffers of at a time. */
+static const unsigned reduceGrain = 4096;
+
+#ifdef CYCLONE_PROFILE
+/**
+ * Works out what one reading of the clock costs, as the median of many
+ * back to back readings.
+ */
+static unsigned long long measureClockCost()
+{
+    std::vector<unsigned long long> samples(255);
+    for (unsigned i = 0; i < samples.size(); i++)
+    {
+        unsigned long long start = getTimeNanoseconds();
+        samples[i] = getTimeNanoseconds() - start;
+    }
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+
+/** Cost of reading the clock, measured once and taken off every timed run. */
+static unsigned long long getClockCost()
+{
+    static const unsigned long long cost = measureClockCost();
+    return cost;
+}
+#endif
+
+ParticleForceRegistry::ParticleForceRegistry(const char *name)
+    : name(name), accumulation(SERIAL), deterministic(false), prepared(false), colourDuration(0)
+{
+}
+
 void ParticleForceRegistry::updateForces(real duration)
 {
-    Registry::iterator i = registrations.begin();
+    CYCLONE_PROFILE_SCOPE("forces/registry");
 
-    for (; i != registrations.end(); i++)
+    // on one thread the colours add up just as the serial loop does.
+    bool threaded = getWorkerCount() > 1;
+    if (accumulation == BUFFERED && (threaded || deterministic))
     {
-        i->fg->updateForce(i->particle, duration);
+        updateForcesBuffered(duration);
+        return;
+    }
+
+    if (accumulation == COLOURED && threaded) updateForcesColoured(duration);
+    else applyForces(NULL, getRegistrationCount(), duration);
+}
+
+void ParticleForceRegistry::updateForces(const unsigned *indices, unsigned count, real duration)
+{
+    applyForces(indices, count, duration);
+}
+
+void ParticleForceRegistry::applyForces(const unsigned *indices, unsigned count, real duration)
+{
+#ifdef CYCLONE_PROFILE
+    if (Profiler::isEnabled())
+    {
+        updateForcesMeasured(indices, count, duration);
+        return;
+    }
+#endif
+
+    if (indices == NULL)
+    {
+        Registry::iterator i = registrations.begin();
+
+        for (; i != registrations.end(); i++)
+        {
+            i->fg->updateForce(i->particle, duration);
+        }
+        return;
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        const ParticleForceRegistration &registration = registrations[indices[i]];
+        registration.fg->updateForce(registration.particle, duration);
     }
 }
 
@@ -17,6 +103,371 @@ void ParticleForceRegistry::add(Particle *particle, ParticleForceGenerator *fg)
     ParticleForceRegistration registration = {particle, fg};
 
     registrations.push_back(registration);
+    prepared = false;
+}
+
+void ParticleForceRegistry::remove(Particle *particle, ParticleForceGenerator *fg)
+{
+    Registry::iterator i = registrations.begin();
+
+    for (; i != registrations.end(); i++)
+    {
+        if (i->particle == particle && i->fg == fg)
+        {
+            registrations.erase(i);
+            prepared = false;
+            return;
+        }
+    }
+}
+
+void ParticleForceRegistry::clear()
+{
+    registrations.clear();
+    prepared = false;
+}
+
+void ParticleForceRegistry::setAccumulation(Accumulation accumulation)
+{
+    ParticleForceRegistry::accumulation = accumulation;
+}
+
+ParticleForceRegistry::Accumulation ParticleForceRegistry::getAccumulation() const
+{
+    return accumulation;
+}
+
+void ParticleForceRegistry::setDeterministic(bool deterministic)
+{
+    ParticleForceRegistry::deterministic = deterministic;
+}
+
+bool ParticleForceRegistry::isDeterministic() const
+{
+    return deterministic;
+}
+
+unsigned ParticleForceRegistry::getColourCount()
+{
+    prepare();
+    return (unsigned)colourStarts.size() - 1;
+}
+
+void ParticleForceRegistry::prepare()
+{
+    if (prepared) return;
+
+    particles.clear();
+    particles.reserve(registrations.size());
+    for (unsigned i = 0; i < registrations.size(); i++) particles.push_back(registrations[i].particle);
+    std::sort(particles.begin(), particles.end(), std::less<Particle*>());
+    particles.erase(std::unique(particles.begin(), particles.end()), particles.end());
+
+    particleSlots.resize(registrations.size());
+    for (unsigned i = 0; i < registrations.size(); i++)
+    {
+        particleSlots[i] = (unsigned)(std::lower_bound(particles.begin(), particles.end(),
+                                                       registrations[i].particle, std::less<Particle*>()) -
+                                      particles.begin());
+    }
+
+    // a particle's n-th registration goes in the n-th colour, so no
+    // colour pushes a particle twice.
+    std::vector<unsigned> colours(registrations.size());
+    std::vector<unsigned> seen(particles.size(), 0);
+    unsigned colourCount = 0;
+    for (unsigned i = 0; i < registrations.size(); i++)
+    {
+        colours[i] = seen[particleSlots[i]]++;
+        if (colours[i] >= colourCount) colourCount = colours[i] + 1;
+    }
+
+    // each colour keeps its registrations in order.
+    colourStarts.assign(colourCount + 1, 0);
+    for (unsigned i = 0; i < registrations.size(); i++) colourStarts[colours[i] + 1]++;
+    for (unsigned c = 0; c < colourCount; c++) colourStarts[c + 1] += colourStarts[c];
+
+    std::vector<unsigned> next(colourStarts.begin(), colourStarts.end() - 1);
+    colourIndices.resize(registrations.size());
+    for (unsigned i = 0; i < registrations.size(); i++) colourIndices[next[colours[i]]++] = i;
+
+    colourGraph.clear();
+    for (unsigned c = 0; c < colourCount; c++)
+    {
+        unsigned task = colourGraph.addTask("forces/colour", colourStarts[c], colourStarts[c + 1], colourGrain,
+                                            [this](unsigned begin, unsigned end) {
+            applyForces(colourIndices.data() + begin, end - begin, colourDuration);
+        });
+        if (c > 0) colourGraph.addDependency(task - 1, task);
+    }
+
+#ifdef CYCLONE_PROFILE
+    // the stats' view of the registrations: each one's generator type,
+    // and whether it is the first of that type on its particle.
+    types.clear();
+    typeSlots.resize(registrations.size());
+    for (unsigned i = 0; i < registrations.size(); i++)
+    {
+        const std::type_info &type = typeid(*registrations[i].fg);
+        unsigned slot = 0;
+        while (slot < types.size() && *types[slot] != type) slot++;
+        if (slot == types.size()) types.push_back(&type);
+        typeSlots[i] = slot;
+    }
+
+    std::vector<unsigned char> typed(particles.size() * types.size(), 0);
+    countsParticle.resize(registrations.size());
+    for (unsigned i = 0; i < registrations.size(); i++)
+    {
+        unsigned char &pair = typed[(size_t)particleSlots[i] * types.size() + typeSlots[i]];
+        countsParticle[i] = pair ? 0 : 1;
+        pair = 1;
+    }
+#endif
+
+    prepared = true;
+}
+
+void ParticleForceRegistry::updateForcesColoured(real duration)
+{
+    prepare();
+
+    colourDuration = duration;
+    colourGraph.run();
+}
+
+void ParticleForceRegistry::updateForcesBuffered(real duration)
+{
+    prepare();
+
+    const unsigned count = (unsigned)particles.size();
+    const unsigned total = (unsigned)registrations.size();
+    unsigned blocks = deterministic ? deterministicBlocks : getWorkerCount();
+    if (blocks > total) blocks = total;
+    if (blocks == 0) return;
+
+    buffers.resize((size_t)blocks * 3 * count);
+
+    parallelFor(0, blocks, 1, [&](unsigned first, unsigned last) {
+        Particle scratch;
+        for (unsigned block = first; block < last; block++)
+        {
+            real *x = &buffers[(size_t)block * 3 * count];
+            real *y = x + count;
+            real *z = y + count;
+            for (unsigned p = 0; p < 3 * count; p++) x[p] = 0;
+
+            unsigned begin = (unsigned)((unsigned long long)total * block / blocks);
+            unsigned end = (unsigned)((unsigned long long)total * (block + 1) / blocks);
+            for (unsigned i = begin; i < end; i++)
+            {
+                // the generator pushes a copy of the particle, and the
+                // force it gets goes into the block's buffer.
+                const ParticleForceRegistration &registration = registrations[i];
+                scratch = *registration.particle;
+                scratch.clearAccumulator();
+                registration.fg->updateForce(&scratch, duration);
+
+                Vector3 force = scratch.getAccumulatedForce();
+                unsigned slot = particleSlots[i];
+                x[slot] += force.x;
+                y[slot] += force.y;
+                z[slot] += force.z;
+            }
+        }
+    });
+
+    // the other blocks are added into the first in block order, a run
+    // of particles at a time, in loops the compiler can vectorise.
+    real *sum = buffers.data();
+    parallelFor(0, count, reduceGrain, [&](unsigned begin, unsigned end) {
+        for (unsigned block = 1; block < blocks; block++)
+        {
+            for (unsigned axis = 0; axis < 3; axis++)
+            {
+                real *to = sum + (size_t)axis * count;
+                const real *from = sum + ((size_t)block * 3 + axis) * count;
+                for (unsigned p = begin; p < end; p++) to[p] += from[p];
+            }
+        }
+
+        for (unsigned p = begin; p < end; p++)
+        {
+            particles[p]->addForce(Vector3(sum[p], sum[count + p], sum[2 * count + p]));
+        }
+    });
+}
+
+unsigned ParticleForceRegistry::getRegistrationCount() const
+{
+    return (unsigned)registrations.size();
+}
+
+Particle* ParticleForceRegistry::getParticle(unsigned index) const
+{
+    return registrations[index].particle;
+}
+
+ParticleForceGenerator* ParticleForceRegistry::getForceGenerator(unsigned index) const
+{
+    return registrations[index].fg;
+}
+
+void ParticleForceRegistry::remapParticles(const ParticleRemap &remap, bool generators)
+{
+    unsigned kept = 0;
+    for (unsigned i = 0; i < registrations.size(); i++)
+    {
+        Particle *particle = remap(registrations[i].particle);
+        if (particle == NULL) continue;
+
+        registrations[kept] = registrations[i];
+        registrations[kept].particle = particle;
+        kept++;
+    }
+    registrations.resize(kept);
+    prepared = false;
+
+    if (!generators) return;
+
+    std::vector<ParticleForceGenerator*> unique;
+    unique.reserve(registrations.size());
+    for (unsigned i = 0; i < registrations.size(); i++) unique.push_back(registrations[i].fg);
+    std::sort(unique.begin(), unique.end(), std::less<ParticleForceGenerator*>());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+    std::vector<ParticleForceGenerator*> lost;
+    for (unsigned i = 0; i < unique.size(); i++)
+    {
+        if (!unique[i]->remapParticles(remap)) lost.push_back(unique[i]);
+    }
+    if (lost.empty()) return;
+
+    // a spring whose other end has gone has nothing left to pull on.
+    kept = 0;
+    for (unsigned i = 0; i < registrations.size(); i++)
+    {
+        if (std::binary_search(lost.begin(), lost.end(), registrations[i].fg, std::less<ParticleForceGenerator*>())) continue;
+        registrations[kept++] = registrations[i];
+    }
+    registrations.resize(kept);
+}
+
+#ifdef CYCLONE_PROFILE
+ParticleForceRegistry::TypeCounters& ParticleForceRegistry::getCounters(const std::type_info &type)
+{
+    Counters::iterator c = counters.begin();
+    for (; c != counters.end(); c++)
+    {
+        if (*c->type == type) return *c;
+    }
+
+    TypeCounters added = {&type, type.name(), 0, 0, 0, 0, 0};
+#ifdef __GNUG__
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+    if (status == 0 && demangled) added.name = demangled;
+    free(demangled);
+#endif
+    counters.push_back(added);
+    return counters.back();
+}
+
+void ParticleForceRegistry::updateForcesMeasured(const unsigned *indices, unsigned count, real duration)
+{
+    // threads applying subsets share the layouts, so the first one to
+    // need them works them out.
+    {
+        std::lock_guard<std::mutex> lock(countersMutex);
+        prepare();
+    }
+
+    // counted here and added in at the end, so threads applying subsets
+    // at the same time take the lock once each.
+    TypeCounters zero = {NULL, std::string(), 0, 0, 0, 0, 0};
+    Counters measured(types.size(), zero);
+
+    // one reading of the clock ends each run and starts the next.
+    const unsigned long long clockCost = getClockCost();
+    unsigned long long last = getTimeNanoseconds();
+
+    unsigned i = 0;
+    while (i < count)
+    {
+        const unsigned type = typeSlots[indices ? indices[i] : i];
+        unsigned first = i;
+        unsigned long long particles = 0;
+
+        for (; i < count; i++)
+        {
+            unsigned index = indices ? indices[i] : i;
+            if (typeSlots[index] != type) break;
+
+            const ParticleForceRegistration &registration = registrations[index];
+            registration.fg->updateForce(registration.particle, duration);
+            particles += countsParticle[index];
+        }
+
+        unsigned long long now = getTimeNanoseconds();
+        unsigned long long elapsed = now - last > clockCost ? now - last - clockCost : 0;
+        last = now;
+
+        TypeCounters &c = measured[type];
+        c.calls += i - first;
+        c.particles += particles;
+        c.batches++;
+        c.nanoseconds += elapsed;
+        if (elapsed > c.maxNanoseconds) c.maxNanoseconds = elapsed;
+    }
+
+    std::lock_guard<std::mutex> lock(countersMutex);
+    for (unsigned t = 0; t < measured.size(); t++)
+    {
+        const TypeCounters &m = measured[t];
+        if (m.batches == 0) continue;
+
+        TypeCounters &c = getCounters(*types[t]);
+        c.calls += m.calls;
+        c.particles += m.particles;
+        c.batches += m.batches;
+        c.nanoseconds += m.nanoseconds;
+        if (m.maxNanoseconds > c.maxNanoseconds) c.maxNanoseconds = m.maxNanoseconds;
+    }
+}
+#endif
+
+void ParticleForceRegistry::getStats(std::vector<ParticleForceStats> &stats) const
+{
+#ifdef CYCLONE_PROFILE
+    std::lock_guard<std::mutex> lock(countersMutex);
+    Counters::const_iterator c = counters.begin();
+    for (; c != counters.end(); c++)
+    {
+        ParticleForceStats s;
+        s.registry = name;
+        s.type = c->name;
+        s.calls = c->calls;
+        s.particles = c->particles;
+        s.batches = c->batches;
+        s.nanoseconds = c->nanoseconds;
+        s.maxNanoseconds = c->maxNanoseconds;
+        stats.push_back(s);
+    }
+#else
+    (void)stats;
+#endif
+}
+
+void ParticleForceRegistry::resetStats()
+{
+#ifdef CYCLONE_PROFILE
+    std::lock_guard<std::mutex> lock(countersMutex);
+    Counters::iterator c = counters.begin();
+    for (; c != counters.end(); c++)
+    {
+        c->calls = c->particles = c->batches = c->nanoseconds = c->maxNanoseconds = 0;
+    }
+#endif
 }
 
 ParticleGravity::ParticleGravity(const Vector3& gravity) : gravity(gravity)
@@ -59,6 +510,8 @@ void ParticleSpring::updateForce(Particle* particle, real duration)
 {
     // hook law: f = -k * deleta_l
     Vector3 force;
+    if (other == NULL) return;
+
     particle->getPosition(&force);
     force -= other->getPosition();
 
@@ -72,7 +525,13 @@ void ParticleSpring::updateForce(Particle* particle, real duration)
 
 }
 
-ParticleAnchoredSpring::ParticleAnchoredSpring(Vector3 *anchor, real springConstant, real restLength) : anchor(anchor), springConstant(sc), restlength(restLength)
+bool ParticleSpring::remapParticles(const ParticleRemap &remap)
+{
+    other = remap(other);
+    return other != NULL;
+}
+
+ParticleAnchoredSpring::ParticleAnchoredSpring(Vector3 *anchor, real springConstant, real restLength) : anchor(anchor), springConstant(springConstant), restLength(restLength)
 {
 }
 
@@ -98,6 +557,8 @@ ParticleBungee::ParticleBungee(Particle *other, real springConstant, real restLe
 void ParticleBungee::updateForce(Particle *particle, real duration)
 {
     Vector3 force;
+    if (other == NULL) return;
+
     particle->getPosition(&force);
     force -= other->getPosition(); 
 
@@ -113,6 +574,17 @@ void ParticleBungee::updateForce(Particle *particle, real duration)
     particle->addForce(force);
 };
 
+bool ParticleBungee::remapParticles(const ParticleRemap &remap)
+{
+    other = remap(other);
+    return other != NULL;
+}
+
+ParticleAnchoredBungee::ParticleAnchoredBungee(Vector3 *anchor, real springConstant, real restLength)
+    : ParticleAnchoredSpring(anchor, springConstant, restLength)
+{
+}
+
 void ParticleAnchoredBungee::updateForce(Particle* particle, real duration)
 {
     Vector3 force;
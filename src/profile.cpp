@@ -0,0 +1,97 @@
+#include <mutex>
+#include <cyclone/profile.h>
+
+using namespace cyclone;
+
+std::atomic<bool> Profiler::enabled(true);
+
+static std::mutex sectionsMutex;
+static ProfileSection *sections = NULL;
+
+ProfileSection::ProfileSection(const char *name)
+    : name(name), next(NULL), calls(0), nanoseconds(0), maxNanoseconds(0),
+      lastCalls(0), lastNanoseconds(0), lastMaxNanoseconds(0),
+      frames(0), totalCalls(0), totalNanoseconds(0), worstFrameNanoseconds(0)
+{
+    Profiler::registerSection(this);
+}
+
+void ProfileSection::record(unsigned long long duration)
+{
+    calls.fetch_add(1, std::memory_order_relaxed);
+    nanoseconds.fetch_add(duration, std::memory_order_relaxed);
+
+    unsigned long long max = maxNanoseconds.load(std::memory_order_relaxed);
+    while (duration > max &&
+           !maxNanoseconds.compare_exchange_weak(max, duration, std::memory_order_relaxed))
+    {
+    }
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    Profiler::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::registerSection(ProfileSection *section)
+{
+    std::lock_guard<std::mutex> lock(sectionsMutex);
+    section->next = sections;
+    sections = section;
+}
+
+void Profiler::endFrame()
+{
+    std::lock_guard<std::mutex> lock(sectionsMutex);
+
+    for (ProfileSection *section = sections; section; section = section->next)
+    {
+        section->lastCalls = section->calls.exchange(0, std::memory_order_relaxed);
+        section->lastNanoseconds = section->nanoseconds.exchange(0, std::memory_order_relaxed);
+        section->lastMaxNanoseconds = section->maxNanoseconds.exchange(0, std::memory_order_relaxed);
+
+        section->frames++;
+        section->totalCalls += section->lastCalls;
+        section->totalNanoseconds += section->lastNanoseconds;
+        if (section->lastNanoseconds > section->worstFrameNanoseconds)
+        {
+            section->worstFrameNanoseconds = section->lastNanoseconds;
+        }
+    }
+}
+
+void Profiler::reset()
+{
+    std::lock_guard<std::mutex> lock(sectionsMutex);
+
+    for (ProfileSection *section = sections; section; section = section->next)
+    {
+        section->calls = 0;
+        section->nanoseconds = 0;
+        section->maxNanoseconds = 0;
+        section->lastCalls = section->lastNanoseconds = section->lastMaxNanoseconds = 0;
+        section->frames = section->totalCalls = section->totalNanoseconds = 0;
+        section->worstFrameNanoseconds = 0;
+    }
+}
+
+void Profiler::getStats(std::vector<ProfileStats> &stats)
+{
+    std::lock_guard<std::mutex> lock(sectionsMutex);
+    stats.clear();
+
+    for (ProfileSection *section = sections; section; section = section->next)
+    {
+        ProfileStats s;
+        s.name = section->name;
+        s.calls = section->lastCalls;
+        s.frameMilliseconds = section->lastNanoseconds * 1e-6;
+        s.maxCallMilliseconds = section->lastMaxNanoseconds * 1e-6;
+
+        double frames = section->frames > 0 ? (double)section->frames : 1;
+        s.averageCalls = section->totalCalls / frames;
+        s.averageFrameMilliseconds = section->totalNanoseconds * 1e-6 / frames;
+        s.worstFrameMilliseconds = section->worstFrameNanoseconds * 1e-6;
+        stats.push_back(s);
+    }
+}
@@ -27,6 +27,22 @@ void Random::seed(unsigned s)
     p1 = 0;  p2 = 10;
 }
 
+Random::State Random::getState() const
+{
+    State state;
+    for (unsigned i = 0; i < 17; i++) state.buffer[i] = buffer[i];
+    state.p1 = p1;
+    state.p2 = p2;
+    return state;
+}
+
+void Random::setState(const State &state)
+{
+    for (unsigned i = 0; i < 17; i++) buffer[i] = state.buffer[i];
+    p1 = state.p1;
+    p2 = state.p2;
+}
+
 unsigned Random::rotl(unsigned n, unsigned r)
 {
 	  return	(n << r) |
@@ -0,0 +1,177 @@
+#include <string.h>
+#include <cyclone/render.h>
+#include <cyclone/parallel.h>
+
+using namespace cyclone;
+
+/** Particles counted or written together. */
+static const unsigned renderBlockSize = 512;
+
+/** Blocks a thread takes at the least, so small sets stay on one thread. */
+static const unsigned renderGrain = 4;
+
+/** Corners of a billboard, in the order they are drawn. */
+static const float cornerX[4] = {-1, 1, 1, -1};
+static const float cornerY[4] = {-1, -1, 1, 1};
+
+static unsigned packColour(real red, real green, real blue, real alpha)
+{
+    const real components[4] = {red, green, blue, alpha};
+    unsigned char bytes[4];
+    for (unsigned i = 0; i < 4; i++)
+    {
+        real value = components[i];
+        if (value < 0) value = 0;
+        if (value > 1) value = 1;
+        bytes[i] = (unsigned char)(value * 255.0f + 0.5f);
+    }
+
+    unsigned colour;
+    memcpy(&colour, bytes, sizeof(colour));
+    return colour;
+}
+
+unsigned long long RenderBuffer::checksum() const
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    const unsigned char *bytes = (const unsigned char*)(positions.empty() ? NULL : &positions[0]);
+    for (unsigned i = 0; i < vertexCount * 3 * sizeof(float); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    bytes = (const unsigned char*)(colours.empty() ? NULL : &colours[0]);
+    for (unsigned i = 0; i < vertexCount * sizeof(unsigned); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+RenderExtractor::RenderExtractor(Primitive primitive, real size, bool reflect)
+    : primitive(primitive), size(size), reflect(reflect)
+{
+}
+
+void RenderExtractor::setPrimitive(Primitive primitive, real size, bool reflect)
+{
+    RenderExtractor::primitive = primitive;
+    RenderExtractor::size = size;
+    RenderExtractor::reflect = reflect;
+}
+
+unsigned RenderExtractor::getVerticesPerParticle() const
+{
+    unsigned vertices = primitive == QUADS ? 4 : 1;
+    return reflect ? vertices * 2 : vertices;
+}
+
+void RenderExtractor::setColour(unsigned type, real red, real green, real blue, real alpha)
+{
+    if (type >= colours.size()) colours.resize(type + 1, packColour(1, 1, 1, 1));
+    colours[type] = packColour(red, green, blue, alpha);
+}
+
+void RenderExtractor::extract(const Particle *const *particles, const unsigned *types, unsigned count,
+                              RenderBuffer &buffer)
+{
+    CYCLONE_PROFILE_SCOPE("render/extract");
+
+    unsigned blocks = (count + renderBlockSize - 1) / renderBlockSize;
+    blockStarts.resize(blocks + 1);
+
+    // count the live particles in each block, then turn the counts into
+    // the first vertex of each block.
+    parallelFor(0, blocks, renderGrain, [&](unsigned begin, unsigned end) {
+        for (unsigned block = begin; block < end; block++)
+        {
+            unsigned first = block * renderBlockSize;
+            unsigned last = first + renderBlockSize < count ? first + renderBlockSize : count;
+
+            unsigned live = 0;
+            for (unsigned i = first; i < last; i++) live += types[i] != 0;
+            blockStarts[block + 1] = live;
+        }
+    });
+
+    const unsigned perParticle = getVerticesPerParticle();
+    blockStarts[0] = 0;
+    for (unsigned block = 0; block < blocks; block++)
+    {
+        blockStarts[block + 1] = blockStarts[block] + blockStarts[block + 1] * perParticle;
+    }
+
+    buffer.vertexCount = blockStarts[blocks];
+    buffer.positions.resize(buffer.vertexCount * 3);
+    buffer.colours.resize(buffer.vertexCount);
+    if (buffer.vertexCount == 0) return;
+
+    const unsigned white = packColour(1, 1, 1, 1);
+    const unsigned typeCount = (unsigned)colours.size();
+    const unsigned *table = colours.empty() ? NULL : &colours[0];
+    float *positionOut = &buffer.positions[0];
+    unsigned *colourOut = &buffer.colours[0];
+
+    const bool quads = primitive == QUADS;
+    const float half = (float)size;
+    const bool mirror = reflect;
+
+    parallelFor(0, blocks, renderGrain, [&](unsigned begin, unsigned end) {
+        for (unsigned block = begin; block < end; block++)
+        {
+            unsigned first = block * renderBlockSize;
+            unsigned last = first + renderBlockSize < count ? first + renderBlockSize : count;
+
+            unsigned vertex = blockStarts[block];
+            for (unsigned i = first; i < last; i++)
+            {
+                unsigned type = types[i];
+                if (type == 0) continue;
+
+                const unsigned colour = type < typeCount ? table[type] : white;
+                const Vector3 position = particles[i]->getPosition();
+                const float x = (float)position.x;
+                const float y = (float)position.y;
+                const float z = (float)position.z;
+
+                float *out = positionOut + vertex * 3;
+                if (quads)
+                {
+                    for (unsigned c = 0; c < 4; c++)
+                    {
+                        out[c * 3] = x + cornerX[c] * half;
+                        out[c * 3 + 1] = y + cornerY[c] * half;
+                        out[c * 3 + 2] = z;
+                    }
+                    if (mirror)
+                    {
+                        for (unsigned c = 0; c < 4; c++)
+                        {
+                            out[12 + c * 3] = x + cornerX[c] * half;
+                            out[12 + c * 3 + 1] = -y + cornerY[c] * half;
+                            out[12 + c * 3 + 2] = z;
+                        }
+                    }
+                }
+                else
+                {
+                    out[0] = x;
+                    out[1] = y;
+                    out[2] = z;
+                    if (mirror)
+                    {
+                        out[3] = x;
+                        out[4] = -y;
+                        out[5] = z;
+                    }
+                }
+
+                for (unsigned v = 0; v < perParticle; v++) colourOut[vertex + v] = colour;
+                vertex += perParticle;
+            }
+        }
+    });
+}
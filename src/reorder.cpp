@@ -0,0 +1,172 @@
+#include <cyclone/reorder.h>
+#include <cyclone/morton.h>
+#include <cyclone/parallel.h>
+
+using namespace cyclone;
+
+/** Keys counted or scattered together by one thread. */
+static const unsigned reorderBlockSize = 4096;
+
+/** Blocks a thread takes at the least. */
+static const unsigned reorderGrain = 4;
+
+/** Bits sorted per radix pass. */
+static const unsigned reorderDigitBits = 8;
+static const unsigned reorderBuckets = 1 << reorderDigitBits;
+
+MortonReorder::MortonReorder(real cellSize)
+    : cellSize(cellSize)
+{
+}
+
+void MortonReorder::setCellSize(real cellSize)
+{
+    MortonReorder::cellSize = cellSize;
+}
+
+void MortonReorder::computeKeys(const Particle *particles, unsigned count)
+{
+    keys.resize(count);
+    if (count == 0) return;
+
+    Vector3 min = particles[0].getPosition();
+    Vector3 max = min;
+    for (unsigned i = 1; i < count; i++)
+    {
+        Vector3 position = particles[i].getPosition();
+        if (position.x < min.x) min.x = position.x;
+        if (position.y < min.y) min.y = position.y;
+        if (position.z < min.z) min.z = position.z;
+        if (position.x > max.x) max.x = position.x;
+        if (position.y > max.y) max.y = position.y;
+        if (position.z > max.z) max.z = position.z;
+    }
+
+    // cells grow if the particles are spread too far for the grid.
+    real extent = max.x - min.x;
+    if (max.y - min.y > extent) extent = max.y - min.y;
+    if (max.z - min.z > extent) extent = max.z - min.z;
+
+    const real cells = (real)((1u << MORTON_BITS) - 1);
+    real scale = cellSize > 0 ? 1 / cellSize : 1;
+    if (extent * scale > cells) scale = cells / extent;
+
+    parallelFor(0, count, reorderBlockSize, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++)
+        {
+            keys[i] = mortonCode(particles[i].getPosition(), min, scale);
+        }
+    });
+}
+
+void MortonReorder::sortKeys(unsigned count)
+{
+    order.resize(count);
+    for (unsigned i = 0; i < count; i++) order[i] = i;
+    if (count < 2) return;
+
+    keyScratch.resize(count);
+    orderScratch.resize(count);
+
+    // only the digits where the keys differ need a pass.
+    unsigned long long differences = 0;
+    for (unsigned i = 1; i < count; i++) differences |= keys[i] ^ keys[0];
+
+    const unsigned blocks = (count + reorderBlockSize - 1) / reorderBlockSize;
+
+    for (unsigned shift = 0; shift < 64; shift += reorderDigitBits)
+    {
+        if (((differences >> shift) & (reorderBuckets - 1)) == 0) continue;
+
+        histograms.assign(blocks * reorderBuckets, 0);
+        parallelFor(0, blocks, reorderGrain, [&](unsigned begin, unsigned end) {
+            for (unsigned block = begin; block < end; block++)
+            {
+                unsigned *histogram = &histograms[block * reorderBuckets];
+                unsigned first = block * reorderBlockSize;
+                unsigned last = first + reorderBlockSize < count ? first + reorderBlockSize : count;
+                for (unsigned i = first; i < last; i++)
+                {
+                    histogram[(keys[i] >> shift) & (reorderBuckets - 1)]++;
+                }
+            }
+        });
+
+        // each block writes its share of a digit after the blocks before
+        // it, which keeps the sort stable whatever the thread count.
+        unsigned offset = 0;
+        for (unsigned digit = 0; digit < reorderBuckets; digit++)
+        {
+            for (unsigned block = 0; block < blocks; block++)
+            {
+                unsigned &slot = histograms[block * reorderBuckets + digit];
+                unsigned digitCount = slot;
+                slot = offset;
+                offset += digitCount;
+            }
+        }
+
+        parallelFor(0, blocks, reorderGrain, [&](unsigned begin, unsigned end) {
+            for (unsigned block = begin; block < end; block++)
+            {
+                unsigned *next = &histograms[block * reorderBuckets];
+                unsigned first = block * reorderBlockSize;
+                unsigned last = first + reorderBlockSize < count ? first + reorderBlockSize : count;
+                for (unsigned i = first; i < last; i++)
+                {
+                    unsigned position = next[(keys[i] >> shift) & (reorderBuckets - 1)]++;
+                    keyScratch[position] = keys[i];
+                    orderScratch[position] = order[i];
+                }
+            }
+        });
+
+        keys.swap(keyScratch);
+        order.swap(orderScratch);
+    }
+}
+
+real MortonReorder::measureDisorder(const Particle *particles, unsigned count)
+{
+    if (count < 2) return 0;
+
+    computeKeys(particles, count);
+
+    unsigned descents = 0;
+    for (unsigned i = 1; i < count; i++) descents += keys[i - 1] > keys[i];
+    return (real)descents / (real)(count - 1);
+}
+
+const std::vector<unsigned>& MortonReorder::sort(const Particle *particles, unsigned count)
+{
+    computeKeys(particles, count);
+    sortKeys(count);
+    return order;
+}
+
+bool MortonReorder::reorder(ParticleStore &store, real threshold)
+{
+    CYCLONE_PROFILE_SCOPE("reorder/morton");
+
+    unsigned count = store.getSize();
+    if (count < 2) return false;
+
+    computeKeys(store.getParticles(), count);
+
+    unsigned descents = 0;
+    for (unsigned i = 1; i < count; i++) descents += keys[i - 1] > keys[i];
+    if (descents == 0 || (real)descents / (real)(count - 1) <= threshold) return false;
+
+    sortKeys(count);
+    store.permute(&order[0]);
+
+    newIndices.resize(count);
+    for (unsigned i = 0; i < count; i++) newIndices[order[i]] = i;
+    remap = ParticleRemap(store.getParticles(), count, &newIndices[0]);
+    return true;
+}
+
+const ParticleRemap& MortonReorder::getRemap() const
+{
+    return remap;
+}
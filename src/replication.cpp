@@ -0,0 +1,586 @@
+#include <math.h>
+#include <string.h>
+#include <cyclone/replication.h>
+
+#if (__APPLE__ || __unix)
+    #define REPLICATION_UDP 1
+    #include <arpa/inet.h>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+using namespace cyclone;
+
+enum PacketKind
+{
+    STATE_PACKET = 1,
+    ACKNOWLEDGE_PACKET = 2
+};
+
+/** Kind, sequence, baseline, count, first, slice size, index, total, precisions. */
+static const unsigned stateHeaderSize = 33;
+static const unsigned acknowledgeSize = 5;
+
+/** Components stored per particle, position then velocity. */
+static const unsigned components = 6;
+
+/** Bits used to store the width of a particle's differences. */
+static const unsigned widthBits = 6;
+
+/** Quantised values are kept in this range so differences fit 32 bits. */
+static const double quantisedLimit = 1073741823.0;
+
+static void putU16(unsigned char *out, unsigned value)
+{
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+}
+
+static void putU32(unsigned char *out, unsigned value)
+{
+    for (unsigned i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (i * 8));
+}
+
+static unsigned getU16(const unsigned char *in)
+{
+    return (unsigned)in[0] | ((unsigned)in[1] << 8);
+}
+
+static unsigned getU32(const unsigned char *in)
+{
+    unsigned value = 0;
+    for (unsigned i = 0; i < 4; i++) value |= (unsigned)in[i] << (i * 8);
+    return value;
+}
+
+static void putF32(unsigned char *out, float value)
+{
+    unsigned bits;
+    memcpy(&bits, &value, 4);
+    putU32(out, bits);
+}
+
+static float getF32(const unsigned char *in)
+{
+    unsigned bits = getU32(in);
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+}
+
+static int quantise(real value, double scale)
+{
+    double scaled = floor(value * scale + 0.5);
+    if (scaled > quantisedLimit) scaled = quantisedLimit;
+    if (scaled < -quantisedLimit) scaled = -quantisedLimit;
+    return (int)scaled;
+}
+
+static unsigned zigzag(int value)
+{
+    return ((unsigned)value << 1) ^ (unsigned)(value >> 31);
+}
+
+static int unzigzag(unsigned value)
+{
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+static unsigned bitWidth(unsigned value)
+{
+    unsigned width = 0;
+    while (value) { width++; value >>= 1; }
+    return width;
+}
+
+namespace
+{
+    /** Packs values of up to 32 bits, least significant bit first. */
+    class BitWriter
+    {
+        ReplicationPacket &out;
+        unsigned long long bits;
+        unsigned count;
+
+    public:
+        BitWriter(ReplicationPacket &out) : out(out), bits(0), count(0) {}
+
+        void write(unsigned value, unsigned width)
+        {
+            if (width == 0) return;
+            if (width < 32) value &= (1u << width) - 1;
+            bits |= (unsigned long long)value << count;
+            count += width;
+            while (count >= 8)
+            {
+                out.push_back((unsigned char)bits);
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+
+        void flush()
+        {
+            if (count > 0) out.push_back((unsigned char)bits);
+            bits = 0;
+            count = 0;
+        }
+    };
+
+    class BitReader
+    {
+        const unsigned char *in;
+        const unsigned char *end;
+        unsigned long long bits;
+        unsigned count;
+
+    public:
+        BitReader(const unsigned char *in, const unsigned char *end)
+            : in(in), end(end), bits(0), count(0) {}
+
+        bool read(unsigned width, unsigned &value)
+        {
+            while (count < width)
+            {
+                if (in >= end) return false;
+                bits |= (unsigned long long)*in++ << count;
+                count += 8;
+            }
+            value = width == 0 ? 0 : (unsigned)(bits & ((1ull << width) - 1));
+            bits >>= width;
+            count -= width;
+            return true;
+        }
+    };
+}
+
+ReplicationEncoder::ReplicationEncoder(real positionPrecision, real velocityPrecision,
+                                       unsigned maxPacketSize)
+    : positionPrecision(positionPrecision), velocityPrecision(velocityPrecision),
+      maxPacketSize(maxPacketSize > stateHeaderSize + 32 ? maxPacketSize : stateHeaderSize + 32),
+      sequence(0), baseline(0)
+{
+}
+
+const ReplicationEncoder::Frame* ReplicationEncoder::findFrame(unsigned sequence) const
+{
+    for (unsigned i = 0; i < history.size(); i++)
+    {
+        if (history[i].sequence == sequence) return &history[i];
+    }
+    return NULL;
+}
+
+void ReplicationEncoder::startPacket(ReplicationPacket &packet, unsigned sequence, unsigned baseline,
+                                     unsigned count, unsigned first, unsigned slice) const
+{
+    packet.assign(stateHeaderSize, 0);
+    packet[0] = STATE_PACKET;
+    putU32(&packet[1], sequence);
+    putU32(&packet[5], baseline);
+    putU32(&packet[9], count);
+    putU32(&packet[13], first);
+    putU16(&packet[21], slice);
+    putF32(&packet[25], (float)positionPrecision);
+    putF32(&packet[29], (float)velocityPrecision);
+}
+
+unsigned ReplicationEncoder::encode(const Particle *const *particles, unsigned count,
+                                    ReplicationPackets &packets)
+{
+    Frame frame;
+    frame.sequence = ++sequence;
+    frame.state.resize((size_t)count * components);
+
+    const double positionScale = 1.0 / positionPrecision;
+    const double velocityScale = 1.0 / velocityPrecision;
+    for (unsigned i = 0; i < count; i++)
+    {
+        Vector3 position = particles[i]->getPosition();
+        Vector3 velocity = particles[i]->getVelocity();
+        int *q = &frame.state[(size_t)i * components];
+        q[0] = quantise(position.x, positionScale);
+        q[1] = quantise(position.y, positionScale);
+        q[2] = quantise(position.z, positionScale);
+        q[3] = quantise(velocity.x, velocityScale);
+        q[4] = quantise(velocity.y, velocityScale);
+        q[5] = quantise(velocity.z, velocityScale);
+    }
+
+    // an observer that stopped acknowledging long ago gets a full frame.
+    const Frame *base = findFrame(baseline);
+    unsigned baseCount = base ? (unsigned)(base->state.size() / components) : 0;
+
+    packets.clear();
+    const unsigned budget = (maxPacketSize - stateHeaderSize) * 8;
+    ReplicationPacket packet;
+    BitWriter bits(packet);
+    bool open = false;
+    unsigned first = 0;
+    unsigned used = 0;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        const int *q = &frame.state[(size_t)i * components];
+        const int *b = i < baseCount ? &base->state[(size_t)i * components] : NULL;
+
+        unsigned coded[components];
+        unsigned positionWidth = 0, velocityWidth = 0;
+        bool changed = false;
+        for (unsigned c = 0; c < components; c++)
+        {
+            coded[c] = zigzag(q[c] - (b ? b[c] : 0));
+            if (coded[c]) changed = true;
+
+            unsigned width = bitWidth(coded[c]);
+            unsigned &widest = c < 3 ? positionWidth : velocityWidth;
+            if (width > widest) widest = width;
+        }
+
+        unsigned cost = 1 + (changed ? 2 * widthBits + 3 * (positionWidth + velocityWidth) : 0);
+        if (open && used + cost > budget)
+        {
+            bits.flush();
+            putU32(&packet[17], i - first);
+            packets.push_back(packet);
+            open = false;
+        }
+
+        if (!open)
+        {
+            startPacket(packet, frame.sequence, base ? baseline : 0, count, i,
+                        (unsigned)packets.size());
+            open = true;
+            first = i;
+            used = 0;
+        }
+
+        bits.write(changed ? 1 : 0, 1);
+        if (changed)
+        {
+            bits.write(positionWidth, widthBits);
+            bits.write(velocityWidth, widthBits);
+            for (unsigned c = 0; c < components; c++)
+            {
+                bits.write(coded[c], c < 3 ? positionWidth : velocityWidth);
+            }
+        }
+        used += cost;
+    }
+
+    // an empty frame still goes out as one packet.
+    if (!open)
+    {
+        startPacket(packet, frame.sequence, base ? baseline : 0, count, count,
+                    (unsigned)packets.size());
+        first = count;
+    }
+    bits.flush();
+    putU32(&packet[17], count - first);
+    packets.push_back(packet);
+
+    for (unsigned p = 0; p < packets.size(); p++)
+    {
+        putU16(&packets[p][23], (unsigned)packets.size());
+    }
+
+    history.push_back(frame);
+    while (history.size() > HISTORY)
+    {
+        history.pop_front();
+    }
+    return frame.sequence;
+}
+
+bool ReplicationEncoder::receive(const unsigned char *data, unsigned size)
+{
+    if (size < acknowledgeSize || data[0] != ACKNOWLEDGE_PACKET) return false;
+    acknowledge(getU32(data + 1));
+    return true;
+}
+
+void ReplicationEncoder::acknowledge(unsigned sequence)
+{
+    // acknowledgements can arrive out of order, only newer ones count.
+    if (sequence > baseline && findFrame(sequence)) baseline = sequence;
+}
+
+unsigned ReplicationEncoder::getBaseline() const
+{
+    return baseline;
+}
+
+ReplicationDecoder::ReplicationDecoder(unsigned maxParticles)
+    : maxParticles(maxParticles), sequence(0), positionPrecision(0), velocityPrecision(0)
+{
+}
+
+const ReplicationDecoder::Frame* ReplicationDecoder::findFrame(unsigned sequence) const
+{
+    for (unsigned i = 0; i < history.size(); i++)
+    {
+        if (history[i].sequence == sequence) return &history[i];
+    }
+    return NULL;
+}
+
+bool ReplicationDecoder::receive(const unsigned char *data, unsigned size)
+{
+    if (size < stateHeaderSize || data[0] != STATE_PACKET) return false;
+
+    unsigned frameSequence = getU32(data + 1);
+    unsigned baseline = getU32(data + 5);
+    unsigned count = getU32(data + 9);
+    unsigned first = getU32(data + 13);
+    unsigned sliceCount = getU32(data + 17);
+    unsigned slice = getU16(data + 21);
+    unsigned slices = getU16(data + 23);
+
+    // late packets of frames already superseded are of no use.
+    if (frameSequence <= sequence) return false;
+
+    // an encoder puts at least one particle in every packet but the
+    // only one of an empty frame, and spends at least a bit on each.
+    if (count > maxParticles || slices == 0 || slices > (count > 0 ? count : 1) || slice >= slices ||
+        first > count || sliceCount > count - first ||
+        sliceCount > (unsigned long long)(size - stateHeaderSize) * 8)
+    {
+        return false;
+    }
+
+    std::deque<Pending>::iterator frame = pending.begin();
+    while (frame != pending.end() && frame->frame.sequence < frameSequence) frame++;
+
+    if (frame == pending.end() || frame->frame.sequence != frameSequence)
+    {
+        const Frame *base = baseline ? findFrame(baseline) : NULL;
+        if (baseline && base == NULL) return false;
+
+        // with every slot taken, the oldest frame gives way, unless this
+        // one is older still.
+        if (pending.size() >= PENDING)
+        {
+            if (frame == pending.begin()) return false;
+            pending.pop_front();
+            frame = pending.begin();
+            while (frame != pending.end() && frame->frame.sequence < frameSequence) frame++;
+        }
+
+        // start from the baseline, so particles that weren't sent keep
+        // their values.
+        frame = pending.insert(frame, Pending());
+        frame->frame.sequence = frameSequence;
+        frame->frame.state.assign((size_t)count * components, 0);
+        if (base)
+        {
+            size_t shared = base->state.size() < frame->frame.state.size() ?
+                base->state.size() : frame->frame.state.size();
+            if (shared > 0) memcpy(frame->frame.state.data(), base->state.data(), shared * sizeof(int));
+        }
+        frame->received.assign(slices, false);
+        frame->receivedCount = 0;
+    }
+    if (frame->received.size() != slices || frame->received[slice] ||
+        frame->frame.state.size() != (size_t)count * components)
+    {
+        return false;
+    }
+
+    BitReader bits(data + stateHeaderSize, data + size);
+    for (unsigned i = first; i < first + sliceCount; i++)
+    {
+        unsigned changed, positionWidth, velocityWidth;
+        if (!bits.read(1, changed)) break;
+        if (!changed) continue;
+
+        bool valid = bits.read(widthBits, positionWidth) && bits.read(widthBits, velocityWidth) &&
+            positionWidth <= 32 && velocityWidth <= 32;
+
+        int *q = &frame->frame.state[(size_t)i * components];
+        for (unsigned c = 0; valid && c < components; c++)
+        {
+            unsigned coded = 0;
+            valid = bits.read(c < 3 ? positionWidth : velocityWidth, coded);
+            q[c] += unzigzag(coded);
+        }
+
+        if (!valid)
+        {
+            // the frame can't be trusted any more.
+            pending.erase(frame);
+            return false;
+        }
+    }
+
+    frame->received[slice] = true;
+    if (++frame->receivedCount < slices) return false;
+
+    positionPrecision = getF32(data + 25);
+    velocityPrecision = getF32(data + 29);
+    sequence = frameSequence;
+
+    positions.resize(count);
+    velocities.resize(count);
+    for (unsigned i = 0; i < count; i++)
+    {
+        const int *q = &frame->frame.state[(size_t)i * components];
+        positions[i] = Vector3(q[0] * positionPrecision, q[1] * positionPrecision, q[2] * positionPrecision);
+        velocities[i] = Vector3(q[3] * velocityPrecision, q[4] * velocityPrecision, q[5] * velocityPrecision);
+    }
+
+    history.push_back(frame->frame);
+    while (history.size() > ReplicationEncoder::HISTORY)
+    {
+        history.pop_front();
+    }
+
+    // this frame and any older ones still missing packets are done with.
+    pending.erase(pending.begin(), frame + 1);
+    return true;
+}
+
+void ReplicationDecoder::acknowledge(ReplicationPacket &packet) const
+{
+    packet.resize(acknowledgeSize);
+    packet[0] = ACKNOWLEDGE_PACKET;
+    putU32(&packet[1], sequence);
+}
+
+unsigned ReplicationDecoder::getSequence() const
+{
+    return sequence;
+}
+
+const std::vector<Vector3>& ReplicationDecoder::getPositions() const
+{
+    return positions;
+}
+
+const std::vector<Vector3>& ReplicationDecoder::getVelocities() const
+{
+    return velocities;
+}
+
+LoopbackTransport::LoopbackTransport()
+    : peer(NULL), lossRate(0)
+{
+    random.seed(1);
+}
+
+void LoopbackTransport::connect(LoopbackTransport &a, LoopbackTransport &b)
+{
+    a.peer = &b;
+    b.peer = &a;
+}
+
+void LoopbackTransport::setLossRate(real lossRate, unsigned seed)
+{
+    LoopbackTransport::lossRate = lossRate;
+    random.seed(seed);
+}
+
+bool LoopbackTransport::send(const unsigned char *data, unsigned size)
+{
+    if (peer == NULL) return false;
+    if (lossRate > 0 && random.randomReal() < lossRate) return true;
+
+    std::lock_guard<std::mutex> lock(peer->mutex);
+    peer->queue.push_back(ReplicationPacket(data, data + size));
+    return true;
+}
+
+bool LoopbackTransport::receive(ReplicationPacket &packet)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (queue.empty()) return false;
+
+    packet.swap(queue.front());
+    queue.pop_front();
+    return true;
+}
+
+UdpTransport::UdpTransport()
+    : socket(-1), peerSize(0)
+{
+}
+
+UdpTransport::~UdpTransport()
+{
+    close();
+}
+
+bool UdpTransport::open(unsigned short localPort, const char *peerAddress, unsigned short peerPort)
+{
+    close();
+
+#if REPLICATION_UDP
+    socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket < 0) return false;
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(localPort);
+
+    struct sockaddr_in remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(peerPort);
+
+    if (sizeof(remote) > sizeof(peer) ||
+        inet_pton(AF_INET, peerAddress, &remote.sin_addr) != 1 ||
+        bind(socket, (struct sockaddr*)&local, sizeof(local)) != 0 ||
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK) != 0)
+    {
+        close();
+        return false;
+    }
+
+    memcpy(peer, &remote, sizeof(remote));
+    peerSize = sizeof(remote);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void UdpTransport::close()
+{
+#if REPLICATION_UDP
+    if (socket >= 0) ::close(socket);
+#endif
+    socket = -1;
+    peerSize = 0;
+}
+
+bool UdpTransport::send(const unsigned char *data, unsigned size)
+{
+#if REPLICATION_UDP
+    if (socket < 0) return false;
+    return sendto(socket, data, size, 0, (const struct sockaddr*)peer, peerSize) == (ssize_t)size;
+#else
+    return false;
+#endif
+}
+
+bool UdpTransport::receive(ReplicationPacket &packet)
+{
+#if REPLICATION_UDP
+    if (socket < 0) return false;
+
+    packet.resize(65536);
+    ssize_t size = recv(socket, &packet[0], packet.size(), 0);
+    if (size < 0)
+    {
+        packet.clear();
+        return false;
+    }
+    packet.resize((size_t)size);
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,289 @@
+#include <new>
+#include <string.h>
+#include <cyclone/sharedstate.h>
+
+#if (__APPLE__ || __unix)
+    #define SHAREDSTATE_POSIX 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace cyclone;
+
+static const char sharedMagic[8] = {'C', 'Y', 'C', 'L', 'S', 'H', 'M', '1'};
+static const unsigned sharedVersion = 1;
+static const unsigned sharedAlignment = 64;
+
+static unsigned long long align(unsigned long long size)
+{
+    return (size + sharedAlignment - 1) / sharedAlignment * sharedAlignment;
+}
+
+static unsigned long long headerBytes()
+{
+    return align(sizeof(SharedStateHeader));
+}
+
+static unsigned long long slotHeaderBytes()
+{
+    return align(sizeof(SharedSlotHeader));
+}
+
+static unsigned long long positionBytes(unsigned capacity)
+{
+    return align((unsigned long long)capacity * 3 * sizeof(float));
+}
+
+static unsigned long long attributeBytes(unsigned capacity)
+{
+    return align((unsigned long long)capacity * sizeof(unsigned));
+}
+
+SharedStateWriter::SharedStateWriter()
+    : header(NULL), size(0), frames(0), writing(0)
+{
+    name[0] = 0;
+}
+
+SharedStateWriter::~SharedStateWriter()
+{
+    close();
+}
+
+bool SharedStateWriter::open(const char *name, unsigned capacity, unsigned attributes)
+{
+    close();
+
+#if SHAREDSTATE_POSIX
+    if (strlen(name) >= sizeof(SharedStateWriter::name)) return false;
+
+    unsigned long long slotSize = slotHeaderBytes() + positionBytes(capacity);
+    if (attributes & TYPES) slotSize += attributeBytes(capacity);
+    if (attributes & COLOURS) slotSize += attributeBytes(capacity);
+    unsigned long long total = headerBytes() + 3 * slotSize;
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return false;
+
+    void *address = MAP_FAILED;
+    if (ftruncate(fd, (off_t)total) == 0)
+    {
+        address = mmap(NULL, (size_t)total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (address == MAP_FAILED)
+    {
+        shm_unlink(name);
+        return false;
+    }
+
+    strcpy(SharedStateWriter::name, name);
+    header = new (address) SharedStateHeader();
+    size = total;
+
+    header->version = sharedVersion;
+    header->capacity = capacity;
+    header->attributes = attributes;
+    header->slotSize = (unsigned)slotSize;
+    header->padding = 0;
+    for (unsigned i = 0; i < 3; i++) header->sequences[i].store(0, std::memory_order_relaxed);
+    header->latest.store(0, std::memory_order_relaxed);
+
+    // the magic goes in last, so readers never see a half set up header.
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, sharedMagic, sizeof(sharedMagic));
+
+    frames = 0;
+    writing = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SharedStateWriter::close()
+{
+#if SHAREDSTATE_POSIX
+    if (header)
+    {
+        munmap(header, (size_t)size);
+        shm_unlink(name);
+    }
+#endif
+    header = NULL;
+    size = 0;
+    name[0] = 0;
+}
+
+unsigned char* SharedStateWriter::getSlot(unsigned slot) const
+{
+    return (unsigned char*)header + headerBytes() + (unsigned long long)slot * header->slotSize;
+}
+
+SharedStateWriter::Frame SharedStateWriter::beginFrame()
+{
+    Frame frame = {NULL, NULL, NULL, 0};
+    if (header == NULL) return frame;
+
+    // never the newest slot, which readers are most likely to be in.
+    writing = (header->latest.load(std::memory_order_relaxed) + 1) % 3;
+
+    std::atomic<unsigned long long> &sequence = header->sequences[writing];
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    unsigned char *slot = getSlot(writing);
+    unsigned char *data = slot + slotHeaderBytes();
+    frame.positions = (float*)data;
+    data += positionBytes(header->capacity);
+
+    if (header->attributes & TYPES)
+    {
+        frame.types = (unsigned*)data;
+        data += attributeBytes(header->capacity);
+    }
+    if (header->attributes & COLOURS)
+    {
+        frame.colours = (unsigned*)data;
+    }
+
+    frame.capacity = header->capacity;
+    return frame;
+}
+
+void SharedStateWriter::endFrame(unsigned count, double time)
+{
+    if (header == NULL) return;
+
+    SharedSlotHeader *slot = (SharedSlotHeader*)getSlot(writing);
+    slot->frame = ++frames;
+    slot->time = time;
+    slot->count = count < header->capacity ? count : header->capacity;
+
+    std::atomic<unsigned long long> &sequence = header->sequences[writing];
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    header->latest.store(writing, std::memory_order_release);
+}
+
+void SharedStateWriter::publish(const Particle *const *particles, unsigned count, double time,
+                                const unsigned *types, const unsigned *colours)
+{
+    Frame frame = beginFrame();
+    if (frame.positions == NULL) return;
+
+    if (count > frame.capacity) count = frame.capacity;
+    for (unsigned i = 0; i < count; i++)
+    {
+        Vector3 position = particles[i]->getPosition();
+        frame.positions[i * 3] = (float)position.x;
+        frame.positions[i * 3 + 1] = (float)position.y;
+        frame.positions[i * 3 + 2] = (float)position.z;
+    }
+    if (frame.types && types) memcpy(frame.types, types, count * sizeof(unsigned));
+    if (frame.colours && colours) memcpy(frame.colours, colours, count * sizeof(unsigned));
+
+    endFrame(count, time);
+}
+
+SharedStateReader::SharedStateReader()
+    : header(NULL), size(0)
+{
+}
+
+SharedStateReader::~SharedStateReader()
+{
+    close();
+}
+
+bool SharedStateReader::open(const char *name)
+{
+    close();
+
+#if SHAREDSTATE_POSIX
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    struct stat info;
+    void *address = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (unsigned long long)info.st_size >= headerBytes())
+    {
+        address = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (address == MAP_FAILED) return false;
+
+    header = (const SharedStateHeader*)address;
+    size = (unsigned long long)info.st_size;
+
+    bool valid = memcmp(header->magic, sharedMagic, sizeof(sharedMagic)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    valid = valid && header->version == sharedVersion &&
+        headerBytes() + 3ULL * header->slotSize <= size;
+
+    if (!valid) close();
+    return valid;
+#else
+    return false;
+#endif
+}
+
+void SharedStateReader::close()
+{
+#if SHAREDSTATE_POSIX
+    if (header) munmap((void*)header, (size_t)size);
+#endif
+    header = NULL;
+    size = 0;
+}
+
+unsigned SharedStateReader::getCapacity() const
+{
+    return header ? header->capacity : 0;
+}
+
+bool SharedStateReader::acquire(SharedStateFrame &frame) const
+{
+    if (header == NULL) return false;
+
+    unsigned slot = header->latest.load(std::memory_order_acquire);
+    unsigned long long sequence = header->sequences[slot].load(std::memory_order_acquire);
+    if (sequence == 0 || (sequence & 1)) return false;
+
+    const unsigned char *base = (const unsigned char*)header + headerBytes() +
+        (unsigned long long)slot * header->slotSize;
+    const SharedSlotHeader *slotHeader = (const SharedSlotHeader*)base;
+
+    frame.frame = slotHeader->frame;
+    frame.time = slotHeader->time;
+    frame.count = slotHeader->count;
+    frame.slot = slot;
+    frame.sequence = sequence;
+
+    const unsigned char *data = base + slotHeaderBytes();
+    frame.positions = (const float*)data;
+    data += positionBytes(header->capacity);
+
+    frame.types = NULL;
+    frame.colours = NULL;
+    if (header->attributes & SharedStateWriter::TYPES)
+    {
+        frame.types = (const unsigned*)data;
+        data += attributeBytes(header->capacity);
+    }
+    if (header->attributes & SharedStateWriter::COLOURS)
+    {
+        frame.colours = (const unsigned*)data;
+    }
+
+    if (frame.count > header->capacity) return false;
+    return validate(frame);
+}
+
+bool SharedStateReader::validate(const SharedStateFrame &frame) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header->sequences[frame.slot].load(std::memory_order_relaxed) == frame.sequence;
+}
@@ -0,0 +1,513 @@
+/*
+ * cyclone-sim: runs a scenario without a window for a fixed number of
+ * fixed size steps, as fast as possible, and reports throughput and a
+ * checksum of the final state.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <cyclone/profile.h>
+#include <cyclone/timer.h>
+#include <cyclone/trace.h>
+
+#include "scenario.h"
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: cyclone-sim [options]\n"
+        "  --scenario NAME   one of: %s (default fireworks)\n"
+        "  --steps N         number of steps to run (default 1000)\n"
+        "  --dt SECONDS      fixed step duration (default 0.016)\n"
+        "  --adaptive TOL    split steps into substeps with at most TOL error each\n"
+        "  --forces MODE     add up forces across threads: serial, coloured or buffered\n"
+        "  --deterministic   add buffered forces up the same way on any number of threads\n"
+        "  --capacity N      particle slots (default 1024)\n"
+        "  --seed N          random seed, not zero (default 1)\n"
+        "  --workers N       threads to split parallel stages across (default: one per core)\n"
+        "  --interval N      steps between launches or salvos (default 30)\n"
+        "  --burst N         fireworks or rounds per launch (default 4)\n"
+        "  --rules FILE      load the scenario's effect rules from a file\n"
+        "  --shuffle         store particles in random order, as if long running\n"
+        "  --multirate       update slow effects only as often as their rules ask\n"
+        "  --reorder N       every N steps, restore spatial order if it has drifted\n"
+        "  --profile         print the time spent in each profiled section\n"
+        "  --trace FILE      write a Chrome trace of every profiled scope\n"
+        "  --restore FILE    start from a snapshot instead of the initial state\n"
+        "  --save FILE       write a snapshot of the final state\n"
+        "  --record FILE     record every particle's trajectory\n"
+        "  --replicate LOSS  stream each step to a loopback observer, dropping\n"
+        "                    the given fraction of packets\n"
+        "  --export NAME     publish positions to the named shared memory segment\n"
+        "  --render          extract render vertices every step and report their checksum\n"
+        "  --ensemble N      instead of a scenario, fire N artillery rounds in worlds of\n"
+        "                    their own and report where they land\n",
+        getScenarioNames());
+}
+
+/**
+ * Fires a sweep of artillery rounds, each in a world of its own, with
+ * mass, launch velocity and damping drawn at random, and prints where
+ * they land.
+ */
+static int runEnsemble(unsigned count, unsigned seed, double dt)
+{
+    cyclone::ProjectileEnsemble::Setup setup;
+    setup.minVelocity = cyclone::Vector3(0, 20, 30);
+    setup.maxVelocity = cyclone::Vector3(0, 40, 50);
+    setup.minMass = 1;
+    setup.maxMass = 200;
+    setup.minDamping = 0.9f;
+    setup.maxDamping = 0.99f;
+    setup.acceleration = cyclone::Vector3(0, -20, 0);
+    setup.k1 = 0.1f;
+    setup.k2 = 0.01f;
+
+    cyclone::ProjectileEnsemble ensemble;
+    ensemble.launch(setup, count, seed);
+
+    unsigned long long begin = cyclone::getTimeNanoseconds();
+    ensemble.run((cyclone::real)dt);
+    double seconds = (cyclone::getTimeNanoseconds() - begin) * 1e-9;
+
+    cyclone::ProjectileEnsemble::Stats stats;
+    ensemble.getStats(stats, 10, setup.maxRange);
+
+    printf("worlds:          %u\n", stats.worlds);
+    printf("wall time:       %.3f s\n", seconds);
+    printf("worlds/sec:      %.0f\n", seconds > 0 ? stats.worlds / seconds : 0.0);
+    printf("landed:          %u (%u expired, %u out of range)\n",
+           stats.landed, stats.expired, stats.outOfRange);
+    printf("distance:        %.2f +- %.2f (%.2f to %.2f)\n", stats.meanDistance,
+           stats.deviation, stats.minDistance, stats.maxDistance);
+    printf("flight time:     %.3f s\n", stats.meanFlightTime);
+
+    unsigned most = 1;
+    for (unsigned i = 0; i < stats.histogram.size(); i++)
+    {
+        if (stats.histogram[i] > most) most = stats.histogram[i];
+    }
+
+    printf("\n");
+    const double width = stats.histogramRange / stats.histogram.size();
+    for (unsigned i = 0; i < stats.histogram.size(); i++)
+    {
+        std::string bar((size_t)(stats.histogram[i] * 50.0 / most), '#');
+        printf("%6.0f - %-6.0f %9u %s\n", i * width, (i + 1) * width,
+               stats.histogram[i], bar.c_str());
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = "fireworks";
+    unsigned steps = 1000;
+    double dt = 0.016;
+    ScenarioOptions options;
+    bool profile = false;
+    const char *trace = NULL;
+    const char *restore = NULL;
+    const char *save = NULL;
+    const char *record = NULL;
+    double replicate = -1;
+    const char *exportName = NULL;
+    bool render = false;
+    const char *rules = NULL;
+    unsigned reorder = 0;
+    unsigned ensemble = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+        {
+            usage();
+            return 0;
+        }
+        if (strcmp(arg, "--profile") == 0)
+        {
+            profile = true;
+            continue;
+        }
+        if (strcmp(arg, "--render") == 0)
+        {
+            render = true;
+            continue;
+        }
+        if (strcmp(arg, "--shuffle") == 0)
+        {
+            options.shuffle = true;
+            continue;
+        }
+        if (strcmp(arg, "--multirate") == 0)
+        {
+            options.multiRate = true;
+            continue;
+        }
+        if (strcmp(arg, "--deterministic") == 0)
+        {
+            options.deterministic = true;
+            continue;
+        }
+        if (value == NULL)
+        {
+            usage();
+            return 1;
+        }
+
+        if (strcmp(arg, "--scenario") == 0) name = value;
+        else if (strcmp(arg, "--steps") == 0) steps = (unsigned)atoi(value);
+        else if (strcmp(arg, "--dt") == 0) dt = atof(value);
+        else if (strcmp(arg, "--capacity") == 0) options.capacity = (unsigned)atoi(value);
+        else if (strcmp(arg, "--seed") == 0) options.seed = (unsigned)atoi(value);
+        else if (strcmp(arg, "--workers") == 0) cyclone::setWorkerCount((unsigned)atoi(value));
+        else if (strcmp(arg, "--interval") == 0) options.interval = (unsigned)atoi(value);
+        else if (strcmp(arg, "--burst") == 0) options.burst = (unsigned)atoi(value);
+        else if (strcmp(arg, "--adaptive") == 0) options.tolerance = (cyclone::real)atof(value);
+        else if (strcmp(arg, "--forces") == 0)
+        {
+            if (strcmp(value, "serial") == 0) options.accumulation = cyclone::ParticleForceRegistry::SERIAL;
+            else if (strcmp(value, "coloured") == 0) options.accumulation = cyclone::ParticleForceRegistry::COLOURED;
+            else if (strcmp(value, "buffered") == 0) options.accumulation = cyclone::ParticleForceRegistry::BUFFERED;
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--rules") == 0) rules = value;
+        else if (strcmp(arg, "--reorder") == 0) reorder = (unsigned)atoi(value);
+        else if (strcmp(arg, "--trace") == 0) trace = value;
+        else if (strcmp(arg, "--restore") == 0) restore = value;
+        else if (strcmp(arg, "--save") == 0) save = value;
+        else if (strcmp(arg, "--record") == 0) record = value;
+        else if (strcmp(arg, "--replicate") == 0) replicate = atof(value);
+        else if (strcmp(arg, "--export") == 0) exportName = value;
+        else if (strcmp(arg, "--ensemble") == 0) ensemble = (unsigned)atoi(value);
+        else
+        {
+            usage();
+            return 1;
+        }
+        i++;
+    }
+
+    if (dt <= 0 || options.capacity == 0 || options.seed == 0 || options.interval == 0)
+    {
+        usage();
+        return 1;
+    }
+
+    if (ensemble > 0) return runEnsemble(ensemble, options.seed, dt);
+
+    Scenario *scenario = createScenario(name, options);
+    if (scenario == NULL)
+    {
+        fprintf(stderr, "cyclone-sim: unknown scenario '%s'\n", name);
+        usage();
+        return 1;
+    }
+
+    std::string error;
+    if (rules && !scenario->loadRules(rules, &error))
+    {
+        fprintf(stderr, "cyclone-sim: can't load rules '%s': %s\n", rules, error.c_str());
+        delete scenario;
+        return 1;
+    }
+
+    cyclone::Snapshot snapshot;
+    if ((restore || save) && !scenario->describe(snapshot))
+    {
+        fprintf(stderr, "cyclone-sim: scenario '%s' doesn't support snapshots\n", name);
+        delete scenario;
+        return 1;
+    }
+    if (restore)
+    {
+        unsigned long long begin = cyclone::getTimeNanoseconds();
+        if (!snapshot.load(restore))
+        {
+            fprintf(stderr, "cyclone-sim: can't restore '%s'\n", restore);
+            delete scenario;
+            return 1;
+        }
+        printf("restored:        %s in %.3f ms\n", restore,
+               (cyclone::getTimeNanoseconds() - begin) * 1e-6);
+    }
+
+    cyclone::TrajectoryRecorder recorder;
+    std::vector<const cyclone::Particle*> recorded;
+    if (record)
+    {
+        if (!recorder.open(record, cyclone::TRAJECTORY_POSITION | cyclone::TRAJECTORY_VELOCITY))
+        {
+            fprintf(stderr, "cyclone-sim: can't write '%s'\n", record);
+            delete scenario;
+            return 1;
+        }
+        scenario->getParticles(recorded);
+    }
+
+    cyclone::ReplicationEncoder encoder;
+    cyclone::ReplicationDecoder decoder;
+    cyclone::LoopbackTransport server, observer;
+    cyclone::LoopbackTransport::connect(server, observer);
+    server.setLossRate((cyclone::real)replicate, options.seed);
+    std::vector<const cyclone::Particle*> replicated;
+    if (replicate >= 0) scenario->getParticles(replicated);
+
+    cyclone::SharedStateWriter exporter;
+    std::vector<const cyclone::Particle*> exported;
+    if (exportName)
+    {
+        scenario->getParticles(exported);
+        if (!exporter.open(exportName, (unsigned)exported.size()))
+        {
+            fprintf(stderr, "cyclone-sim: can't create shared memory '%s'\n", exportName);
+            delete scenario;
+            return 1;
+        }
+    }
+
+    cyclone::RenderExtractor extractor;
+    cyclone::RenderBuffer rendered;
+    std::vector<const cyclone::Particle*> renderParticles;
+    std::vector<unsigned> renderTypes;
+    if (render)
+    {
+        scenario->setupRender(extractor);
+        scenario->getParticles(renderParticles);
+    }
+
+    unsigned long long replicatedBytes = 0;
+    unsigned long long replicatedFrames = 0;
+
+    unsigned reorders = 0;
+
+    unsigned long long particleSteps = 0;
+    unsigned peak = 0;
+
+    cyclone::Profiler::setEnabled(profile);
+    cyclone::Profiler::reset();
+
+    if (trace && !cyclone::Trace::start(trace))
+    {
+        fprintf(stderr, "cyclone-sim: can't write trace '%s'\n", trace);
+        delete scenario;
+        return 1;
+    }
+
+    unsigned long long start = cyclone::getTimeNanoseconds();
+    for (unsigned i = 0; i < steps; i++)
+    {
+        {
+            CYCLONE_PROFILE_SCOPE("step");
+            scenario->step((cyclone::real)dt);
+        }
+
+        // particles that moved in memory have to be listed again.
+        if (reorder > 0 && (i + 1) % reorder == 0 && scenario->reorder(0.05f))
+        {
+            reorders++;
+            if (save) scenario->describe(snapshot);
+            if (record) scenario->getParticles(recorded);
+            if (exportName) scenario->getParticles(exported);
+            if (replicate >= 0) scenario->getParticles(replicated);
+            if (render) scenario->getParticles(renderParticles);
+        }
+
+        if (record)
+        {
+            CYCLONE_PROFILE_SCOPE("record");
+            recorder.record((i + 1) * dt, recorded.data(), (unsigned)recorded.size());
+        }
+
+        if (exportName)
+        {
+            CYCLONE_PROFILE_SCOPE("export");
+            exporter.publish(exported.data(), (unsigned)exported.size(), (i + 1) * dt);
+        }
+
+        if (render)
+        {
+            scenario->getTypes(renderTypes);
+            extractor.extract(renderParticles.data(), renderTypes.data(),
+                              (unsigned)renderParticles.size(), rendered);
+        }
+
+        if (replicate >= 0)
+        {
+            CYCLONE_PROFILE_SCOPE("replicate");
+            cyclone::ReplicationPackets packets;
+            encoder.encode(replicated.data(), (unsigned)replicated.size(), packets);
+            for (unsigned p = 0; p < packets.size(); p++)
+            {
+                server.send(packets[p].data(), (unsigned)packets[p].size());
+                replicatedBytes += packets[p].size();
+            }
+
+            cyclone::ReplicationPacket packet;
+            while (observer.receive(packet))
+            {
+                if (!decoder.receive(packet.data(), (unsigned)packet.size())) continue;
+
+                replicatedFrames++;
+                decoder.acknowledge(packet);
+                observer.send(packet.data(), (unsigned)packet.size());
+            }
+            while (server.receive(packet)) encoder.receive(packet.data(), (unsigned)packet.size());
+        }
+
+        unsigned live = scenario->getLiveCount();
+        particleSteps += live;
+        if (live > peak) peak = live;
+
+        if (profile) cyclone::Profiler::endFrame();
+    }
+    unsigned long long stop = cyclone::getTimeNanoseconds();
+
+    if (record)
+    {
+        if (!recorder.close())
+        {
+            fprintf(stderr, "cyclone-sim: writing '%s' failed\n", record);
+        }
+        if (recorder.getStallCount() > 0)
+        {
+            fprintf(stderr, "cyclone-sim: recording stalled %llu times\n", recorder.getStallCount());
+        }
+    }
+
+    if (trace)
+    {
+        cyclone::Trace::stop();
+        if (cyclone::Trace::getDroppedCount() > 0)
+        {
+            fprintf(stderr, "cyclone-sim: trace dropped %llu scopes\n",
+                    cyclone::Trace::getDroppedCount());
+        }
+    }
+
+    double seconds = (stop - start) * 1e-9;
+    if (seconds <= 0) seconds = 1e-9;
+
+    printf("scenario:        %s\n", scenario->getName());
+    printf("steps:           %u\n", steps);
+    printf("dt:              %g\n", dt);
+    printf("seconds:         %.6f\n", seconds);
+    printf("steps/sec:       %.1f\n", steps / seconds);
+    printf("particles/sec:   %.1f\n", particleSteps / seconds);
+    printf("peak particles:  %u\n", peak);
+    printf("final particles: %u\n", scenario->getLiveCount());
+    printf("checksum:        %016llx\n", scenario->checksum());
+    if (reorder > 0) printf("reorders:        %u\n", reorders);
+
+    const cyclone::AdaptiveStepper *stepper = scenario->getStepper();
+    if (stepper)
+    {
+        printf("substeps:        %u (%u rejected)\n", stepper->getSubstepCount(), stepper->getRejectedCount());
+        printf("largest error:   %g\n", stepper->getLargestError());
+    }
+
+    if (render)
+    {
+        printf("render vertices: %u\n", rendered.vertexCount);
+        printf("render checksum: %016llx\n", rendered.checksum());
+    }
+
+    if (replicate >= 0)
+    {
+        // the observer's view of the last frame it completed.
+        double worst = 0;
+        const std::vector<cyclone::Vector3> &positions = decoder.getPositions();
+        for (unsigned i = 0; i < positions.size() && decoder.getSequence() == steps; i++)
+        {
+            cyclone::Vector3 error = positions[i] - replicated[i]->getPosition();
+            double e = fabs(error.x) + fabs(error.y) + fabs(error.z);
+            if (e > worst) worst = e;
+        }
+
+        printf("replicated:      %llu of %u frames, %.1f bytes/frame (raw %u)\n",
+               replicatedFrames, steps, (double)replicatedBytes / (steps > 0 ? steps : 1),
+               (unsigned)(replicated.size() * 2 * sizeof(cyclone::Vector3)));
+        if (decoder.getSequence() == steps) printf("replica error:   %g\n", worst);
+    }
+
+    if (save)
+    {
+        unsigned long long begin = cyclone::getTimeNanoseconds();
+        if (!snapshot.save(save))
+        {
+            fprintf(stderr, "cyclone-sim: can't save '%s'\n", save);
+            delete scenario;
+            return 1;
+        }
+        printf("saved:           %s in %.3f ms\n", save,
+               (cyclone::getTimeNanoseconds() - begin) * 1e-6);
+
+        // the file has to bring a fresh scenario back to the same state.
+        Scenario *check = createScenario(name, options);
+        cyclone::Snapshot restored;
+        bool same = (!rules || check->loadRules(rules, NULL)) && check->describe(restored) &&
+                    restored.load(save) && check->checksum() == scenario->checksum();
+        delete check;
+        if (!same)
+        {
+            fprintf(stderr, "cyclone-sim: '%s' doesn't restore to the saved state\n", save);
+            delete scenario;
+            return 1;
+        }
+    }
+
+    if (profile)
+    {
+        std::vector<cyclone::ProfileStats> stats;
+        cyclone::Profiler::getStats(stats);
+
+        if (stats.empty())
+        {
+            printf("\nno profiled sections, build with -DCYCLONE_PROFILE\n");
+        }
+        else
+        {
+            printf("\n%-28s %12s %14s %14s %14s\n",
+                   "section", "calls/step", "avg ms/step", "worst ms/step", "total ms");
+            for (unsigned i = 0; i < stats.size(); i++)
+            {
+                const cyclone::ProfileStats &s = stats[i];
+                printf("%-28s %12.1f %14.4f %14.4f %14.3f\n", s.name, s.averageCalls,
+                       s.averageFrameMilliseconds, s.worstFrameMilliseconds,
+                       s.averageFrameMilliseconds * steps);
+            }
+        }
+
+        std::vector<cyclone::ParticleForceStats> forces;
+        if (scenario->getRegistry()) scenario->getRegistry()->getStats(forces);
+
+        if (!forces.empty())
+        {
+            printf("\n%-40s %12s %15s %12s %14s %14s\n",
+                   "force generator", "calls/step", "particles/step", "ns/call", "ms/step", "worst run ms");
+            for (unsigned i = 0; i < forces.size(); i++)
+            {
+                const cyclone::ParticleForceStats &s = forces[i];
+                std::string label = std::string(s.registry) + "/" + s.type;
+                printf("%-40s %12.1f %15.1f %12.2f %14.4f %14.4f\n", label.c_str(),
+                       (double)s.calls / steps, (double)s.particles / steps,
+                       s.calls > 0 ? (double)s.nanoseconds / s.calls : 0.0,
+                       s.nanoseconds * 1e-6 / steps, s.maxNanoseconds * 1e-6);
+            }
+        }
+    }
+
+    delete scenario;
+    return 0;
+}
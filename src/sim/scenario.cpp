@@ -0,0 +1,509 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <cyclone/profile.h>
+#include "scenario.h"
+#include "../demos/fireworks/fireworksystem.h"
+#include "../demos/ballistic/ballisticrange.h"
+
+unsigned long long hashParticle(unsigned long long hash, const cyclone::Particle &particle)
+{
+    cyclone::real values[6];
+    cyclone::Vector3 position = particle.getPosition();
+    cyclone::Vector3 velocity = particle.getVelocity();
+    values[0] = position.x; values[1] = position.y; values[2] = position.z;
+    values[3] = velocity.x; values[4] = velocity.y; values[5] = velocity.z;
+
+    const unsigned char *bytes = (const unsigned char*)values;
+    for (unsigned i = 0; i < sizeof(values); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * The fireworks demo, launching a burst of random fireworks every
+ * interval so the cascade keeps going.
+ */
+class FireworksScenario : public Scenario
+{
+    FireworkSystem fireworks;
+
+    cyclone::Random random;
+
+    ScenarioOptions options;
+
+    unsigned steps;
+
+public:
+    FireworksScenario(const ScenarioOptions &options)
+        : fireworks(options.capacity), options(options), steps(0)
+    {
+        fireworks.seed(options.seed);
+        fireworks.setMultiRate(options.multiRate);
+        random.seed(options.seed);
+    }
+
+    virtual const char* getName() const
+    {
+        return "fireworks";
+    }
+
+    virtual void step(cyclone::real duration)
+    {
+        if (steps % options.interval == 0)
+        {
+            for (unsigned i = 0; i < options.burst; i++)
+            {
+                fireworks.create(random.randomInt(fireworks.getRuleCount()) + 1, 1, NULL);
+            }
+        }
+
+        fireworks.update(duration);
+        steps++;
+    }
+
+    virtual unsigned getLiveCount() const
+    {
+        return fireworks.getLiveCount();
+    }
+
+    virtual void getParticles(std::vector<const cyclone::Particle*> &particles) const
+    {
+        const cyclone::Particle *firework = fireworks.getParticles();
+        particles.resize(fireworks.getMaxFireworks());
+        for (unsigned i = 0; i < particles.size(); i++) particles[i] = firework + i;
+    }
+
+    virtual void getTypes(std::vector<unsigned> &types) const
+    {
+        const unsigned *type = fireworks.getTypes();
+        types.assign(type, type + fireworks.getMaxFireworks());
+    }
+
+    virtual bool loadRules(const char *filename, std::string *error)
+    {
+        return fireworks.loadRules(filename, error);
+    }
+
+    virtual void setupRender(cyclone::RenderExtractor &extractor) const
+    {
+        extractor.setPrimitive(cyclone::RenderExtractor::QUADS, 0.1f, true);
+        fireworks.setColours(extractor);
+    }
+
+    virtual bool describe(cyclone::Snapshot &snapshot)
+    {
+        snapshot.particles.clear();
+        snapshot.particleWords.clear();
+        snapshot.particleReals.clear();
+        snapshot.values.clear();
+        snapshot.randoms.clear();
+        if (!fireworks.describe(snapshot)) return false;
+
+        // the launches go on where they left off.
+        snapshot.values.push_back(&steps);
+        snapshot.randoms.push_back(&random);
+        return true;
+    }
+
+    virtual unsigned long long checksum() const
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        const cyclone::Particle *firework = fireworks.getParticles();
+        const unsigned *types = fireworks.getTypes();
+        for (unsigned i = 0; i < fireworks.getMaxFireworks(); i++)
+        {
+            if (types[i] == 0) continue;
+            hash = hashParticle(hash ^ types[i], firework[i]);
+        }
+        return hash;
+    }
+};
+
+/**
+ * The ballistic demo, firing a salvo cycling through the shot types every
+ * interval.
+ */
+class BallisticScenario : public Scenario
+{
+    BallisticRange range;
+
+    ScenarioOptions options;
+
+    unsigned steps;
+
+    unsigned nextType;
+
+public:
+    BallisticScenario(const ScenarioOptions &options)
+        : range(options.capacity), options(options), steps(0), nextType(0)
+    {
+    }
+
+    virtual const char* getName() const
+    {
+        return "ballistic";
+    }
+
+    virtual void step(cyclone::real duration)
+    {
+        if (steps % options.interval == 0)
+        {
+            for (unsigned i = 0; i < options.burst; i++)
+            {
+                BallisticRange::ShotType type = (BallisticRange::ShotType)(BallisticRange::PISTOL + nextType);
+                if (!range.fire(type)) break;
+                nextType = (nextType + 1) % 4;
+            }
+        }
+
+        range.update(duration);
+        steps++;
+    }
+
+    virtual unsigned getLiveCount() const
+    {
+        return range.getLiveCount();
+    }
+
+    virtual void getParticles(std::vector<const cyclone::Particle*> &particles) const
+    {
+        const BallisticRange::AmmoRound *shot = range.getRounds();
+        particles.resize(range.getRoundCount());
+        for (unsigned i = 0; i < particles.size(); i++) particles[i] = &shot[i].particle;
+    }
+
+    virtual void getTypes(std::vector<unsigned> &types) const
+    {
+        const BallisticRange::AmmoRound *shot = range.getRounds();
+        types.resize(range.getRoundCount());
+        for (unsigned i = 0; i < types.size(); i++) types[i] = shot[i].type;
+    }
+
+    virtual void setupRender(cyclone::RenderExtractor &extractor) const
+    {
+        extractor.setPrimitive(cyclone::RenderExtractor::QUADS, 0.3f);
+        for (unsigned type = BallisticRange::PISTOL; type <= BallisticRange::LASER; type++)
+        {
+            extractor.setColour(type, 0, 0, 0);
+        }
+    }
+
+    virtual unsigned long long checksum() const
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        const BallisticRange::AmmoRound *shot = range.getRounds();
+        for (unsigned i = 0; i < range.getRoundCount(); i++, shot++)
+        {
+            if (shot->type == BallisticRange::UNUSED) continue;
+            hash = hashParticle(hash ^ shot->type, shot->particle);
+        }
+        return hash;
+    }
+};
+
+/** Most particles in each band of rows the spring mesh's step is split into. */
+static const unsigned meshBandSize = 4096;
+
+/** Fewest bands the spring mesh is split into, when it has enough rows. */
+static const unsigned meshBands = 8;
+
+/**
+ * A square sheet of particles joined by springs to their neighbours,
+ * hanging from its top row under gravity.
+ */
+class SpringMeshScenario : public Scenario
+{
+    /** The sheet's particles, each with its place in the sheet as an id. */
+    cyclone::ParticleStore store;
+    cyclone::ParticleStore::Column idColumn;
+
+    std::vector<cyclone::ParticleSpring*> springs;
+
+    cyclone::ParticleGravity gravity;
+
+    cyclone::ParticleForceRegistry registry;
+
+    cyclone::MortonReorder reorderer;
+
+    cyclone::AdaptiveStepper stepper;
+
+    bool adaptive;
+
+    /**
+     * The step as a graph of tasks, with the sheet split into bands of
+     * rows. Each band has a task for the forces on its particles and one
+     * that integrates them, which waits only for the forces of its own
+     * band and the bands either side, whose springs read its positions.
+     */
+    cyclone::TaskGraph graph;
+
+    unsigned side;
+    unsigned bandRows;
+
+    /** The registrations that push each band's particles, in order. */
+    std::vector<std::vector<unsigned> > bandRegistrations;
+
+    /** The slots each band's particles are stored in. */
+    std::vector<std::vector<unsigned> > bandSlots;
+
+    bool partitioned;
+
+    /** The duration of the step the graph is running. */
+    cyclone::real stepDuration;
+
+    void connect(unsigned a, unsigned b, cyclone::real restLength)
+    {
+        cyclone::Particle *particles = store.getParticles();
+
+        // a spring only pushes the particle it is registered with, so each
+        // link needs one in each direction.
+        cyclone::ParticleSpring *spring = new cyclone::ParticleSpring(&particles[b], 40.0f, restLength);
+        springs.push_back(spring);
+        registry.add(&particles[a], spring);
+
+        spring = new cyclone::ParticleSpring(&particles[a], 40.0f, restLength);
+        springs.push_back(spring);
+        registry.add(&particles[b], spring);
+    }
+
+    unsigned getBand(unsigned id) const
+    {
+        return id / side / bandRows;
+    }
+
+    /** Sorts the registrations and slots into bands. */
+    void partition()
+    {
+        for (unsigned band = 0; band < bandSlots.size(); band++)
+        {
+            bandRegistrations[band].clear();
+            bandSlots[band].clear();
+        }
+
+        cyclone::AttributeView<unsigned> ids = store.getView<unsigned>(idColumn);
+        const cyclone::Particle *particles = store.getParticles();
+        for (unsigned i = 0; i < registry.getRegistrationCount(); i++)
+        {
+            unsigned slot = (unsigned)(registry.getParticle(i) - particles);
+            bandRegistrations[getBand(ids[slot])].push_back(i);
+        }
+        for (unsigned slot = 0; slot < store.getSize(); slot++)
+        {
+            bandSlots[getBand(ids[slot])].push_back(slot);
+        }
+        partitioned = true;
+    }
+
+    /** Lists the particles in id order. */
+    void getSheet(std::vector<const cyclone::Particle*> &sheet) const
+    {
+        cyclone::AttributeView<const unsigned> ids = store.getView<unsigned>(idColumn);
+        sheet.resize(store.getSize());
+        for (unsigned i = 0; i < store.getSize(); i++) sheet[ids[i]] = &store.getParticle(i);
+    }
+
+public:
+    SpringMeshScenario(const ScenarioOptions &options)
+        : gravity(cyclone::Vector3::GRAVITY), registry("springmesh"), reorderer(0.5f),
+          stepper(options.tolerance), adaptive(options.tolerance > 0), partitioned(false), stepDuration(0)
+    {
+        side = (unsigned)sqrt((double)options.capacity);
+        if (side < 2) side = 2;
+
+        const cyclone::real spacing = 0.5f;
+        store.resize(side * side);
+        idColumn = store.addColumn<unsigned>("id", 0);
+
+        // the slot each point of the sheet is stored in.
+        std::vector<unsigned> slots(side * side);
+        for (unsigned i = 0; i < slots.size(); i++) slots[i] = i;
+        if (options.shuffle)
+        {
+            cyclone::Random random;
+            random.seed(options.seed);
+            for (unsigned i = (unsigned)slots.size() - 1; i > 0; i--)
+            {
+                unsigned j = random.randomInt(i + 1);
+                unsigned slot = slots[i];
+                slots[i] = slots[j];
+                slots[j] = slot;
+            }
+        }
+
+        cyclone::AttributeView<unsigned> ids = store.getView<unsigned>(idColumn);
+        for (unsigned y = 0; y < side; y++)
+        {
+            for (unsigned x = 0; x < side; x++)
+            {
+                unsigned slot = slots[y * side + x];
+                ids[slot] = y * side + x;
+
+                cyclone::Particle &particle = store.getParticle(slot);
+                particle.setPosition(x * spacing, -(cyclone::real)y * spacing, 0);
+                particle.setMass(1);
+                particle.setDamping(0.9f);
+
+                // the top row is pinned in place.
+                if (y == 0) particle.setInverseMass(0);
+                else registry.add(&particle, &gravity);
+
+                if (x > 0) connect(slot, slots[y * side + x - 1], spacing);
+                if (y > 0) connect(slot, slots[(y - 1) * side + x], spacing);
+            }
+        }
+
+        registry.setAccumulation(options.accumulation);
+        registry.setDeterministic(options.deterministic);
+
+        // enough bands for every worker to have some, even on a small sheet.
+        bandRows = (side + meshBands - 1) / meshBands;
+        if (bandRows > meshBandSize / side) bandRows = meshBandSize / side;
+        if (bandRows < 1) bandRows = 1;
+        const unsigned bands = (side + bandRows - 1) / bandRows;
+        bandRegistrations.resize(bands);
+        bandSlots.resize(bands);
+
+        for (unsigned band = 0; band < bands; band++)
+        {
+            graph.addTask("forces/springmesh", band, band + 1, 1, [this](unsigned first, unsigned) {
+                CYCLONE_PROFILE_SCOPE("forces/springmesh");
+                const std::vector<unsigned> &indices = bandRegistrations[first];
+                registry.updateForces(indices.data(), (unsigned)indices.size(), stepDuration);
+            });
+        }
+        for (unsigned band = 0; band < bands; band++)
+        {
+            unsigned task = graph.addTask("integrate/springmesh", band, band + 1, 1, [this](unsigned first, unsigned) {
+                CYCLONE_PROFILE_SCOPE("integrate/springmesh");
+                cyclone::Particle *particles = store.getParticles();
+                const std::vector<unsigned> &slots = bandSlots[first];
+                for (unsigned i = 0; i < slots.size(); i++)
+                {
+                    particles[slots[i]].integrate(stepDuration);
+                }
+            });
+
+            for (unsigned other = band > 0 ? band - 1 : 0; other <= band + 1 && other < bands; other++)
+            {
+                graph.addDependency(other, task);
+            }
+        }
+    }
+
+    ~SpringMeshScenario()
+    {
+        for (unsigned i = 0; i < springs.size(); i++) delete springs[i];
+    }
+
+    virtual const char* getName() const
+    {
+        return "springmesh";
+    }
+
+    virtual void step(cyclone::real duration)
+    {
+        if (adaptive)
+        {
+            stepper.advance(store.getParticles(), store.getSize(), registry, duration);
+            return;
+        }
+
+        // the whole registry at once, added up however it was asked to.
+        if (registry.getAccumulation() != cyclone::ParticleForceRegistry::SERIAL)
+        {
+            registry.updateForces(duration);
+
+            CYCLONE_PROFILE_SCOPE("integrate/springmesh");
+            cyclone::Particle *particles = store.getParticles();
+            cyclone::parallelFor(0, store.getSize(), meshBandSize, [&](unsigned begin, unsigned end) {
+                for (unsigned i = begin; i < end; i++) particles[i].integrate(duration);
+            });
+            return;
+        }
+
+        if (!partitioned) partition();
+
+        stepDuration = duration;
+        graph.run();
+    }
+
+    virtual unsigned getLiveCount() const
+    {
+        return store.getSize();
+    }
+
+    virtual void getParticles(std::vector<const cyclone::Particle*> &particles) const
+    {
+        getSheet(particles);
+    }
+
+    virtual bool reorder(cyclone::real threshold)
+    {
+        if (!reorderer.reorder(store, threshold)) return false;
+
+        // the springs are remapped through the registry they're in.
+        registry.remapParticles(reorderer.getRemap());
+        partitioned = false;
+        return true;
+    }
+
+    virtual const cyclone::ParticleForceRegistry* getRegistry() const
+    {
+        return &registry;
+    }
+
+    virtual const cyclone::AdaptiveStepper* getStepper() const
+    {
+        return adaptive ? &stepper : NULL;
+    }
+
+    virtual bool describe(cyclone::Snapshot &snapshot)
+    {
+        std::vector<const cyclone::Particle*> sheet;
+        getSheet(sheet);
+
+        snapshot.particles.clear();
+        for (unsigned i = 0; i < sheet.size(); i++)
+        {
+            snapshot.particles.push_back(const_cast<cyclone::Particle*>(sheet[i]));
+        }
+
+        // a restore replaces the registrations.
+        partitioned = false;
+
+        snapshot.registry = &registry;
+        snapshot.generators.assign(1, &gravity);
+        snapshot.generators.insert(snapshot.generators.end(), springs.begin(), springs.end());
+        return true;
+    }
+
+    virtual unsigned long long checksum() const
+    {
+        std::vector<const cyclone::Particle*> sheet;
+        getSheet(sheet);
+
+        unsigned long long hash = 14695981039346656037ULL;
+        for (unsigned i = 0; i < sheet.size(); i++)
+        {
+            hash = hashParticle(hash, *sheet[i]);
+        }
+        return hash;
+    }
+};
+
+Scenario* createScenario(const char *name, const ScenarioOptions &options)
+{
+    if (strcmp(name, "fireworks") == 0) return new FireworksScenario(options);
+    if (strcmp(name, "ballistic") == 0) return new BallisticScenario(options);
+    if (strcmp(name, "springmesh") == 0) return new SpringMeshScenario(options);
+    return NULL;
+}
+
+const char* getScenarioNames()
+{
+    return "fireworks ballistic springmesh";
+}
@@ -0,0 +1,161 @@
+#ifndef CYCLONE_SIM_SCENARIO_H
+#define CYCLONE_SIM_SCENARIO_H
+
+#include <string>
+#include <cyclone/cyclone.h>
+
+/**
+ * Options shared by every headless scenario.
+ */
+struct ScenarioOptions
+{
+    /** Number of particle slots. */
+    unsigned capacity;
+
+    /** Seed for the scenario's random numbers, never zero. */
+    unsigned seed;
+
+    /** Number of steps between launches or salvos. */
+    unsigned interval;
+
+    /** Number of rounds fired or fireworks launched at a time. */
+    unsigned burst;
+
+    /**
+     * Stores particles in a random order rather than the order they are
+     * laid out in, as happens to a world that has run for a while.
+     */
+    bool shuffle;
+
+    /**
+     * Updates particles whose rules allow it less often than every
+     * step.
+     */
+    bool multiRate;
+
+    /**
+     * Largest error allowed in a substep, for scenarios that can split
+     * their steps adaptively. Zero takes every step whole.
+     */
+    cyclone::real tolerance;
+
+    /**
+     * How the spring mesh adds up forces across threads. Serial keeps
+     * its step graph, whose bands each push only their own particles.
+     */
+    cyclone::ParticleForceRegistry::Accumulation accumulation;
+
+    /** Adds buffered forces up the same way on any number of threads. */
+    bool deterministic;
+
+    ScenarioOptions()
+        : capacity(1024), seed(1), interval(30), burst(4), shuffle(false), multiRate(false),
+          tolerance(0), accumulation(cyclone::ParticleForceRegistry::SERIAL), deterministic(false)
+    {
+    }
+};
+
+/**
+ * A simulation that can be stepped without a window, used by the
+ * headless runner and the benchmarks.
+ */
+class Scenario
+{
+public:
+    virtual ~Scenario() {}
+
+    virtual const char* getName() const = 0;
+
+    /** Advances the simulation by one fixed step. */
+    virtual void step(cyclone::real duration) = 0;
+
+    /** Number of particles currently simulated. */
+    virtual unsigned getLiveCount() const = 0;
+
+    /**
+     * Hashes the state of every live particle, so runs can be compared
+     * bit for bit across builds and machines.
+     */
+    virtual unsigned long long checksum() const = 0;
+
+    /**
+     * Lists every particle slot, live or not, in an order that stays the
+     * same from step to step.
+     */
+    virtual void getParticles(std::vector<const cyclone::Particle*> &particles) const = 0;
+
+    /**
+     * Lists the render type of each slot given by getParticles, zero for
+     * a slot that isn't in use. Every slot is in use unless a scenario
+     * says otherwise.
+     */
+    virtual void getTypes(std::vector<unsigned> &types) const
+    {
+        std::vector<const cyclone::Particle*> particles;
+        getParticles(particles);
+        types.assign(particles.size(), 1);
+    }
+
+    /**
+     * Replaces the scenario's effect rules with those in the given file.
+     * Returns false, describing why, if it has no rules or the file
+     * can't be compiled.
+     */
+    virtual bool loadRules(const char *, std::string *error)
+    {
+        if (error) *error = "the scenario has no rules";
+        return false;
+    }
+
+    /** Sets the shape and colours the scenario is drawn with. */
+    virtual void setupRender(cyclone::RenderExtractor &) const
+    {
+    }
+
+    /**
+     * Points the snapshot at the scenario's particles, registry,
+     * generators, random number generators and whatever else it needs
+     * to carry on. Returns false if the scenario can't be snapshotted.
+     */
+    virtual bool describe(cyclone::Snapshot &)
+    {
+        return false;
+    }
+
+    /**
+     * Puts the particles back in spatial order if they've drifted
+     * further out of it than the threshold, a fraction from zero to
+     * about a half. Returns true if they moved, after which the
+     * particles must be listed again.
+     */
+    virtual bool reorder(cyclone::real)
+    {
+        return false;
+    }
+
+    /** The scenario's force registry, if it has one. */
+    virtual const cyclone::ParticleForceRegistry* getRegistry() const
+    {
+        return NULL;
+    }
+
+    /** The scenario's adaptive stepper, if it is splitting its steps. */
+    virtual const cyclone::AdaptiveStepper* getStepper() const
+    {
+        return NULL;
+    }
+};
+
+/**
+ * Creates the named scenario, or returns NULL if there is no such
+ * scenario.
+ */
+Scenario* createScenario(const char *name, const ScenarioOptions &options);
+
+/** Returns the names of the scenarios, separated by spaces. */
+const char* getScenarioNames();
+
+/** Adds the position and velocity of a particle to an FNV-1a hash. */
+unsigned long long hashParticle(unsigned long long hash, const cyclone::Particle &particle);
+
+#endif
@@ -0,0 +1,589 @@
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cyclone/snapshot.h>
+
+#if (__APPLE__ || __unix)
+    #define SNAPSHOT_MMAP 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace cyclone;
+
+static const char snapshotMagic[8] = {'C', 'Y', 'C', 'L', 'S', 'N', 'A', 'P'};
+static const unsigned headerSize = 64;
+static const unsigned directoryEntrySize = 24;
+static const unsigned columnAlignment = 64;
+
+static bool isLittleEndian()
+{
+    unsigned one = 1;
+    return *(unsigned char*)&one == 1;
+}
+
+static void putU32(unsigned char *out, unsigned value)
+{
+    for (unsigned i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (i * 8));
+}
+
+static void putU64(unsigned char *out, unsigned long long value)
+{
+    for (unsigned i = 0; i < 8; i++) out[i] = (unsigned char)(value >> (i * 8));
+}
+
+static unsigned getU32(const unsigned char *in)
+{
+    unsigned value = 0;
+    for (unsigned i = 0; i < 4; i++) value |= (unsigned)in[i] << (i * 8);
+    return value;
+}
+
+static unsigned long long getU64(const unsigned char *in)
+{
+    unsigned long long value = 0;
+    for (unsigned i = 0; i < 8; i++) value |= (unsigned long long)in[i] << (i * 8);
+    return value;
+}
+
+/**
+ * Reverses the bytes of every word of the given size, to turn native
+ * big-endian data into the file's little-endian order and back.
+ */
+static void swapWords(unsigned char *data, unsigned long long bytes, unsigned wordSize)
+{
+    for (unsigned long long i = 0; i + wordSize <= bytes; i += wordSize)
+    {
+        for (unsigned a = 0, b = wordSize - 1; a < b; a++, b--)
+        {
+            unsigned char t = data[i + a];
+            data[i + a] = data[i + b];
+            data[i + b] = t;
+        }
+    }
+}
+
+/** Reads a real of the file's size, converting to this build's real. */
+static real getReal(const unsigned char *in, unsigned realSize)
+{
+    if (realSize == 4)
+    {
+        unsigned bits = getU32(in);
+        float value;
+        memcpy(&value, &bits, 4);
+        return (real)value;
+    }
+    else
+    {
+        unsigned long long bits = getU64(in);
+        double value;
+        memcpy(&value, &bits, 8);
+        return (real)value;
+    }
+}
+
+SnapshotFile::SnapshotFile()
+    : data(NULL), size(0), mapped(false)
+{
+    close();
+}
+
+SnapshotFile::~SnapshotFile()
+{
+    close();
+}
+
+bool SnapshotFile::open(const char *filename)
+{
+    close();
+
+#if SNAPSHOT_MMAP
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)headerSize)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *address = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) return false;
+
+    // restoring walks every column front to back.
+    madvise(address, (size_t)info.st_size, MADV_SEQUENTIAL);
+    madvise(address, (size_t)info.st_size, MADV_WILLNEED);
+
+    data = (unsigned char*)address;
+    size = (unsigned long long)info.st_size;
+    mapped = true;
+#else
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return false;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (length < (long)headerSize)
+    {
+        fclose(file);
+        return false;
+    }
+
+    data = (unsigned char*)malloc((size_t)length);
+    size = (unsigned long long)length;
+    bool read = data && fread(data, 1, (size_t)length, file) == (size_t)length;
+    fclose(file);
+    if (!read)
+    {
+        close();
+        return false;
+    }
+#endif
+
+    if (!parse())
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool SnapshotFile::parse()
+{
+    if (memcmp(data, snapshotMagic, sizeof(snapshotMagic)) != 0) return false;
+    if (getU32(data + 8) != VERSION) return false;
+
+    realSize = getU32(data + 12);
+    if (realSize != 4 && realSize != 8) return false;
+
+    unsigned columnCount = getU32(data + 16);
+    particleCount = getU64(data + 24);
+    registrationCount = getU64(data + 32);
+    generatorCount = getU64(data + 40);
+    randomCount = getU64(data + 48);
+    valueCount = getU64(data + 56);
+
+    if (headerSize + (unsigned long long)columnCount * directoryEntrySize > size) return false;
+
+    const unsigned char *entry = data + headerSize;
+    for (unsigned i = 0; i < columnCount; i++, entry += directoryEntrySize)
+    {
+        unsigned id = getU32(entry);
+        unsigned elementSize = getU32(entry + 4);
+        unsigned long long offset = getU64(entry + 8);
+        unsigned long long count = getU64(entry + 16);
+
+        // columns from a newer minor revision are skipped.
+        if (id >= COLUMN_COUNT) continue;
+
+        // divided rather than multiplied, so a huge count can't wrap.
+        if (offset > size || (elementSize > 0 && count > (size - offset) / elementSize)) return false;
+
+        unsigned long long expected = particleCount;
+        if (id == VALUE) expected = valueCount;
+        else if (id == RANDOM_STATE) expected = randomCount;
+        else if (id == REGISTRATION_PARTICLE || id == REGISTRATION_GENERATOR) expected = registrationCount;
+        if (count != expected) return false;
+
+        columns[id] = data + offset;
+        elementSizes[id] = elementSize;
+    }
+
+    // the random states' positions index their 17 word buffers, so one
+    // out of range is caught here rather than on the first draw.
+    if (columns[RANDOM_STATE] && elementSizes[RANDOM_STATE] == 19 * 4)
+    {
+        for (unsigned long long i = 0; i < randomCount; i++)
+        {
+            const unsigned char *state = columns[RANDOM_STATE] + i * 19 * 4;
+            if (getU32(state + 17 * 4) >= 17 || getU32(state + 18 * 4) >= 17) return false;
+        }
+    }
+    return true;
+}
+
+void SnapshotFile::close()
+{
+    if (data)
+    {
+#if SNAPSHOT_MMAP
+        if (mapped) munmap(data, (size_t)size);
+#endif
+        if (!mapped) free(data);
+    }
+
+    data = NULL;
+    size = 0;
+    mapped = false;
+    realSize = 0;
+    particleCount = registrationCount = generatorCount = randomCount = valueCount = 0;
+    for (unsigned i = 0; i < COLUMN_COUNT; i++)
+    {
+        columns[i] = NULL;
+        elementSizes[i] = 0;
+    }
+}
+
+unsigned SnapshotFile::getRealSize() const
+{
+    return realSize;
+}
+
+unsigned long long SnapshotFile::getParticleCount() const
+{
+    return particleCount;
+}
+
+unsigned long long SnapshotFile::getRegistrationCount() const
+{
+    return registrationCount;
+}
+
+unsigned long long SnapshotFile::getGeneratorCount() const
+{
+    return generatorCount;
+}
+
+unsigned long long SnapshotFile::getRandomCount() const
+{
+    return randomCount;
+}
+
+unsigned long long SnapshotFile::getValueCount() const
+{
+    return valueCount;
+}
+
+const void* SnapshotFile::getColumn(Column column, unsigned *elementSize) const
+{
+    if (elementSize) *elementSize = elementSizes[column];
+    return columns[column];
+}
+
+Snapshot::Snapshot()
+    : registry(NULL)
+{
+}
+
+namespace
+{
+    /**
+     * Builds the columns of a snapshot one at a time, each in a single
+     * buffer that is written out in one go.
+     */
+    class ColumnWriter
+    {
+        FILE *file;
+        unsigned long long offset;
+        std::vector<unsigned char> directory;
+        std::vector<unsigned char> buffer;
+        bool failed;
+
+    public:
+        ColumnWriter(FILE *file, unsigned columnCount)
+            : file(file), failed(false)
+        {
+            offset = headerSize + columnCount * directoryEntrySize;
+        }
+
+        unsigned char* begin(unsigned long long bytes)
+        {
+            buffer.resize(bytes > 0 ? bytes : 1);
+            return &buffer[0];
+        }
+
+        void end(unsigned id, unsigned elementSize, unsigned long long count, unsigned wordSize)
+        {
+            unsigned long long bytes = count * elementSize;
+            if (!isLittleEndian()) swapWords(&buffer[0], bytes, wordSize);
+
+            unsigned long long aligned = (offset + columnAlignment - 1) / columnAlignment * columnAlignment;
+            static const unsigned char zeros[columnAlignment] = {0};
+            if (aligned > offset && fwrite(zeros, 1, (size_t)(aligned - offset), file) != aligned - offset)
+            {
+                failed = true;
+            }
+            if (bytes > 0 && fwrite(&buffer[0], 1, (size_t)bytes, file) != bytes) failed = true;
+
+            unsigned char entry[directoryEntrySize];
+            putU32(entry, id);
+            putU32(entry + 4, elementSize);
+            putU64(entry + 8, aligned);
+            putU64(entry + 16, count);
+            directory.insert(directory.end(), entry, entry + directoryEntrySize);
+
+            offset = aligned + bytes;
+        }
+
+        const std::vector<unsigned char>& getDirectory() const
+        {
+            return directory;
+        }
+
+        bool hasFailed() const
+        {
+            return failed;
+        }
+    };
+}
+
+bool Snapshot::save(const char *filename) const
+{
+    unsigned long long count = particles.size();
+    unsigned registrationCount = registry ? registry->getRegistrationCount() : 0;
+
+    // registrations refer to the tables by index.
+    std::vector<unsigned> registeredParticles(registrationCount);
+    std::vector<unsigned> registeredGenerators(registrationCount);
+    if (registrationCount > 0)
+    {
+        std::map<const Particle*, unsigned> particleIndex;
+        std::map<const ParticleForceGenerator*, unsigned> generatorIndex;
+        for (unsigned i = 0; i < particles.size(); i++) particleIndex[particles[i]] = i;
+        for (unsigned i = 0; i < generators.size(); i++) generatorIndex[generators[i]] = i;
+
+        for (unsigned i = 0; i < registrationCount; i++)
+        {
+            std::map<const Particle*, unsigned>::iterator p = particleIndex.find(registry->getParticle(i));
+            std::map<const ParticleForceGenerator*, unsigned>::iterator g =
+                generatorIndex.find(registry->getForceGenerator(i));
+            if (p == particleIndex.end() || g == generatorIndex.end()) return false;
+
+            registeredParticles[i] = p->second;
+            registeredGenerators[i] = g->second;
+        }
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) return false;
+
+    const unsigned columnCount = SnapshotFile::COLUMN_COUNT;
+    const unsigned realSize = sizeof(real);
+
+    // the directory is only known at the end, so reserve its space.
+    std::vector<unsigned char> head(headerSize + columnCount * directoryEntrySize, 0);
+    fwrite(&head[0], 1, head.size(), file);
+
+    ColumnWriter writer(file, columnCount);
+
+    for (unsigned column = SnapshotFile::POSITION; column <= SnapshotFile::FORCE_ACCUMULATOR; column++)
+    {
+        real *out = (real*)writer.begin(count * 3 * realSize);
+        for (unsigned i = 0; i < count; i++)
+        {
+            const Particle *particle = particles[i];
+            Vector3 v;
+            switch (column)
+            {
+            case SnapshotFile::POSITION: v = particle->getPosition(); break;
+            case SnapshotFile::VELOCITY: v = particle->getVelocity(); break;
+            case SnapshotFile::ACCELERATION: v = particle->getAcceleration(); break;
+            default: v = particle->getAccumulatedForce(); break;
+            }
+            out[i * 3] = v.x;
+            out[i * 3 + 1] = v.y;
+            out[i * 3 + 2] = v.z;
+        }
+        writer.end(column, 3 * realSize, count, realSize);
+    }
+
+    real *out = (real*)writer.begin(count * realSize);
+    for (unsigned i = 0; i < count; i++) out[i] = particles[i]->getDamping();
+    writer.end(SnapshotFile::DAMPING, realSize, count, realSize);
+
+    out = (real*)writer.begin(count * realSize);
+    for (unsigned i = 0; i < count; i++) out[i] = particles[i]->getInverseMass();
+    writer.end(SnapshotFile::INVERSE_MASS, realSize, count, realSize);
+
+    unsigned char *indices = writer.begin(registrationCount * 4);
+    if (registrationCount > 0) memcpy(indices, &registeredParticles[0], registrationCount * 4);
+    writer.end(SnapshotFile::REGISTRATION_PARTICLE, 4, registrationCount, 4);
+
+    indices = writer.begin(registrationCount * 4);
+    if (registrationCount > 0) memcpy(indices, &registeredGenerators[0], registrationCount * 4);
+    writer.end(SnapshotFile::REGISTRATION_GENERATOR, 4, registrationCount, 4);
+
+    unsigned *words = (unsigned*)writer.begin(randoms.size() * 19 * 4);
+    for (unsigned i = 0; i < randoms.size(); i++)
+    {
+        Random::State state = randoms[i]->getState();
+        memcpy(words + i * 19, state.buffer, 17 * 4);
+        words[i * 19 + 17] = (unsigned)state.p1;
+        words[i * 19 + 18] = (unsigned)state.p2;
+    }
+    writer.end(SnapshotFile::RANDOM_STATE, 19 * 4, randoms.size(), 4);
+
+    const unsigned wordCount = (unsigned)particleWords.size();
+    words = (unsigned*)writer.begin(count * wordCount * 4);
+    for (unsigned i = 0; i < count; i++)
+    {
+        for (unsigned w = 0; w < wordCount; w++) words[i * wordCount + w] = particleWords[w][i];
+    }
+    writer.end(SnapshotFile::PARTICLE_WORDS, wordCount * 4, count, 4);
+
+    const unsigned realCount = (unsigned)particleReals.size();
+    out = (real*)writer.begin(count * realCount * realSize);
+    for (unsigned i = 0; i < count; i++)
+    {
+        for (unsigned r = 0; r < realCount; r++) out[i * realCount + r] = particleReals[r][i];
+    }
+    writer.end(SnapshotFile::PARTICLE_REALS, realCount * realSize, count, realSize);
+
+    words = (unsigned*)writer.begin(values.size() * 4);
+    for (unsigned i = 0; i < values.size(); i++) words[i] = *values[i];
+    writer.end(SnapshotFile::VALUE, 4, values.size(), 4);
+
+    memcpy(&head[0], snapshotMagic, sizeof(snapshotMagic));
+    putU32(&head[8], SnapshotFile::VERSION);
+    putU32(&head[12], realSize);
+    putU32(&head[16], columnCount);
+    putU64(&head[24], count);
+    putU64(&head[32], registrationCount);
+    putU64(&head[40], generators.size());
+    putU64(&head[48], randoms.size());
+    putU64(&head[56], values.size());
+    memcpy(&head[headerSize], &writer.getDirectory()[0], writer.getDirectory().size());
+
+    bool written = !writer.hasFailed() &&
+        fseek(file, 0, SEEK_SET) == 0 &&
+        fwrite(&head[0], 1, head.size(), file) == head.size();
+    if (fclose(file) != 0) written = false;
+
+    if (!written) remove(filename);
+    return written;
+}
+
+bool Snapshot::load(const char *filename)
+{
+    SnapshotFile file;
+    if (!file.open(filename)) return false;
+
+    if (file.getParticleCount() != particles.size() ||
+        file.getRandomCount() != randoms.size() ||
+        file.getGeneratorCount() != generators.size() ||
+        file.getValueCount() != values.size() ||
+        (file.getRegistrationCount() > 0 && registry == NULL))
+    {
+        return false;
+    }
+
+    unsigned realSize = file.getRealSize();
+    const unsigned char *vectors[4];
+    for (unsigned column = SnapshotFile::POSITION; column <= SnapshotFile::FORCE_ACCUMULATOR; column++)
+    {
+        unsigned elementSize;
+        vectors[column] = (const unsigned char*)file.getColumn((SnapshotFile::Column)column, &elementSize);
+        if (vectors[column] == NULL || elementSize != 3 * realSize) return false;
+    }
+
+    unsigned dampingSize, inverseMassSize, particleIndexSize, generatorIndexSize, randomSize;
+    unsigned wordsSize, realsSize, valueSize;
+    const unsigned char *damping = (const unsigned char*)file.getColumn(SnapshotFile::DAMPING, &dampingSize);
+    const unsigned char *inverseMass = (const unsigned char*)file.getColumn(SnapshotFile::INVERSE_MASS, &inverseMassSize);
+    const unsigned char *particleIndex = (const unsigned char*)file.getColumn(SnapshotFile::REGISTRATION_PARTICLE, &particleIndexSize);
+    const unsigned char *generatorIndex = (const unsigned char*)file.getColumn(SnapshotFile::REGISTRATION_GENERATOR, &generatorIndexSize);
+    const unsigned char *random = (const unsigned char*)file.getColumn(SnapshotFile::RANDOM_STATE, &randomSize);
+    const unsigned char *words = (const unsigned char*)file.getColumn(SnapshotFile::PARTICLE_WORDS, &wordsSize);
+    const unsigned char *reals = (const unsigned char*)file.getColumn(SnapshotFile::PARTICLE_REALS, &realsSize);
+    const unsigned char *value = (const unsigned char*)file.getColumn(SnapshotFile::VALUE, &valueSize);
+    const unsigned wordCount = (unsigned)particleWords.size();
+    const unsigned realCount = (unsigned)particleReals.size();
+
+    if (damping == NULL || dampingSize != realSize ||
+        inverseMass == NULL || inverseMassSize != realSize ||
+        (file.getRegistrationCount() > 0 &&
+            (particleIndex == NULL || particleIndexSize != 4 ||
+             generatorIndex == NULL || generatorIndexSize != 4)) ||
+        (file.getRandomCount() > 0 && (random == NULL || randomSize != 19 * 4)) ||
+        (wordCount > 0 && (words == NULL || wordsSize != wordCount * 4)) ||
+        (realCount > 0 && (reals == NULL || realsSize != realCount * realSize)) ||
+        (values.size() > 0 && (value == NULL || valueSize != 4)))
+    {
+        return false;
+    }
+
+    unsigned registrationCount = (unsigned)file.getRegistrationCount();
+    for (unsigned i = 0; i < registrationCount; i++)
+    {
+        if (getU32(particleIndex + i * 4) >= particles.size() ||
+            getU32(generatorIndex + i * 4) >= generators.size())
+        {
+            return false;
+        }
+    }
+
+    // everything is checked, so from here on the state is overwritten.
+    // Particles are stored as objects rather than columns, so the mapped
+    // columns are scattered into them in a single pass.
+    bool native = isLittleEndian() && realSize == sizeof(real);
+    unsigned count = (unsigned)particles.size();
+    for (unsigned i = 0; i < count; i++)
+    {
+        Particle *particle = particles[i];
+        Vector3 v[4];
+
+        for (unsigned column = 0; column < 4; column++)
+        {
+            const unsigned char *in = vectors[column] + (unsigned long long)i * 3 * realSize;
+            if (native)
+            {
+                real xyz[3];
+                memcpy(xyz, in, sizeof(xyz));
+                v[column] = Vector3(xyz[0], xyz[1], xyz[2]);
+            }
+            else
+            {
+                v[column] = Vector3(getReal(in, realSize), getReal(in + realSize, realSize),
+                                    getReal(in + 2 * realSize, realSize));
+            }
+        }
+
+        particle->setPosition(v[SnapshotFile::POSITION]);
+        particle->setVelocity(v[SnapshotFile::VELOCITY]);
+        particle->setAcceleration(v[SnapshotFile::ACCELERATION]);
+        particle->clearAccumulator();
+        particle->addForce(v[SnapshotFile::FORCE_ACCUMULATOR]);
+        particle->setDamping(getReal(damping + i * realSize, realSize));
+        particle->setInverseMass(getReal(inverseMass + i * realSize, realSize));
+
+        for (unsigned w = 0; w < wordCount; w++)
+        {
+            particleWords[w][i] = getU32(words + ((unsigned long long)i * wordCount + w) * 4);
+        }
+        for (unsigned r = 0; r < realCount; r++)
+        {
+            particleReals[r][i] = getReal(reals + ((unsigned long long)i * realCount + r) * realSize, realSize);
+        }
+    }
+
+    if (registry)
+    {
+        registry->clear();
+        for (unsigned i = 0; i < registrationCount; i++)
+        {
+            registry->add(particles[getU32(particleIndex + i * 4)],
+                          generators[getU32(generatorIndex + i * 4)]);
+        }
+    }
+
+    for (unsigned i = 0; i < randoms.size(); i++)
+    {
+        const unsigned char *in = random + i * 19 * 4;
+        Random::State state;
+        for (unsigned w = 0; w < 17; w++) state.buffer[w] = getU32(in + w * 4);
+        state.p1 = (int)getU32(in + 17 * 4);
+        state.p2 = (int)getU32(in + 18 * 4);
+        randoms[i]->setState(state);
+    }
+
+    for (unsigned i = 0; i < values.size(); i++) *values[i] = getU32(value + i * 4);
+
+    return true;
+}
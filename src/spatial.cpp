@@ -0,0 +1,61 @@
+#include <assert.h>
+#include <cyclone/spatial.h>
+
+using namespace cyclone;
+
+SpatialGrid::SpatialGrid(real cellSize)
+    : tableSize(1), positions(NULL)
+{
+    setCellSize(cellSize);
+}
+
+void SpatialGrid::setCellSize(real cellSize)
+{
+    assert(cellSize > 0);
+    SpatialGrid::cellSize = cellSize;
+    inverseCellSize = ((real)1) / cellSize;
+}
+
+real SpatialGrid::getCellSize() const
+{
+    return cellSize;
+}
+
+void SpatialGrid::build(const Vector3 *positions, unsigned count)
+{
+    SpatialGrid::positions = positions;
+
+    // about two buckets per point keeps collisions rare.
+    tableSize = 1;
+    while (tableSize < count * 2) tableSize <<= 1;
+
+    cellStart.assign(tableSize + 1, 0);
+    pointCell.resize(count);
+    entries.resize(count);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        const Vector3 &p = positions[i];
+        unsigned cell = hash(cellCoordinate(p.x), cellCoordinate(p.y), cellCoordinate(p.z));
+        pointCell[i] = cell;
+        cellStart[cell + 1]++;
+    }
+
+    for (unsigned cell = 0; cell < tableSize; cell++)
+    {
+        cellStart[cell + 1] += cellStart[cell];
+    }
+
+    std::vector<unsigned> next(cellStart.begin(), cellStart.end() - 1);
+    for (unsigned i = 0; i < count; i++)
+    {
+        entries[next[pointCell[i]]++] = i;
+    }
+}
+
+unsigned SpatialGrid::query(const Vector3 &centre, real radius, std::vector<unsigned> &found) const
+{
+    unsigned start = (unsigned)found.size();
+    query(centre, radius, [&found](unsigned index) { found.push_back(index); });
+    return (unsigned)found.size() - start;
+}
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cyclone/sph.h>
+#include <cyclone/parallel.h>
+#include <cyclone/profile.h>
+
+using namespace cyclone;
+
+static const real PI = (real)3.14159265358979;
+
+ParticleFluid::ParticleFluid(real smoothingRadius, real restDensity, real stiffness, real viscosity)
+    : smoothingRadius(smoothingRadius), restDensity(restDensity), stiffness(stiffness),
+      viscosity(viscosity), skin(smoothingRadius * 0.2f), grid(smoothingRadius), rebuilds(0)
+{
+    updateKernels();
+}
+
+void ParticleFluid::updateKernels()
+{
+    real h = smoothingRadius;
+    real h6 = h * h * h * h * h * h;
+
+    // poly6 for density, spiky for pressure and the viscosity kernel
+    // laplacian, as in Muller et al. 2003.
+    poly6 = 315.0f / (64.0f * PI * h6 * h * h * h);
+    spikyGradient = 45.0f / (PI * h6);
+    viscosityLaplacian = 45.0f / (PI * h6);
+
+    grid.setCellSize(smoothingRadius + skin);
+    listPositions.clear();
+}
+
+void ParticleFluid::add(Particle *particle)
+{
+    particles.push_back(particle);
+    listPositions.clear();
+}
+
+void ParticleFluid::remove(Particle *particle)
+{
+    Particles::iterator i = std::find(particles.begin(), particles.end(), particle);
+    if (i != particles.end()) particles.erase(i);
+    listPositions.clear();
+}
+
+void ParticleFluid::remapParticles(const ParticleRemap &remap)
+{
+    if (particles.empty()) return;
+    particles.resize(remap.remapList(particles.data(), (unsigned)particles.size()));
+    listPositions.clear();
+}
+
+void ParticleFluid::clear()
+{
+    particles.clear();
+    listPositions.clear();
+}
+
+void ParticleFluid::setSmoothingRadius(real smoothingRadius)
+{
+    ParticleFluid::smoothingRadius = smoothingRadius;
+    updateKernels();
+}
+
+void ParticleFluid::setSkin(real skin)
+{
+    ParticleFluid::skin = skin;
+    updateKernels();
+}
+
+void ParticleFluid::setStiffness(real stiffness)
+{
+    ParticleFluid::stiffness = stiffness;
+}
+
+void ParticleFluid::setViscosity(real viscosity)
+{
+    ParticleFluid::viscosity = viscosity;
+}
+
+real ParticleFluid::getDensity(unsigned index) const
+{
+    return densities[index];
+}
+
+unsigned ParticleFluid::getRebuildCount() const
+{
+    return rebuilds;
+}
+
+void ParticleFluid::gather()
+{
+    unsigned count = (unsigned)particles.size();
+    positions.resize(count);
+    velocities.resize(count);
+    masses.resize(count);
+    densities.resize(count);
+    pressures.resize(count);
+
+    parallelFor(0, count, 4096, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++)
+        {
+            Particle *particle = particles[i];
+            positions[i] = particle->getPosition();
+            velocities[i] = particle->getVelocity();
+            // immovable particles act as boundary with unit mass.
+            masses[i] = particle->hasFiniteMass() ? particle->getMass() : 1;
+        }
+    });
+}
+
+bool ParticleFluid::needsRebuild() const
+{
+    if (listPositions.size() != positions.size()) return true;
+
+    real limit = skin * 0.5f;
+    limit *= limit;
+
+    for (unsigned i = 0; i < positions.size(); i++)
+    {
+        if ((positions[i] - listPositions[i]).sqaureMagnitude() > limit) return true;
+    }
+    return false;
+}
+
+void ParticleFluid::buildNeighbourLists()
+{
+    CYCLONE_PROFILE_SCOPE("forces/sph-neighbours");
+
+    unsigned count = (unsigned)positions.size();
+    real radius = smoothingRadius + skin;
+
+    listPositions = positions;
+    grid.build(&listPositions[0], count);
+
+    // count first so every particle can write its own slice of the list.
+    std::vector<unsigned> counts(count);
+    parallelFor(0, count, 1024, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++)
+        {
+            unsigned found = 0;
+            grid.query(listPositions[i], radius, [&found](unsigned) { found++; });
+            counts[i] = found - 1;
+        }
+    });
+
+    neighbourStart.resize(count + 1);
+    neighbourStart[0] = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        neighbourStart[i + 1] = neighbourStart[i] + counts[i];
+    }
+    neighbours.resize(neighbourStart[count]);
+
+    parallelFor(0, count, 1024, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++)
+        {
+            unsigned next = neighbourStart[i];
+            grid.query(listPositions[i], radius, [&](unsigned j) {
+                if (j != i) neighbours[next++] = j;
+            });
+        }
+    });
+
+    rebuilds++;
+}
+
+void ParticleFluid::computeDensities()
+{
+    CYCLONE_PROFILE_SCOPE("forces/sph-density");
+
+    real h2 = smoothingRadius * smoothingRadius;
+    unsigned count = (unsigned)positions.size();
+
+    parallelFor(0, count, 1024, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++)
+        {
+            const Vector3 &pi = positions[i];
+
+            // the particle's own contribution at r = 0.
+            real density = masses[i] * h2 * h2 * h2;
+
+            for (unsigned n = neighbourStart[i]; n < neighbourStart[i + 1]; n++)
+            {
+                unsigned j = neighbours[n];
+                real dx = pi.x - positions[j].x;
+                real dy = pi.y - positions[j].y;
+                real dz = pi.z - positions[j].z;
+                real q = h2 - (dx * dx + dy * dy + dz * dz);
+                q = q > 0 ? q : 0;
+                density += masses[j] * q * q * q;
+            }
+
+            density *= poly6;
+            densities[i] = density;
+
+            real pressure = stiffness * (density - restDensity);
+            pressures[i] = pressure > 0 ? pressure : 0;
+        }
+    });
+}
+
+void ParticleFluid::applyForces()
+{
+    CYCLONE_PROFILE_SCOPE("forces/sph");
+
+    unsigned count = (unsigned)positions.size();
+
+    // neighbour lists are symmetric, so each particle only writes to
+    // its own accumulator.
+    parallelFor(0, count, 1024, [&](unsigned begin, unsigned end) {
+        // copied, so the kernel's stores can't be taken to change them.
+        const real h = smoothingRadius;
+        const real spiky = spikyGradient;
+        const real viscous = viscosity;
+        const real laplacian = viscosityLaplacian;
+
+        // neighbours are gathered a block at a time into flat arrays, so
+        // the kernel runs over contiguous reals with no branches and can
+        // be vectorised.
+        const unsigned blockSize = 64;
+        real dx[blockSize], dy[blockSize], dz[blockSize];
+        real dvx[blockSize], dvy[blockSize], dvz[blockSize];
+        real mOverRho[blockSize], pj[blockSize];
+
+        for (unsigned i = begin; i < end; i++)
+        {
+            const Vector3 &pi = positions[i];
+            const Vector3 &vi = velocities[i];
+            real pressure = pressures[i];
+
+            real fx = 0, fy = 0, fz = 0;
+            for (unsigned first = neighbourStart[i]; first < neighbourStart[i + 1]; first += blockSize)
+            {
+                unsigned found = neighbourStart[i + 1] - first;
+                if (found > blockSize) found = blockSize;
+
+                for (unsigned n = 0; n < found; n++)
+                {
+                    unsigned j = neighbours[first + n];
+                    dx[n] = pi.x - positions[j].x;
+                    dy[n] = pi.y - positions[j].y;
+                    dz[n] = pi.z - positions[j].z;
+                    dvx[n] = velocities[j].x - vi.x;
+                    dvy[n] = velocities[j].y - vi.y;
+                    dvz[n] = velocities[j].z - vi.z;
+                    mOverRho[n] = masses[j] / densities[j];
+                    pj[n] = pressures[j];
+                }
+
+                // each neighbour's force is written over its offset and
+                // only then summed, so nothing is carried from one
+                // neighbour to the next and the sums keep their order.
+                for (unsigned n = 0; n < found; n++)
+                {
+                    real r = real_sqrt(dx[n] * dx[n] + dy[n] * dy[n] + dz[n] * dz[n]);
+
+                    // neighbours outside the radius, from the list's
+                    // skin, or on top of the particle are masked to no
+                    // force.
+                    bool inside = (r < h) & (r > 0);
+                    real w = h - r;
+                    w = inside ? w : 0;
+                    real safeR = inside ? r : 1;
+
+                    real p = mOverRho[n] * 0.5f * (pressure + pj[n]) * spiky * w * w / safeR;
+                    real v = mOverRho[n] * viscous * laplacian * w;
+
+                    dx[n] = p * dx[n] + v * dvx[n];
+                    dy[n] = p * dy[n] + v * dvy[n];
+                    dz[n] = p * dz[n] + v * dvz[n];
+                }
+
+                for (unsigned n = 0; n < found; n++)
+                {
+                    fx += dx[n];
+                    fy += dy[n];
+                    fz += dz[n];
+                }
+            }
+
+            Particle *particle = particles[i];
+            if (!particle->hasFiniteMass() || densities[i] <= 0) continue;
+
+            // force per unit volume to force on the particle.
+            real scale = masses[i] / densities[i];
+            particle->addForce(Vector3(fx * scale, fy * scale, fz * scale));
+        }
+    });
+}
+
+void ParticleFluid::updateForces(real)
+{
+    if (particles.empty()) return;
+
+    gather();
+    if (needsRebuild()) buildNeighbourLists();
+    computeDensities();
+    applyForces();
+}
@@ -0,0 +1,198 @@
+#include <string.h>
+#include <cyclone/store.h>
+
+using namespace cyclone;
+
+const ParticleStore::Column ParticleStore::NO_COLUMN;
+const unsigned ParticleStore::REMOVED;
+
+ParticleStore::ParticleStore(unsigned size)
+    : particles(size)
+{
+}
+
+ParticleStore::Column ParticleStore::addColumn(const char *name, const std::type_info &type,
+                                               unsigned elementSize, const void *initial)
+{
+    if (findColumn(name) != NO_COLUMN) return NO_COLUMN;
+
+    columns.push_back(ColumnData());
+    ColumnData &column = columns.back();
+    column.name = name;
+    column.type = &type;
+    column.elementSize = elementSize;
+    column.initial.assign((const unsigned char*)initial, (const unsigned char*)initial + elementSize);
+
+    column.values.resize(particles.size() * elementSize);
+    for (unsigned i = 0; i < particles.size(); i++)
+    {
+        memcpy(&column.values[i * elementSize], initial, elementSize);
+    }
+    return (Column)columns.size() - 1;
+}
+
+void* ParticleStore::getColumnData(Column column, const std::type_info &type) const
+{
+    if (column >= columns.size() || *columns[column].type != type) return NULL;
+
+    // an empty column has no storage, but its view is still valid.
+    static unsigned char empty[16];
+    const std::vector<unsigned char> &values = columns[column].values;
+    return values.empty() ? (void*)empty : (void*)&values[0];
+}
+
+ParticleStore::Column ParticleStore::findColumn(const char *name) const
+{
+    for (unsigned i = 0; i < columns.size(); i++)
+    {
+        if (columns[i].name == name) return i;
+    }
+    return NO_COLUMN;
+}
+
+unsigned ParticleStore::getColumnCount() const
+{
+    return (unsigned)columns.size();
+}
+
+const char* ParticleStore::getColumnName(Column column) const
+{
+    return column < columns.size() ? columns[column].name.c_str() : NULL;
+}
+
+unsigned ParticleStore::getSize() const
+{
+    return (unsigned)particles.size();
+}
+
+void ParticleStore::resize(unsigned size)
+{
+    unsigned old = getSize();
+    particles.resize(size);
+
+    for (unsigned c = 0; c < columns.size(); c++)
+    {
+        ColumnData &column = columns[c];
+        column.values.resize(size * column.elementSize);
+        for (unsigned i = old; i < size; i++)
+        {
+            memcpy(&column.values[i * column.elementSize], &column.initial[0], column.elementSize);
+        }
+    }
+}
+
+void ParticleStore::reserve(unsigned capacity)
+{
+    particles.reserve(capacity);
+    for (unsigned c = 0; c < columns.size(); c++)
+    {
+        columns[c].values.reserve(capacity * columns[c].elementSize);
+    }
+}
+
+unsigned ParticleStore::spawn()
+{
+    unsigned index = getSize();
+    resize(index + 1);
+    return index;
+}
+
+void ParticleStore::copy(unsigned from, unsigned to)
+{
+    if (from == to) return;
+
+    particles[to] = particles[from];
+    for (unsigned c = 0; c < columns.size(); c++)
+    {
+        ColumnData &column = columns[c];
+        memcpy(&column.values[to * column.elementSize], &column.values[from * column.elementSize],
+               column.elementSize);
+    }
+}
+
+void ParticleStore::swap(unsigned a, unsigned b)
+{
+    if (a == b) return;
+
+    Particle particle = particles[a];
+    particles[a] = particles[b];
+    particles[b] = particle;
+
+    for (unsigned c = 0; c < columns.size(); c++)
+    {
+        ColumnData &column = columns[c];
+        unsigned char *x = &column.values[a * column.elementSize];
+        unsigned char *y = &column.values[b * column.elementSize];
+        for (unsigned i = 0; i < column.elementSize; i++)
+        {
+            unsigned char t = x[i];
+            x[i] = y[i];
+            y[i] = t;
+        }
+    }
+}
+
+unsigned ParticleStore::compact(const unsigned char *keep, unsigned *remap)
+{
+    unsigned size = getSize();
+    unsigned kept = 0;
+    for (unsigned i = 0; i < size; i++)
+    {
+        if (keep[i] == 0)
+        {
+            if (remap) remap[i] = REMOVED;
+            continue;
+        }
+
+        copy(i, kept);
+        if (remap) remap[i] = kept;
+        kept++;
+    }
+
+    resize(kept);
+    return kept;
+}
+
+void ParticleStore::permute(const unsigned *order)
+{
+    unsigned size = getSize();
+
+    // the particles are copied back rather than swapped, so they stay
+    // where they are and pointers to the array can be remapped.
+    particleScratch.resize(size);
+    for (unsigned i = 0; i < size; i++) particleScratch[i] = particles[order[i]];
+    for (unsigned i = 0; i < size; i++) particles[i] = particleScratch[i];
+
+    for (unsigned c = 0; c < columns.size(); c++)
+    {
+        ColumnData &column = columns[c];
+        const unsigned elementSize = column.elementSize;
+
+        columnScratch.resize(column.values.size());
+        for (unsigned i = 0; i < size; i++)
+        {
+            memcpy(&columnScratch[i * elementSize], &column.values[order[i] * elementSize], elementSize);
+        }
+        column.values.swap(columnScratch);
+    }
+}
+
+Particle* ParticleStore::getParticles()
+{
+    return particles.empty() ? NULL : &particles[0];
+}
+
+const Particle* ParticleStore::getParticles() const
+{
+    return particles.empty() ? NULL : &particles[0];
+}
+
+Particle& ParticleStore::getParticle(unsigned index)
+{
+    return particles[index];
+}
+
+const Particle& ParticleStore::getParticle(unsigned index) const
+{
+    return particles[index];
+}
@@ -0,0 +1,263 @@
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <cyclone/taskgraph.h>
+
+namespace cyclone
+{
+    /**
+     * The worker threads every graph's chunks are handed out to. Threads
+     * are started the first time they're needed and then sleep until
+     * there is work, so a step doesn't pay to start them.
+     */
+    class TaskPool
+    {
+        struct Chunk
+        {
+            TaskGraph *graph;
+            unsigned task;
+            unsigned begin;
+            unsigned end;
+        };
+
+        std::mutex mutex;
+
+        /** Signalled when chunks are added and when a graph finishes. */
+        std::condition_variable changed;
+
+        std::deque<Chunk> ready;
+
+        std::vector<std::thread> threads;
+
+        /** Threads allowed to take chunks, the worker count less the caller. */
+        unsigned active;
+
+        bool stopping;
+
+        TaskPool()
+            : active(0), stopping(false)
+        {
+        }
+
+        ~TaskPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            changed.notify_all();
+            for (unsigned i = 0; i < threads.size(); i++) threads[i].join();
+        }
+
+        /** Queues the chunks of a task whose predecessors have all finished. */
+        void release(TaskGraph &graph, unsigned task)
+        {
+            const TaskGraph::Task &t = graph.tasks[task];
+            if (t.end <= t.begin)
+            {
+                finish(graph, task);
+                return;
+            }
+
+            for (unsigned begin = t.begin; begin < t.end; begin += t.grain)
+            {
+                Chunk chunk = {&graph, task, begin, begin + t.grain < t.end ? begin + t.grain : t.end};
+                ready.push_back(chunk);
+            }
+            changed.notify_all();
+        }
+
+        /** Releases the successors of a task whose chunks are all done. */
+        void finish(TaskGraph &graph, unsigned task)
+        {
+            const std::vector<unsigned> &successors = graph.tasks[task].successors;
+            for (unsigned i = 0; i < successors.size(); i++)
+            {
+                if (--graph.waiting[successors[i]] == 0) release(graph, successors[i]);
+            }
+
+            if (--graph.unfinished == 0) changed.notify_all();
+        }
+
+        /** Does a chunk with the lock released, then marks it done. */
+        void execute(const Chunk &chunk, std::unique_lock<std::mutex> &lock)
+        {
+            lock.unlock();
+            {
+                const TaskGraph::Task &task = chunk.graph->tasks[chunk.task];
+                CYCLONE_TRACE_SCOPE(task.name);
+                task.body(chunk.begin, chunk.end);
+            }
+            lock.lock();
+
+            if (--chunk.graph->remaining[chunk.task] == 0) finish(*chunk.graph, chunk.task);
+        }
+
+        void work(unsigned index)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                while (!stopping && (index >= active || ready.empty())) changed.wait(lock);
+                if (stopping) return;
+
+                Chunk chunk = ready.front();
+                ready.pop_front();
+                execute(chunk, lock);
+            }
+        }
+
+    public:
+        static TaskPool& get()
+        {
+            static TaskPool pool;
+            return pool;
+        }
+
+        void run(TaskGraph &graph, unsigned workers)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            active = workers - 1;
+            while (threads.size() < active)
+            {
+                threads.push_back(std::thread(&TaskPool::work, this, (unsigned)threads.size()));
+            }
+
+            graph.unfinished = (unsigned)graph.tasks.size();
+            graph.waiting.resize(graph.tasks.size());
+            graph.remaining.resize(graph.tasks.size());
+            for (unsigned i = 0; i < graph.tasks.size(); i++)
+            {
+                const TaskGraph::Task &task = graph.tasks[i];
+                graph.waiting[i] = task.predecessors;
+                graph.remaining[i] = (task.end - task.begin + task.grain - 1) / task.grain;
+            }
+            for (unsigned i = 0; i < graph.tasks.size(); i++)
+            {
+                if (graph.tasks[i].predecessors == 0) release(graph, i);
+            }
+
+            // the caller works too, on whatever is ready, until its own
+            // graph is done.
+            while (graph.unfinished > 0)
+            {
+                if (ready.empty())
+                {
+                    changed.wait(lock);
+                    continue;
+                }
+
+                Chunk chunk = ready.front();
+                ready.pop_front();
+                execute(chunk, lock);
+            }
+        }
+    };
+}
+
+using namespace cyclone;
+
+TaskGraph::TaskGraph()
+    : sorted(true), unfinished(0)
+{
+}
+
+unsigned TaskGraph::addTask(const char *name, const std::function<void()> &body)
+{
+    return addTask(name, 0, 1, 1, [body](unsigned, unsigned) { body(); });
+}
+
+unsigned TaskGraph::addTask(const char *name, unsigned begin, unsigned end, unsigned grain, const Body &body)
+{
+    Task task;
+    task.name = name;
+    task.body = body;
+    task.begin = begin;
+    task.end = end > begin ? end : begin;
+    task.grain = grain > 0 ? grain : 1;
+    task.predecessors = 0;
+    tasks.push_back(task);
+
+    sorted = false;
+    return (unsigned)tasks.size() - 1;
+}
+
+void TaskGraph::addDependency(unsigned before, unsigned after)
+{
+    tasks[before].successors.push_back(after);
+    tasks[after].predecessors++;
+    sorted = false;
+}
+
+void TaskGraph::clear()
+{
+    tasks.clear();
+    order.clear();
+    sorted = true;
+}
+
+unsigned TaskGraph::getTaskCount() const
+{
+    return (unsigned)tasks.size();
+}
+
+const char* TaskGraph::getTaskName(unsigned task) const
+{
+    return tasks[task].name;
+}
+
+bool TaskGraph::sort()
+{
+    if (!sorted)
+    {
+        // tasks in the order they were added, each as soon as those it
+        // waits for are in.
+        std::vector<unsigned> waiting(tasks.size());
+        order.clear();
+        for (unsigned i = 0; i < tasks.size(); i++)
+        {
+            waiting[i] = tasks[i].predecessors;
+            if (waiting[i] == 0) order.push_back(i);
+        }
+
+        for (unsigned i = 0; i < order.size(); i++)
+        {
+            const std::vector<unsigned> &successors = tasks[order[i]].successors;
+            for (unsigned j = 0; j < successors.size(); j++)
+            {
+                if (--waiting[successors[j]] == 0) order.push_back(successors[j]);
+            }
+        }
+        sorted = true;
+    }
+
+    // tasks on a cycle never come free.
+    return order.size() == tasks.size();
+}
+
+void TaskGraph::runInline()
+{
+    for (unsigned i = 0; i < order.size(); i++)
+    {
+        const Task &task = tasks[order[i]];
+        CYCLONE_TRACE_SCOPE(task.name);
+        for (unsigned begin = task.begin; begin < task.end; begin += task.grain)
+        {
+            task.body(begin, begin + task.grain < task.end ? begin + task.grain : task.end);
+        }
+    }
+}
+
+bool TaskGraph::run()
+{
+    CYCLONE_PROFILE_SCOPE("tasks/graph");
+
+    if (!sort()) return false;
+    if (tasks.empty()) return true;
+
+    unsigned workers = getWorkerCount();
+    if (workers <= 1) runInline();
+    else TaskPool::get().run(*this, workers);
+    return true;
+}
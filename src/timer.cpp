@@ -0,0 +1,38 @@
+#include <cyclone/timer.h>
+
+#if (__APPLE__ || __unix)
+    #define TIMER_UNIX 1
+    #include <time.h>
+#else
+    #define TIMER_WINDOWS 1
+    #include <windows.h>
+#endif
+
+using namespace cyclone;
+
+unsigned long long cyclone::getTimeNanoseconds()
+{
+#if TIMER_UNIX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#else
+    static LONGLONG frequency = 0;
+    if (frequency == 0) QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+
+    LONGLONG counter;
+    QueryPerformanceCounter((LARGE_INTEGER*)&counter);
+
+    // split to avoid overflowing the multiplication.
+    LONGLONG seconds = counter / frequency;
+    LONGLONG remainder = counter % frequency;
+    return (unsigned long long)seconds * 1000000000ULL +
+        (unsigned long long)(remainder * 1000000000LL / frequency);
+#endif
+}
+
+double cyclone::getTimeSeconds()
+{
+    return (double)getTimeNanoseconds() * 1e-9;
+}
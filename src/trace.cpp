@@ -0,0 +1,276 @@
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#include <cyclone/trace.h>
+
+using namespace cyclone;
+
+std::atomic<bool> Trace::enabled(false);
+
+namespace
+{
+    /** Deepest nesting of scopes recorded on one thread. */
+    const unsigned MaxDepth = 64;
+
+    /** A begin event has a name, an end event doesn't. */
+    struct TraceEvent
+    {
+        const char *name;
+        unsigned long long time;
+    };
+
+    /**
+     * Single producer, single consumer ring of one thread's events. The
+     * owning thread only moves head and the flush thread only moves
+     * tail. Rings are never freed, a ring whose thread has exited is
+     * handed to the next new thread.
+     */
+    struct TraceRing
+    {
+        std::vector<TraceEvent> events;
+        std::atomic<unsigned long long> head;
+        std::atomic<unsigned long long> tail;
+        std::atomic<bool> released;
+        unsigned id;
+        bool named;
+
+        /** Names of the open scopes, only touched by the owner. */
+        const char *stack[MaxDepth];
+        unsigned depth;
+
+        TraceRing *next;
+
+        TraceRing(unsigned id)
+            : head(0), tail(0), released(false), id(id), named(false), depth(0), next(NULL)
+        {
+        }
+    };
+
+    std::mutex ringsMutex;
+    std::atomic<TraceRing*> rings(NULL);
+    unsigned ringCount = 0;
+    unsigned ringCapacity = 65536;
+
+    std::atomic<unsigned long long> dropped(0);
+
+    FILE *file = NULL;
+    bool firstEvent = true;
+    unsigned long long origin = 0;
+
+    std::thread flusher;
+    std::mutex flushMutex;
+    std::condition_variable flushCondition;
+    bool stopping = false;
+
+    /** Gives the calling thread's ring back when the thread exits. */
+    struct RingOwner
+    {
+        TraceRing *ring;
+
+        RingOwner() : ring(NULL) {}
+
+        ~RingOwner()
+        {
+            if (ring) ring->released.store(true, std::memory_order_release);
+        }
+    };
+
+    thread_local RingOwner owner;
+
+    TraceRing* acquireRing()
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+
+        TraceRing *ring = rings.load(std::memory_order_acquire);
+        for (; ring; ring = ring->next)
+        {
+            bool expected = true;
+            if (ring->released.compare_exchange_strong(expected, false, std::memory_order_acquire))
+            {
+                ring->depth = 0;
+                return ring;
+            }
+        }
+
+        ring = new TraceRing(ringCount++);
+        ring->events.resize(ringCapacity);
+        ring->next = rings.load(std::memory_order_relaxed);
+        rings.store(ring, std::memory_order_release);
+        return ring;
+    }
+
+    TraceRing* getRing()
+    {
+        if (owner.ring == NULL) owner.ring = acquireRing();
+        return owner.ring;
+    }
+
+    void writeName(const char *name)
+    {
+        for (; *name; name++)
+        {
+            if (*name == '"' || *name == '\\') fputc('\\', file);
+            fputc(*name, file);
+        }
+    }
+
+    void writeSeparator()
+    {
+        if (!firstEvent) fputs(",\n", file);
+        firstEvent = false;
+    }
+
+    /** Formats every pending event of every ring into the file. */
+    void drain()
+    {
+        TraceRing *ring = rings.load(std::memory_order_acquire);
+        for (; ring; ring = ring->next)
+        {
+            unsigned long long tail = ring->tail.load(std::memory_order_relaxed);
+            unsigned long long head = ring->head.load(std::memory_order_acquire);
+            if (tail == head) continue;
+
+            if (!ring->named)
+            {
+                writeSeparator();
+                fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                        "\"args\":{\"name\":\"thread %u\"}}", ring->id, ring->id);
+                ring->named = true;
+            }
+
+            unsigned capacity = (unsigned)ring->events.size();
+            for (; tail != head; tail++)
+            {
+                const TraceEvent &event = ring->events[tail % capacity];
+                double microseconds = (event.time - origin) * 1e-3;
+
+                writeSeparator();
+                if (event.name)
+                {
+                    fputs("{\"name\":\"", file);
+                    writeName(event.name);
+                    fprintf(file, "\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                            microseconds, ring->id);
+                }
+                else
+                {
+                    fprintf(file, "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                            microseconds, ring->id);
+                }
+            }
+
+            ring->tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    void flushLoop()
+    {
+        std::unique_lock<std::mutex> lock(flushMutex);
+        while (!stopping)
+        {
+            flushCondition.wait_for(lock, std::chrono::milliseconds(10));
+            drain();
+        }
+    }
+}
+
+bool Trace::start(const char *filename, unsigned capacity)
+{
+    if (isEnabled() || capacity < MaxDepth * 2) return false;
+
+    file = fopen(filename, "w");
+    if (file == NULL) return false;
+
+    // no traced code runs now, so every ring can be reset in place.
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        ringCapacity = capacity;
+        for (TraceRing *ring = rings.load(); ring; ring = ring->next)
+        {
+            ring->events.resize(capacity);
+            ring->head = 0;
+            ring->tail = 0;
+            ring->depth = 0;
+            ring->named = false;
+        }
+    }
+
+    dropped = 0;
+    firstEvent = true;
+    origin = getTimeNanoseconds();
+    fputs("{\"traceEvents\":[\n", file);
+
+    stopping = false;
+    flusher = std::thread(flushLoop);
+
+    enabled.store(true, std::memory_order_release);
+    return true;
+}
+
+void Trace::stop()
+{
+    if (!isEnabled()) return;
+    enabled.store(false, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        stopping = true;
+    }
+    flushCondition.notify_one();
+    flusher.join();
+
+    drain();
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+    fclose(file);
+    file = NULL;
+}
+
+bool Trace::begin(const char *name, unsigned long long time)
+{
+    TraceRing *ring = getRing();
+
+    // leave room for the end of every open scope, so that a full ring
+    // drops whole scopes and the timeline always stays balanced.
+    unsigned long long head = ring->head.load(std::memory_order_relaxed);
+    unsigned long long used = head - ring->tail.load(std::memory_order_acquire);
+    if (ring->depth >= MaxDepth || used + ring->depth + 2 > ring->events.size())
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    TraceEvent &event = ring->events[head % ring->events.size()];
+    event.name = name;
+    event.time = time;
+    ring->head.store(head + 1, std::memory_order_release);
+
+    ring->stack[ring->depth++] = name;
+    return true;
+}
+
+void Trace::end(unsigned long long time)
+{
+    TraceRing *ring = getRing();
+
+    unsigned long long head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent &event = ring->events[head % ring->events.size()];
+    event.name = NULL;
+    event.time = time;
+    ring->head.store(head + 1, std::memory_order_release);
+
+    ring->depth--;
+}
+
+const char* Trace::getCurrentScope()
+{
+    if (!isEnabled() || owner.ring == NULL || owner.ring->depth == 0) return NULL;
+    return owner.ring->stack[owner.ring->depth - 1];
+}
+
+unsigned long long Trace::getDroppedCount()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,602 @@
+#include <math.h>
+#include <string.h>
+#include <cyclone/trajectory.h>
+
+using namespace cyclone;
+
+static const char trajectoryMagic[8] = {'C', 'Y', 'C', 'L', 'T', 'R', 'A', 'J'};
+static const char indexMagic[8] = {'C', 'Y', 'C', 'L', 'T', 'I', 'D', 'X'};
+static const unsigned trajectoryVersion = 1;
+static const unsigned headerSize = 24;
+static const unsigned chunkHeaderSize = 8;
+static const unsigned indexEntrySize = 32;
+static const unsigned trailerSize = 24;
+
+static void putU32(unsigned char *out, unsigned value)
+{
+    for (unsigned i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (i * 8));
+}
+
+static void putU64(unsigned char *out, unsigned long long value)
+{
+    for (unsigned i = 0; i < 8; i++) out[i] = (unsigned char)(value >> (i * 8));
+}
+
+static unsigned getU32(const unsigned char *in)
+{
+    unsigned value = 0;
+    for (unsigned i = 0; i < 4; i++) value |= (unsigned)in[i] << (i * 8);
+    return value;
+}
+
+static unsigned long long getU64(const unsigned char *in)
+{
+    unsigned long long value = 0;
+    for (unsigned i = 0; i < 8; i++) value |= (unsigned long long)in[i] << (i * 8);
+    return value;
+}
+
+static unsigned long long doubleBits(double value)
+{
+    unsigned long long bits;
+    memcpy(&bits, &value, 8);
+    return bits;
+}
+
+static double bitsDouble(unsigned long long bits)
+{
+    double value;
+    memcpy(&value, &bits, 8);
+    return value;
+}
+
+/** Appends an unsigned LEB128 variable length integer. */
+static void putVarint(std::vector<unsigned char> &out, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+
+static bool getVarint(const unsigned char *&in, const unsigned char *end, unsigned long long &value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && in < end; shift += 7)
+    {
+        unsigned char byte = *in++;
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+/** Maps signed differences to unsigned so small ones stay short. */
+static unsigned long long zigzag(long long value)
+{
+    return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static long long unzigzag(unsigned long long value)
+{
+    return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+/**
+ * Per component history within a chunk. Values are predicted by carrying
+ * on in a straight line from the last two frames, and only the error of
+ * the prediction is stored, so smooth motion and particles at rest both
+ * cost next to nothing.
+ */
+struct TrajectoryHistory
+{
+    std::vector<int> last;
+    std::vector<int> beforeLast;
+
+    void clear()
+    {
+        last.clear();
+        beforeLast.clear();
+    }
+
+    void grow(size_t size)
+    {
+        if (last.size() >= size) return;
+        last.resize(size, 0);
+        beforeLast.resize(size, 0);
+    }
+
+    long long predict(size_t i) const
+    {
+        return 2 * (long long)last[i] - beforeLast[i];
+    }
+
+    void push(size_t i, int value)
+    {
+        beforeLast[i] = last[i];
+        last[i] = value;
+    }
+};
+
+static unsigned columnCount(unsigned columns)
+{
+    return ((columns & TRAJECTORY_POSITION) ? 1 : 0) + ((columns & TRAJECTORY_VELOCITY) ? 1 : 0);
+}
+
+/**
+ * Raw frames as copied out of the particles, three reals per particle
+ * for each column, one column after another.
+ */
+struct TrajectoryRecorder::Chunk
+{
+    std::vector<real> values;
+    std::vector<unsigned> counts;
+    std::vector<double> times;
+
+    /** Encoder scratch space, only used by the writer thread. */
+    std::vector<unsigned char> bytes;
+    TrajectoryHistory history[2];
+
+    void clear()
+    {
+        values.clear();
+        counts.clear();
+        times.clear();
+    }
+};
+
+TrajectoryRecorder::TrajectoryRecorder()
+    : file(NULL), columns(0), quantum(0), chunkFrames(0), front(new Chunk()), back(new Chunk()),
+      frames(0), stalls(0), chunkCount(0), writtenFrames(0), pending(false), stopping(false), failed(false)
+{
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    close();
+    delete front;
+    delete back;
+}
+
+bool TrajectoryRecorder::open(const char *filename, unsigned columns, real quantum, unsigned chunkFrames)
+{
+    close();
+    if (columnCount(columns) == 0 || quantum <= 0 || chunkFrames == 0) return false;
+
+    file = fopen(filename, "wb");
+    if (file == NULL) return false;
+
+    TrajectoryRecorder::columns = columns;
+    TrajectoryRecorder::quantum = quantum;
+    TrajectoryRecorder::chunkFrames = chunkFrames;
+    frames = 0;
+    stalls = 0;
+    index.clear();
+    chunkCount = 0;
+    writtenFrames = 0;
+    pending = false;
+    stopping = false;
+    failed = false;
+    front->clear();
+    back->clear();
+
+    unsigned char header[headerSize];
+    memcpy(header, trajectoryMagic, 8);
+    putU32(header + 8, trajectoryVersion);
+    putU32(header + 12, columns);
+    putU64(header + 16, doubleBits(quantum));
+    if (fwrite(header, 1, headerSize, file) != headerSize) failed = true;
+
+    writer = std::thread(&TrajectoryRecorder::writeLoop, this);
+    return true;
+}
+
+void TrajectoryRecorder::record(double time, const Particle *const *particles, unsigned count)
+{
+    if (file == NULL) return;
+
+    Chunk *chunk = front;
+    chunk->times.push_back(time);
+    chunk->counts.push_back(count);
+
+    size_t start = chunk->values.size();
+    chunk->values.resize(start + (size_t)count * 3 * columnCount(columns));
+    real *out = chunk->values.empty() ? NULL : &chunk->values[start];
+
+    if (columns & TRAJECTORY_POSITION)
+    {
+        for (unsigned i = 0; i < count; i++, out += 3)
+        {
+            Vector3 position = particles[i]->getPosition();
+            out[0] = position.x;
+            out[1] = position.y;
+            out[2] = position.z;
+        }
+    }
+    if (columns & TRAJECTORY_VELOCITY)
+    {
+        for (unsigned i = 0; i < count; i++, out += 3)
+        {
+            Vector3 velocity = particles[i]->getVelocity();
+            out[0] = velocity.x;
+            out[1] = velocity.y;
+            out[2] = velocity.z;
+        }
+    }
+
+    frames++;
+    if (chunk->times.size() >= chunkFrames) submit();
+}
+
+void TrajectoryRecorder::submit()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (pending)
+    {
+        stalls++;
+        while (pending) condition.wait(lock);
+    }
+
+    Chunk *full = front;
+    front = back;
+    back = full;
+    front->clear();
+
+    pending = true;
+    condition.notify_all();
+}
+
+void TrajectoryRecorder::writeLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        while (!pending && !stopping) condition.wait(lock);
+
+        if (pending)
+        {
+            lock.unlock();
+            writeChunk(back);
+            lock.lock();
+
+            pending = false;
+            condition.notify_all();
+        }
+        else if (stopping)
+        {
+            return;
+        }
+    }
+}
+
+void TrajectoryRecorder::writeChunk(Chunk *chunk)
+{
+    unsigned frameCount = (unsigned)chunk->times.size();
+    if (frameCount == 0) return;
+
+    std::vector<unsigned char> &bytes = chunk->bytes;
+    bytes.assign(chunkHeaderSize, 0);
+
+    // the first frame of every chunk is relative to zero, so chunks can
+    // be decoded on their own.
+    unsigned columnsUsed = columnCount(columns);
+    for (unsigned c = 0; c < columnsUsed; c++) chunk->history[c].clear();
+    bytes.reserve(chunk->values.size() + frameCount * 16 + chunkHeaderSize);
+
+    const double scale = 1.0 / quantum;
+    const real *in = chunk->values.empty() ? NULL : &chunk->values[0];
+    for (unsigned f = 0; f < frameCount; f++)
+    {
+        unsigned count = chunk->counts[f];
+        unsigned char time[8];
+        putU64(time, doubleBits(chunk->times[f]));
+        bytes.insert(bytes.end(), time, time + 8);
+        putVarint(bytes, count);
+
+        for (unsigned c = 0; c < columnsUsed; c++)
+        {
+            TrajectoryHistory &history = chunk->history[c];
+            history.grow((size_t)count * 3);
+
+            // a zero byte starts a run of correct predictions, followed by
+            // its length. Anything else is a zigzag coded error.
+            unsigned long long run = 0;
+            for (unsigned i = 0; i < count * 3; i++)
+            {
+                double scaled = floor(*in++ * scale + 0.5);
+                if (scaled > 2147483647.0) scaled = 2147483647.0;
+                if (scaled < -2147483647.0) scaled = -2147483647.0;
+
+                int quantised = (int)scaled;
+                long long error = quantised - history.predict(i);
+                history.push(i, quantised);
+
+                if (error == 0)
+                {
+                    run++;
+                    continue;
+                }
+                if (run > 0)
+                {
+                    bytes.push_back(0);
+                    putVarint(bytes, run);
+                    run = 0;
+                }
+                putVarint(bytes, zigzag(error));
+            }
+            if (run > 0)
+            {
+                bytes.push_back(0);
+                putVarint(bytes, run);
+            }
+        }
+    }
+
+    unsigned long long offset = (unsigned long long)ftell(file);
+    putU32(&bytes[0], frameCount);
+    putU32(&bytes[4], (unsigned)(bytes.size() - chunkHeaderSize));
+    if (fwrite(&bytes[0], 1, bytes.size(), file) != bytes.size()) failed = true;
+
+    unsigned char entry[indexEntrySize] = {0};
+    putU64(entry, offset);
+    putU64(entry + 8, writtenFrames);
+    putU32(entry + 16, frameCount);
+    putU64(entry + 24, doubleBits(chunk->times[0]));
+    index.insert(index.end(), entry, entry + indexEntrySize);
+    writtenFrames += frameCount;
+    chunkCount++;
+}
+
+bool TrajectoryRecorder::close()
+{
+    if (file == NULL) return false;
+
+    if (!front->times.empty()) submit();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    writer.join();
+
+    unsigned long long indexOffset = (unsigned long long)ftell(file);
+    if (!index.empty() && fwrite(&index[0], 1, index.size(), file) != index.size()) failed = true;
+
+    unsigned char trailer[trailerSize];
+    putU64(trailer, indexOffset);
+    putU64(trailer + 8, chunkCount);
+    memcpy(trailer + 16, indexMagic, 8);
+    if (fwrite(trailer, 1, trailerSize, file) != trailerSize) failed = true;
+
+    if (fclose(file) != 0) failed = true;
+    file = NULL;
+    return !failed;
+}
+
+bool TrajectoryRecorder::isOpen() const
+{
+    return file != NULL;
+}
+
+unsigned long long TrajectoryRecorder::getFrameCount() const
+{
+    return frames;
+}
+
+unsigned long long TrajectoryRecorder::getStallCount() const
+{
+    return stalls;
+}
+
+TrajectoryReader::TrajectoryReader()
+    : file(NULL), columns(0), quantum(0), frameCount(0), cachedChunk(0)
+{
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+    close();
+}
+
+bool TrajectoryReader::open(const char *filename)
+{
+    close();
+
+    file = fopen(filename, "rb");
+    if (file == NULL) return false;
+
+    unsigned char header[headerSize];
+    unsigned char trailer[trailerSize];
+    bool valid = fread(header, 1, headerSize, file) == headerSize &&
+        memcmp(header, trajectoryMagic, 8) == 0 &&
+        getU32(header + 8) == trajectoryVersion &&
+        fseek(file, -(long)trailerSize, SEEK_END) == 0 &&
+        fread(trailer, 1, trailerSize, file) == trailerSize &&
+        memcmp(trailer + 16, indexMagic, 8) == 0;
+
+    if (valid)
+    {
+        columns = getU32(header + 12);
+        quantum = (real)bitsDouble(getU64(header + 16));
+
+        unsigned long long count = getU64(trailer + 8);
+        std::vector<unsigned char> entries((size_t)(count * indexEntrySize));
+        valid = fseek(file, (long)getU64(trailer), SEEK_SET) == 0 &&
+            (count == 0 || fread(&entries[0], 1, entries.size(), file) == entries.size());
+
+        for (unsigned long long i = 0; valid && i < count; i++)
+        {
+            const unsigned char *entry = &entries[(size_t)(i * indexEntrySize)];
+            ChunkEntry chunk;
+            chunk.offset = getU64(entry);
+            chunk.firstFrame = getU64(entry + 8);
+            chunk.frameCount = getU32(entry + 16);
+            chunk.firstTime = bitsDouble(getU64(entry + 24));
+            chunks.push_back(chunk);
+            frameCount += chunk.frameCount;
+        }
+    }
+
+    if (!valid) close();
+    return valid;
+}
+
+void TrajectoryReader::close()
+{
+    if (file) fclose(file);
+    file = NULL;
+    chunks.clear();
+    frameCount = 0;
+    cachedChunk = 0;
+    frameStarts.clear();
+}
+
+unsigned TrajectoryReader::getColumns() const
+{
+    return columns;
+}
+
+unsigned long long TrajectoryReader::getFrameCount() const
+{
+    return frameCount;
+}
+
+unsigned long long TrajectoryReader::findFrame(double time)
+{
+    // the chunk is found through the index, the frame within it by the
+    // recorded times.
+    unsigned low = 0, high = (unsigned)chunks.size();
+    while (high - low > 1)
+    {
+        unsigned middle = (low + high) / 2;
+        if (chunks[middle].firstTime <= time) low = middle;
+        else high = middle;
+    }
+    if (chunks.empty() || !decode(low)) return chunks.empty() ? 0 : chunks[low].firstFrame;
+
+    unsigned long long frame = chunks[low].firstFrame;
+    for (unsigned f = 1; f < times.size() && times[f] <= time; f++) frame++;
+    return frame;
+}
+
+bool TrajectoryReader::decode(unsigned chunk)
+{
+    if (!frameStarts.empty() && cachedChunk == chunk) return true;
+    frameStarts.clear();
+    values.clear();
+    counts.clear();
+    times.clear();
+
+    unsigned char header[chunkHeaderSize];
+    if (fseek(file, (long)chunks[chunk].offset, SEEK_SET) != 0 ||
+        fread(header, 1, chunkHeaderSize, file) != chunkHeaderSize)
+    {
+        return false;
+    }
+
+    unsigned frames = getU32(header);
+    std::vector<unsigned char> bytes(getU32(header + 4));
+    if (frames != chunks[chunk].frameCount ||
+        (!bytes.empty() && fread(&bytes[0], 1, bytes.size(), file) != bytes.size()))
+    {
+        return false;
+    }
+
+    const unsigned char *in = bytes.empty() ? NULL : &bytes[0];
+    const unsigned char *end = in + bytes.size();
+    unsigned columnsUsed = columnCount(columns);
+    TrajectoryHistory history[2];
+
+    for (unsigned f = 0; f < frames; f++)
+    {
+        unsigned long long count;
+        if (end - in < 8) return false;
+        times.push_back(bitsDouble(getU64(in)));
+        in += 8;
+        if (!getVarint(in, end, count)) return false;
+
+        counts.push_back((unsigned)count);
+        frameStarts.push_back(values.size());
+
+        for (unsigned c = 0; c < columnsUsed; c++)
+        {
+            history[c].grow((size_t)count * 3);
+
+            unsigned long long run = 0;
+            for (unsigned i = 0; i < count * 3; i++)
+            {
+                long long error = 0;
+                if (run > 0)
+                {
+                    run--;
+                }
+                else
+                {
+                    unsigned long long token;
+                    if (!getVarint(in, end, token) || (token == 0 && !getVarint(in, end, run)))
+                    {
+                        frameStarts.clear();
+                        return false;
+                    }
+                    if (token == 0) run--;
+                    else error = unzigzag(token);
+                }
+
+                int quantised = (int)(history[c].predict(i) + error);
+                history[c].push(i, quantised);
+                values.push_back((real)(quantised * (double)quantum));
+            }
+            if (run > 0)
+            {
+                frameStarts.clear();
+                return false;
+            }
+        }
+    }
+
+    cachedChunk = chunk;
+    return true;
+}
+
+bool TrajectoryReader::readFrame(unsigned long long frame, double *time,
+                                 std::vector<Vector3> *positions,
+                                 std::vector<Vector3> *velocities)
+{
+    if (frame >= frameCount) return false;
+
+    unsigned low = 0, high = (unsigned)chunks.size();
+    while (high - low > 1)
+    {
+        unsigned middle = (low + high) / 2;
+        if (chunks[middle].firstFrame <= frame) low = middle;
+        else high = middle;
+    }
+    if (!decode(low)) return false;
+
+    unsigned f = (unsigned)(frame - chunks[low].firstFrame);
+    unsigned count = counts[f];
+    const real *in = values.empty() ? NULL : &values[(size_t)frameStarts[f]];
+    if (time) *time = times[f];
+
+    std::vector<Vector3> *outputs[2] = {positions, velocities};
+    for (unsigned c = 0; c < 2; c++)
+    {
+        std::vector<Vector3> *out = outputs[c];
+        if (out) out->clear();
+        if ((columns & (1u << c)) == 0) continue;
+
+        if (out)
+        {
+            out->resize(count);
+            for (unsigned i = 0; i < count; i++)
+            {
+                (*out)[i] = Vector3(in[i * 3], in[i * 3 + 1], in[i * 3 + 2]);
+            }
+        }
+        in += count * 3;
+    }
+    return true;
+}